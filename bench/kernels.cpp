@@ -0,0 +1,286 @@
+// Microbenchmarks of the ray tracing kernels on synthetic ray sets, run with
+// `meson benchmark` or directly: bench [--reps N] [--cpu N] [--filter name]
+//
+// Every kernel is run for a few warmup repetitions, then timed over --reps
+// repetitions of the whole ray set on a thread pinned to one core. Reported
+// are ns per call (min, median, mean, stddev over the repetitions) and the
+// resulting calls per second.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "color.hpp"
+#include "material.hpp"
+#include "object.hpp"
+#include "parallel.hpp"
+#include "scene.hpp"
+#include "trace.hpp"
+#include "util.hpp"
+
+namespace {
+
+struct Options {
+  int warmup{3};
+  int reps{15};
+  int cpu{0};
+  std::string filter;
+};
+
+// keeps results alive so the kernels are not optimized away
+volatile std::uint64_t sink;
+
+bool pin_to_cpu(int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu % std::max(1u, std::thread::hardware_concurrency()), &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+struct Stats {
+  double min;
+  double median;
+  double mean;
+  double stddev;
+};
+
+Stats statistics(std::vector<double> samples) {
+  std::sort(samples.begin(), samples.end());
+  auto const n = static_cast<double>(samples.size());
+  auto const mean = std::accumulate(samples.begin(), samples.end(), 0.0) / n;
+  auto variance = 0.0;
+  for (auto s : samples)
+    variance += (s - mean) * (s - mean);
+  auto const middle = samples.size() / 2;
+  auto const median = samples.size() % 2 == 1
+                          ? samples[middle]
+                          : (samples[middle - 1] + samples[middle]) / 2.0;
+  return {samples.front(), median, mean,
+          samples.size() > 1 ? std::sqrt(variance / (n - 1)) : 0.0};
+}
+
+// `kernel` runs over the whole set and returns something depending on every
+// call, `calls` is how many kernel calls that is
+template <typename F>
+void run(Options const &options, char const *name, std::size_t calls,
+         F &&kernel) {
+  if (!options.filter.empty() &&
+      std::string_view(name).find(options.filter) == std::string_view::npos)
+    return;
+
+  using clock = std::chrono::steady_clock;
+  for (int i = 0; i < options.warmup; ++i)
+    sink = sink + kernel();
+
+  std::vector<double> ns_per_call;
+  ns_per_call.reserve(options.reps);
+  for (int i = 0; i < options.reps; ++i) {
+    auto const start = clock::now();
+    sink = sink + kernel();
+    auto const end = clock::now();
+    ns_per_call.push_back(
+        std::chrono::duration<double, std::nano>(end - start).count() / calls);
+  }
+
+  auto const s = statistics(std::move(ns_per_call));
+  std::printf("%-32s %10.2f %10.2f %10.2f %8.2f %14.0f\n", name, s.min,
+              s.median, s.mean, s.stddev, 1e9 / s.median);
+}
+
+ren::Object make_object(ren::Object::Type type, glm::vec3 translation,
+                        glm::vec3 scale,
+                        std::shared_ptr<ren::Material> const &material) {
+  ren::Object obj;
+  obj.set_type(type);
+  obj.set_translation(translation);
+  obj.set_scale(scale);
+  obj.set_material(material);
+  ren::assign_hit_functions(obj);
+  return obj;
+}
+
+// a plane and `n_spheres` spheres laid out like the default scene, plus its
+// light, built without meshes so no GL context is needed
+ren::Scene make_scene(std::size_t n_spheres) {
+  auto const diffuse =
+      ren::Material::create_material_from_scatter<ren::lambertian>(
+          color(0.1, 0.2, 0.5));
+  auto const light =
+      ren::Material::create_material_from_scatter<ren::diffuse_light>(
+          color(1.f, 1.f, 1.f));
+
+  ren::Scene scene;
+  scene.add_light(make_object(ren::Object::Type::sphere,
+                              glm::vec3(0.f, 10.f, 3.f), glm::vec3(0.1f),
+                              light));
+  scene.add_object(make_object(ren::Object::Type::plane,
+                               glm::vec3(0.f, -5.f, 0.f),
+                               glm::vec3(20.f, 1.f, 20.f), diffuse));
+  for (std::size_t i = 0; i < n_spheres; ++i) {
+    auto const p = glm::vec3((random_float() * 2 - 1) * 5, random_float() * 5,
+                             (random_float() * 2 - 1) * 5);
+    scene.add_object(
+        make_object(ren::Object::Type::sphere, p, glm::vec3(1.f), diffuse));
+  }
+  return scene;
+}
+
+// camera-like rays: origins around the scene, directions roughly towards it
+std::vector<ren::ray> make_rays(std::size_t n) {
+  std::vector<ren::ray> rays;
+  rays.reserve(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    auto const origin = random_vec3(-12.f, 12.f);
+    auto const target = random_vec3(-5.f, 5.f);
+    rays.emplace_back(origin, glm::normalize(target - origin));
+  }
+  return rays;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    auto const arg = std::string_view(argv[i]);
+    if (arg == "--reps")
+      options.reps = std::max(1, std::atoi(argv[i + 1]));
+    else if (arg == "--warmup")
+      options.warmup = std::max(0, std::atoi(argv[i + 1]));
+    else if (arg == "--cpu")
+      options.cpu = std::atoi(argv[i + 1]);
+    else if (arg == "--filter")
+      options.filter = argv[i + 1];
+  }
+
+  seed_random(5489);
+  if (!pin_to_cpu(options.cpu))
+    std::printf("warning: could not pin to cpu %d\n", options.cpu);
+
+  constexpr std::size_t n_rays = 1 << 16;
+  auto const rays = make_rays(n_rays);
+  auto const small_scene = make_scene(9);
+  auto const large_scene = make_scene(256);
+  auto const &sphere = small_scene.objects()[1];
+  auto const &plane = small_scene.objects()[0];
+
+  std::printf("%d warmup, %d timed repetitions of %zu rays, ns per call\n",
+              options.warmup, options.reps, n_rays);
+  std::printf("%-32s %10s %10s %10s %8s %14s\n", "kernel", "min", "median",
+              "mean", "stddev", "calls/s");
+
+  run(options, "sphere_hit", n_rays, [&] {
+    std::uint64_t hits = 0;
+    ren::hit_record rec;
+    for (auto const &r : rays)
+      hits += ren::sphere_hit(sphere, r, 0.001f, infinity, rec);
+    return hits;
+  });
+  run(options, "sphere_occluded", n_rays, [&] {
+    std::uint64_t hits = 0;
+    for (auto const &r : rays)
+      hits += ren::sphere_occluded(sphere, r, 0.001f, infinity);
+    return hits;
+  });
+  run(options, "plane_hit", n_rays, [&] {
+    std::uint64_t hits = 0;
+    ren::hit_record rec;
+    for (auto const &r : rays)
+      hits += ren::plane_hit(plane, r, 0.001f, infinity, rec);
+    return hits;
+  });
+  run(options, "plane_occluded", n_rays, [&] {
+    std::uint64_t hits = 0;
+    for (auto const &r : rays)
+      hits += ren::plane_occluded(plane, r, 0.001f, infinity);
+    return hits;
+  });
+
+  for (auto const *scene : {&small_scene, &large_scene}) {
+    auto const n_objects = scene->objects().size() + scene->lights().size();
+    auto const hit_name = "hit_scene " + std::to_string(n_objects);
+    run(options, hit_name.c_str(), n_rays, [&] {
+      std::uint64_t hits = 0;
+      ren::hit_record rec;
+      for (auto const &r : rays)
+        hits += ren::hit_scene(r, scene, rec);
+      return hits;
+    });
+    auto const occluded_name = "occluded " + std::to_string(n_objects);
+    run(options, occluded_name.c_str(), n_rays, [&] {
+      std::uint64_t hits = 0;
+      int last = -1;
+      for (auto const &r : rays)
+        hits += ren::occluded(r, scene, 100.f, &last);
+      return hits;
+    });
+  }
+
+  // every worker pinned to its own core, calls/s is the aggregate
+  auto const n_threads = ren::default_thread_count();
+  auto const mt_name = "hit_scene 256 x" + std::to_string(n_threads);
+  run(options, mt_name.c_str(), n_rays, [&] {
+    std::atomic<std::uint64_t> hits{0};
+    ren::parallel_for(
+        n_rays,
+        [&](std::size_t begin, std::size_t end, unsigned w) {
+          if (w != 0)
+            pin_to_cpu(options.cpu + static_cast<int>(w));
+          std::uint64_t local = 0;
+          ren::hit_record rec;
+          for (auto i = begin; i < end; ++i)
+            local += ren::hit_scene(rays[i], &large_scene, rec);
+          hits += local;
+        },
+        n_threads);
+    return hits.load();
+  });
+
+  run(options, "get_pixel_tuple", n_rays, [&] {
+    std::uint64_t sum = 0;
+    for (auto const &r : rays) {
+      auto const [x, y, z] =
+          ren::get_pixel_tuple(glm::abs(r.direction()) * 50.f, 50);
+      sum += x + y + z;
+    }
+    return sum;
+  });
+
+  run(options, "random_float", n_rays, [&] {
+    auto sum = 0.f;
+    for (std::size_t i = 0; i < n_rays; ++i)
+      sum += random_float();
+    return static_cast<std::uint64_t>(sum);
+  });
+  run(options, "random_unit_vector", n_rays, [&] {
+    auto sum = glm::vec3(0.f);
+    for (std::size_t i = 0; i < n_rays; ++i)
+      sum += random_unit_vector();
+    return static_cast<std::uint64_t>(glm::length(sum));
+  });
+  run(options, "random_in_unit_sphere", n_rays, [&] {
+    auto sum = glm::vec3(0.f);
+    for (std::size_t i = 0; i < n_rays; ++i)
+      sum += random_in_unit_sphere();
+    return static_cast<std::uint64_t>(glm::length(sum));
+  });
+}
@@ -0,0 +1,15 @@
+#version 330 core
+out vec4 frag_color;
+
+uniform sampler2D g_albedo;
+uniform sampler2D g_depth;
+uniform vec3 ambient;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	// keep the clear color where nothing was drawn
+	if (texelFetch(g_depth, texel, 0).r == 1.0)
+		discard;
+	frag_color = vec4(ambient * texelFetch(g_albedo, texel, 0).rgb, 1.0);
+}
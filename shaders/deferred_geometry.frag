@@ -0,0 +1,14 @@
+#version 330 core
+// rgb albedo, a specular strength
+layout (location = 0) out vec4 g_albedo;
+// xyz world space normal, w shininess
+layout (location = 1) out vec4 g_normal;
+
+in vec3 normal;
+flat in vec4 base_color;
+
+void main()
+{
+	g_albedo = vec4(base_color.rgb, 0.5);
+	g_normal = vec4(normalize(normal), base_color.a);
+}
@@ -0,0 +1,26 @@
+#version 330 core
+layout (location = 0) in vec3 a_pos;
+layout (location = 1) in vec3 a_normal;
+// per instance, see InstanceData
+layout (location = 3) in mat4 i_model;
+layout (location = 7) in mat4 i_normal_matrix;
+
+out vec3 normal;
+flat out vec4 base_color;
+
+layout (std140) uniform Frame {
+	mat4 projection;
+	mat4 view;
+	vec4 view_pos;
+	vec4 light_pos;
+	vec4 light_color;
+} frame;
+
+void main()
+{
+	normal = mat3(i_normal_matrix) * a_normal;
+	// rgb color, a shininess
+	base_color = i_normal_matrix[3];
+
+	gl_Position = frame.projection * frame.view * i_model * vec4(a_pos, 1.0f);
+}
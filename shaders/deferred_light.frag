@@ -0,0 +1,55 @@
+#version 330 core
+out vec4 frag_color;
+
+flat in vec4 light;
+flat in vec3 light_color;
+
+layout (std140) uniform Frame {
+	mat4 projection;
+	mat4 view;
+	vec4 view_pos;
+	vec4 light_pos;
+	vec4 light_color;
+} frame;
+
+uniform sampler2D g_albedo;
+uniform sampler2D g_normal;
+uniform sampler2D g_depth;
+uniform mat4 inv_view_proj;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(g_depth, texel, 0).r;
+	if (depth == 1.0)
+		discard;
+
+	// world position from the depth buffer
+	vec2 uv = gl_FragCoord.xy / vec2(textureSize(g_depth, 0));
+	vec4 ndc = vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	vec4 world = inv_view_proj * ndc;
+	vec3 pos = world.xyz / world.w;
+
+	vec3 to_light = light.xyz - pos;
+	float dist2 = dot(to_light, to_light);
+	float radius2 = light.w * light.w;
+	if (dist2 >= radius2)
+		discard;
+	// smooth falloff reaching zero at the radius, so the volume bounds the
+	// light exactly
+	float window = clamp(1.0 - dist2 / radius2, 0.0, 1.0);
+	float attenuation = window * window;
+
+	vec4 albedo = texelFetch(g_albedo, texel, 0);
+	vec4 normal = texelFetch(g_normal, texel, 0);
+	vec3 n = normalize(normal.xyz);
+	vec3 light_dir = to_light * inversesqrt(dist2);
+	float diff = max(dot(n, light_dir), 0.0);
+
+	vec3 view_dir = normalize(frame.view_pos.xyz - pos);
+	vec3 halfway = normalize(light_dir + view_dir);
+	float spec = pow(max(dot(n, halfway), 0.0), normal.w);
+
+	vec3 res = light_color * attenuation * (diff * albedo.rgb + spec * albedo.a);
+	frag_color = vec4(res, 1.0);
+}
@@ -0,0 +1,26 @@
+#version 330 core
+layout (location = 0) in vec3 a_pos;
+// per light: xyz position, w radius
+layout (location = 3) in vec4 i_light;
+// per light: rgb color premultiplied by the intensity
+layout (location = 4) in vec3 i_color;
+
+flat out vec4 light;
+flat out vec3 light_color;
+
+layout (std140) uniform Frame {
+	mat4 projection;
+	mat4 view;
+	vec4 view_pos;
+	vec4 light_pos;
+	vec4 light_color;
+} frame;
+
+void main()
+{
+	light = i_light;
+	light_color = i_color;
+	// a_pos is a sphere enclosing the unit sphere
+	vec3 pos = i_light.xyz + a_pos * i_light.w;
+	gl_Position = frame.projection * frame.view * vec4(pos, 1.0);
+}
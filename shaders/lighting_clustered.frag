@@ -0,0 +1,61 @@
+#version 330 core
+out vec4 frag_color;
+
+in vec3 pos;
+in vec3 normal;
+in float view_depth;
+flat in vec4 base_color;
+
+layout (std140) uniform Frame {
+	mat4 projection;
+	mat4 view;
+	vec4 view_pos;
+	vec4 light_pos;
+	vec4 light_color;
+} frame;
+
+// see LightClusters: per cluster the offset into light_indices and the count
+uniform usamplerBuffer cluster_grid;
+uniform usamplerBuffer light_indices;
+// two texels per light, xyz position and radius, then the color
+uniform samplerBuffer light_data;
+
+uniform ivec3 clusters;
+uniform vec2 tile_size;
+// slice = log(depth) * x - y
+uniform vec2 slicing;
+uniform vec3 ambient;
+
+void main()
+{
+	ivec2 tile = min(ivec2(gl_FragCoord.xy / tile_size), clusters.xy - 1);
+	int slice = clamp(int(floor(log(view_depth) * slicing.x - slicing.y)), 0,
+	                  clusters.z - 1);
+	int cluster = tile.x + clusters.x * (tile.y + clusters.y * slice);
+	uvec2 range = texelFetch(cluster_grid, cluster).xy;
+
+	vec3 norm = normalize(normal);
+	vec3 view_dir = normalize(frame.view_pos.xyz - pos);
+	vec3 res = ambient * base_color.rgb;
+	for (uint i = 0u; i < range.y; ++i) {
+		int light = int(texelFetch(light_indices, int(range.x + i)).r);
+		vec4 light_pos = texelFetch(light_data, 2 * light);
+		vec3 light_color = texelFetch(light_data, 2 * light + 1).rgb;
+
+		vec3 to_light = light_pos.xyz - pos;
+		float dist2 = dot(to_light, to_light);
+		float radius2 = light_pos.w * light_pos.w;
+		if (dist2 >= radius2)
+			continue;
+		// same falloff as the deferred renderer, zero at the radius
+		float window = clamp(1.0 - dist2 / radius2, 0.0, 1.0);
+		float attenuation = window * window;
+
+		vec3 light_dir = to_light * inversesqrt(dist2);
+		float diff = max(dot(norm, light_dir), 0.0);
+		vec3 halfway = normalize(light_dir + view_dir);
+		float spec = pow(max(dot(norm, halfway), 0.0), base_color.a);
+		res += light_color * attenuation * (diff * base_color.rgb + spec * 0.5);
+	}
+	frag_color = vec4(res, 1.0);
+}
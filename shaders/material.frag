@@ -1,41 +1,37 @@
 #version 330 core
 out vec4 frag_color;
 
-struct Material {
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-	float shininess;
-};
-
-struct Light {
-	vec3 position;
-
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-};
+layout (std140) uniform Frame {
+	mat4 projection;
+	mat4 view;
+	vec4 view_pos;
+	vec4 light_pos;
+	vec4 light_color;
+} frame;
+
+layout (std140) uniform Material {
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular; // w is the shininess
+} material;
 
 in vec3 pos;
 in vec3 normal;
 
-uniform vec3 view_pos;
-uniform Material material;
-uniform Light light;
-
 void main()
 {
-	vec3 ambient = light.ambient * material.ambient;
+	vec3 light_color = frame.light_color.rgb;
+	vec3 ambient = light_color * material.ambient.rgb;
 
 	vec3 norm = normalize(normal);
-	vec3 light_dir = normalize(light.position - pos);
+	vec3 light_dir = normalize(frame.light_pos.xyz - pos);
 	float diff = max(dot(norm, light_dir), 0.0);
-	vec3 diffuse = light.diffuse * (diff * material.diffuse);
+	vec3 diffuse = light_color * (diff * material.diffuse.rgb);
 
-	vec3 view_dir = normalize(view_pos - pos);
+	vec3 view_dir = normalize(frame.view_pos.xyz - pos);
 	vec3 reflect_dir = reflect(-light_dir, norm);
-	float spec = pow(max(dot(view_dir, reflect_dir), 0.0), material.shininess);
-	vec3 specular = light.specular * (spec * material.specular);
+	float spec = pow(max(dot(view_dir, reflect_dir), 0.0), material.specular.w);
+	vec3 specular = light_color * (spec * material.specular.rgb);
 
 	vec3 res = ambient + diffuse + specular;
 	frag_color = vec4(res, 1.0);
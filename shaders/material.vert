@@ -1,19 +1,25 @@
 #version 330 core
 layout (location = 0) in vec3 a_pos;
 layout (location = 1) in vec3 a_normal;
+// per instance, see InstanceData
+layout (location = 3) in mat4 i_model;
+layout (location = 7) in mat4 i_normal_matrix;
 
 out vec3 pos;
 out vec3 normal;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform Frame {
+	mat4 projection;
+	mat4 view;
+	vec4 view_pos;
+	vec4 light_pos;
+	vec4 light_color;
+} frame;
 
 void main()
 {
-	pos = vec3(model * vec4(a_pos, 1.0));
-	normal = mat3(transpose(inverse(model))) * a_normal;
+	pos = vec3(i_model * vec4(a_pos, 1.0));
+	normal = mat3(i_normal_matrix) * a_normal;
 
-	// gl_Position = projection * view * model * vec4(pos.xyz, 1.0f);
-	gl_Position = projection * view * vec4(pos, 1.0f);
+	gl_Position = frame.projection * frame.view * vec4(pos, 1.0f);
 }
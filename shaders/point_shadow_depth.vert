@@ -1,9 +1,14 @@
 #version 330 core
 layout (location = 0) in vec3 a_pos;
+// per instance, see InstanceData
+layout (location = 3) in mat4 i_model;
 
-uniform mat4 model;
+uniform mat4 shadow_matrix; // projection * view of the cube face being drawn
+
+out vec4 frag_pos;
 
 void main()
 {
-	gl_Position = model * vec4(a_pos, 1.0);
+	frag_pos = i_model * vec4(a_pos, 1.0);
+	gl_Position = shadow_matrix * frag_pos;
 }
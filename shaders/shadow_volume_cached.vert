@@ -0,0 +1,13 @@
+#version 330 core
+
+// volumes built on the CPU, w = 0 for vertices extruded to infinity
+layout (location = 0) in vec4 Position;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    gl_Position = projection * view * model * Position;
+}
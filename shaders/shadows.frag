@@ -1,9 +1,13 @@
 #version 330 core
 out vec4 frag_color;
 
-struct Light {
-	vec3 position;
-};
+layout (std140) uniform Frame {
+	mat4 projection;
+	mat4 view;
+	vec4 view_pos;
+	vec4 light_pos;
+	vec4 light_color;
+} frame;
 
 in VS_OUT {
    vec3 pos;
@@ -11,29 +15,65 @@ in VS_OUT {
    vec2 tex_coords;
 } fs_in;
 
+// ShadowMappingRenderer::max_lights
+const int max_lights = 8;
+
 // uniform	sampler2D diffuse_texture;
-uniform	samplerCube depth_map;
-uniform Light light;
-uniform vec3 view_pos;
+// the shadow atlas, every light has one tile per cube face
+uniform	sampler2D depth_map;
+uniform int n_lights;
+uniform vec3 light_pos[max_lights];
+// per light and face the tile in depth_map, xy origin and zw size, an empty
+// tile is not drawn yet and casts no shadow
+uniform vec4 face_rect[max_lights * 6];
 
 uniform float far_plane;
 
-float shadow_calculation(vec3 frag_pos)
+// face and coordinates of `v` in a cube map, in the orientation the faces
+// were drawn in
+int cube_face(vec3 v, out vec2 uv)
+{
+    vec3 a = abs(v);
+    int face;
+    float ma;
+    if (a.x >= a.y && a.x >= a.z) {
+        face = v.x > 0.0 ? 0 : 1;
+        ma = a.x;
+        uv = vec2(v.x > 0.0 ? -v.z : v.z, -v.y);
+    } else if (a.y >= a.z) {
+        face = v.y > 0.0 ? 2 : 3;
+        ma = a.y;
+        uv = vec2(v.x, v.y > 0.0 ? v.z : -v.z);
+    } else {
+        face = v.z > 0.0 ? 4 : 5;
+        ma = a.z;
+        uv = vec2(v.z > 0.0 ? v.x : -v.x, -v.y);
+    }
+    uv = uv / ma * 0.5 + 0.5;
+    return face;
+}
+
+float shadow_calculation(int light, vec3 frag_pos)
 {
     // get vector between fragment position and light position
-    vec3 frag_to_light = frag_pos - light.position;
-    // use the fragment to light vector to sample from the depth map
-    float closest_depth = texture(depth_map, frag_to_light).r;
+    vec3 frag_to_light = frag_pos - light_pos[light];
+    vec2 uv;
+    int face = cube_face(frag_to_light, uv);
+    vec4 rect = face_rect[light * 6 + face];
+    if (rect.z == 0.0)
+        return 0.0;
+    // stay half a texel inside the tile
+    vec2 half_texel = 0.5 / vec2(textureSize(depth_map, 0));
+    vec2 atlas_uv = clamp(rect.xy + uv * rect.zw, rect.xy + half_texel,
+                          rect.xy + rect.zw - half_texel);
+    float closest_depth = texture(depth_map, atlas_uv).r;
     // it is currently in linear range between [0,1], let's re-transform it back to original depth value
     closest_depth *= far_plane;
     // now get current linear depth as the length between the fragment and light position
     float current_depth = length(frag_to_light);
     // test for shadows
     float bias = 0.05; // we use a much larger bias since depth is now in [near_plane, far_plane] range
-    float shadow = current_depth -  bias > closest_depth ? 1.0 : 0.0;
-    frag_color = vec4(vec3(closest_depth / far_plane), 1.0);
-
-    return shadow;
+    return current_depth -  bias > closest_depth ? 1.0 : 0.0;
 }
 
 void main()
@@ -43,23 +83,21 @@ void main()
 	vec3 light_color = vec3(0.3);
 
 	vec3 ambient = 0.3 * color;
+	vec3 view_dir = normalize(frame.view_pos.xyz - fs_in.pos);
 
-	vec3 light_dir = normalize(light.position - fs_in.pos);
-	float diff = max(dot(light_dir, norm), 0.0);
-	vec3 diffuse = diff * light_color;
-
-	vec3 view_dir = normalize(view_pos - fs_in.pos);
-	vec3 reflect_dir = reflect(-light_dir, norm);
-
-	vec3 halfway_dir = normalize(light_dir + view_dir);
-	float spec = pow(max(dot(norm, halfway_dir), 0.0), 64.0);
-	vec3 specular = spec * light_color;
+	vec3 lighting = ambient;
+	for (int i = 0; i < n_lights; ++i) {
+		vec3 light_dir = normalize(light_pos[i] - fs_in.pos);
+		float diff = max(dot(light_dir, norm), 0.0);
+		vec3 diffuse = diff * light_color;
 
+		vec3 halfway_dir = normalize(light_dir + view_dir);
+		float spec = pow(max(dot(norm, halfway_dir), 0.0), 64.0);
+		vec3 specular = spec * light_color;
 
-	float bias = max(0.05 * (1.0 - dot(norm, light_dir)), 0.005);
-	float shadow = shadow_calculation(fs_in.pos);
-	vec3 lighting = (ambient + (1.0 - shadow) * (diffuse + specular)) * color;
+		float shadow = shadow_calculation(i, fs_in.pos);
+		lighting += (1.0 - shadow) * (diffuse + specular);
+	}
 
-	//	vec3 res = ambient + diffuse + specular;
-	frag_color = vec4(lighting, 1.0);
+	frag_color = vec4(lighting * color, 1.0);
 }
@@ -2,6 +2,9 @@
 layout (location = 0) in vec3 a_pos;
 layout (location = 1) in vec3 a_normal;
 layout (location = 2) in vec2 a_tex_coords;
+// per instance, see InstanceData
+layout (location = 3) in mat4 i_model;
+layout (location = 7) in mat4 i_normal_matrix;
 
 out VS_OUT {
 	vec3 pos;
@@ -9,16 +12,20 @@ out VS_OUT {
 	vec2 tex_coords;
 } vs_out;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform Frame {
+	mat4 projection;
+	mat4 view;
+	vec4 view_pos;
+	vec4 light_pos;
+	vec4 light_color;
+} frame;
 
 void main()
 {
-	vs_out.pos = vec3(model * vec4(a_pos, 1.0));
-	vs_out.normal = mat3(transpose(inverse(model))) * a_normal;
+	vs_out.pos = vec3(i_model * vec4(a_pos, 1.0));
+	vs_out.normal = mat3(i_normal_matrix) * a_normal;
 
 	vs_out.tex_coords = a_tex_coords;
 
-	gl_Position = projection * view * model * vec4(a_pos.xyz, 1.0);
+	gl_Position = frame.projection * frame.view * vec4(vs_out.pos, 1.0);
 }
@@ -0,0 +1,264 @@
+#include "adjacency.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "parallel.hpp"
+
+namespace ren {
+
+namespace {
+
+constexpr GLuint none = 0xFFFFFFFF;
+// below this a single thread is faster than starting more
+constexpr std::size_t min_triangles_per_thread = 16384;
+// items per hash bucket, small enough for a bucket's table to stay in cache
+constexpr std::size_t bucket_items = 2048;
+
+std::uint64_t mix(std::uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ull;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBull;
+  x ^= x >> 31;
+  return x;
+}
+
+std::uint64_t position_hash(glm::vec3 const &p) {
+  std::uint32_t bits[3];
+  for (int k = 0; k < 3; ++k) {
+    auto const f = p[k] + 0.f; // -0 hashes like 0
+    std::memcpy(&bits[k], &f, sizeof(f));
+  }
+  return mix(bits[0] | static_cast<std::uint64_t>(bits[1]) << 32) ^
+         mix(bits[2] + 0x9E3779B97F4A7C15ull);
+}
+
+// Items grouped by the high bits of their hash, bucket k holds
+// items[offsets[k]] .. items[offsets[k + 1]] in ascending order.
+struct Buckets {
+  std::vector<std::size_t> offsets;
+  std::vector<GLuint> items;
+  unsigned bits;
+
+  std::size_t bucket(std::uint64_t hash) const {
+    return bits == 0 ? 0 : hash >> (64 - bits);
+  }
+  std::size_t size() const { return offsets.size() - 1; }
+};
+
+// Stable counting sort of [0, n) by hash bucket, items with a hash of 0 are
+// left out. Every thread counts and scatters its own range of items.
+Buckets make_buckets(std::vector<std::uint64_t> const &hashes,
+                     unsigned n_threads) {
+  auto const n = hashes.size();
+  Buckets b{};
+  while (b.bits < 24 && (std::size_t{1} << b.bits) * bucket_items < n)
+    ++b.bits;
+  auto const n_buckets = std::size_t{1} << b.bits;
+
+  std::vector<std::vector<std::size_t>> counts(
+      n_threads, std::vector<std::size_t>(n_buckets, 0));
+  parallel_for(
+      n,
+      [&](std::size_t begin, std::size_t end, unsigned w) {
+        for (auto i = begin; i < end; ++i)
+          if (hashes[i] != 0)
+            ++counts[w][b.bucket(hashes[i])];
+      },
+      n_threads);
+
+  // bucket major prefix sum keeps every bucket in item order
+  b.offsets.assign(n_buckets + 1, 0);
+  std::size_t total = 0;
+  for (std::size_t k = 0; k < n_buckets; ++k) {
+    b.offsets[k] = total;
+    for (auto &c : counts) {
+      auto const count = c[k];
+      c[k] = total;
+      total += count;
+    }
+  }
+  b.offsets[n_buckets] = total;
+
+  b.items.resize(total);
+  parallel_for(
+      n,
+      [&](std::size_t begin, std::size_t end, unsigned w) {
+        for (auto i = begin; i < end; ++i)
+          if (hashes[i] != 0)
+            b.items[counts[w][b.bucket(hashes[i])]++] = static_cast<GLuint>(i);
+      },
+      n_threads);
+  return b;
+}
+
+// open addressing table with at least twice as many slots as items
+template <typename T>
+void reset_table(std::vector<T> &table, std::size_t n_items, T const &empty) {
+  std::size_t size = 16;
+  while (size < n_items * 2)
+    size *= 2;
+  table.assign(size, empty);
+}
+
+} // namespace
+
+std::vector<GLuint> build_adjacency(std::vector<Vertex> const &vertices,
+                                    std::vector<GLuint> const &indices,
+                                    unsigned n_threads) {
+  auto const n_tris = indices.size() / 3;
+  auto const n_half_edges = n_tris * 3;
+  auto const n_vertices = vertices.size();
+  if (n_threads == 0)
+    n_threads = default_thread_count();
+  n_threads = static_cast<unsigned>(std::clamp<std::size_t>(
+      n_tris / min_triangles_per_thread, 1, n_threads));
+
+  // weld: every vertex maps to the first vertex with the same position
+  std::vector<std::uint64_t> hashes(n_vertices);
+  parallel_for(
+      n_vertices,
+      [&](std::size_t begin, std::size_t end, unsigned) {
+        for (auto v = begin; v < end; ++v)
+          hashes[v] = position_hash(vertices[v].pos) | 1;
+      },
+      n_threads);
+
+  std::vector<GLuint> canonical(n_vertices);
+  {
+    auto const buckets = make_buckets(hashes, n_threads);
+    parallel_for(
+        buckets.size(),
+        [&](std::size_t begin, std::size_t end, unsigned) {
+          std::vector<GLuint> table;
+          for (auto k = begin; k < end; ++k) {
+            auto const first = buckets.offsets[k];
+            auto const last = buckets.offsets[k + 1];
+            reset_table(table, last - first, none);
+            auto const mask = table.size() - 1;
+            for (auto i = first; i < last; ++i) {
+              auto const v = buckets.items[i];
+              auto slot = hashes[v] & mask;
+              while (table[slot] != none &&
+                     vertices[table[slot]].pos != vertices[v].pos)
+                slot = (slot + 1) & mask;
+              if (table[slot] == none)
+                table[slot] = v;
+              canonical[v] = table[slot];
+            }
+          }
+        },
+        n_threads);
+  }
+
+  // undirected edge key and direction per half-edge, degenerate edges get no
+  // key and stay open
+  std::vector<std::uint64_t> keys(n_half_edges);
+  std::vector<std::uint8_t> forward(n_half_edges);
+  parallel_for(
+      n_tris,
+      [&](std::size_t begin, std::size_t end, unsigned) {
+        for (auto t = begin; t < end; ++t) {
+          GLuint const v[3] = {canonical[indices[t * 3]],
+                               canonical[indices[t * 3 + 1]],
+                               canonical[indices[t * 3 + 2]]};
+          for (std::size_t k = 0; k < 3; ++k) {
+            auto const a = v[k], b = v[(k + 1) % 3];
+            auto const lo = static_cast<std::uint64_t>(std::min(a, b));
+            auto const hi = static_cast<std::uint64_t>(std::max(a, b));
+            forward[t * 3 + k] = a < b;
+            keys[t * 3 + k] = a == b ? 0 : lo << 32 | hi;
+          }
+        }
+      },
+      n_threads);
+
+  // pair the half-edges of every edge, oppositely wound partners first, then
+  // whatever is left over from inconsistently wound or non-manifold input
+  std::vector<GLuint> neighbor(n_half_edges, none);
+  {
+    std::vector<std::uint64_t> edge_hashes(n_half_edges);
+    parallel_for(
+        n_half_edges,
+        [&](std::size_t begin, std::size_t end, unsigned) {
+          for (auto h = begin; h < end; ++h)
+            edge_hashes[h] = keys[h] == 0 ? 0 : mix(keys[h]) | 1;
+        },
+        n_threads);
+
+    auto const buckets = make_buckets(edge_hashes, n_threads);
+    parallel_for(
+        buckets.size(),
+        [&](std::size_t begin, std::size_t end, unsigned) {
+          struct Slot {
+            std::uint64_t key;
+            GLuint first; // chain of bucket positions linked through `next`
+          };
+          std::vector<Slot> table;
+          std::vector<GLuint> next;
+          for (auto k = begin; k < end; ++k) {
+            auto const first = buckets.offsets[k];
+            auto const last = buckets.offsets[k + 1];
+            reset_table(table, last - first, Slot{0, none});
+            next.assign(last - first, none);
+            auto const mask = table.size() - 1;
+            // walking backwards leaves every chain in triangle order
+            for (auto i = last; i-- > first;) {
+              auto const h = buckets.items[i];
+              auto slot = edge_hashes[h] & mask;
+              while (table[slot].key != 0 && table[slot].key != keys[h])
+                slot = (slot + 1) & mask;
+              table[slot].key = keys[h];
+              next[i - first] = table[slot].first;
+              table[slot].first = static_cast<GLuint>(i - first);
+            }
+
+            for (auto const &slot : table) {
+              if (slot.key == 0)
+                continue;
+              for (bool opposite : {true, false}) {
+                for (auto i = slot.first; i != none; i = next[i]) {
+                  auto const h = buckets.items[first + i];
+                  if (neighbor[h] != none)
+                    continue;
+                  for (auto j = next[i]; j != none; j = next[j]) {
+                    auto const g = buckets.items[first + j];
+                    if (neighbor[g] == none &&
+                        (!opposite || forward[g] != forward[h])) {
+                      neighbor[h] = g;
+                      neighbor[g] = h;
+                      break;
+                    }
+                  }
+                }
+              }
+            }
+          }
+        },
+        n_threads);
+  }
+
+  std::vector<GLuint> out(n_tris * 6);
+  parallel_for(
+      n_tris,
+      [&](std::size_t begin, std::size_t end, unsigned) {
+        for (auto t = begin; t < end; ++t) {
+          for (std::size_t k = 0; k < 3; ++k) {
+            auto const h = t * 3 + k;
+            auto const g = neighbor[h];
+            // the vertex opposite of an edge is the one after its end
+            auto const adjacent = g != none
+                                      ? indices[g - g % 3 + (g + 2) % 3]
+                                      : indices[t * 3 + (k + 2) % 3];
+            out[t * 6 + k * 2] = indices[h];
+            out[t * 6 + k * 2 + 1] = adjacent;
+          }
+        }
+      },
+      n_threads);
+  return out;
+}
+
+} // namespace ren
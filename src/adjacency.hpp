@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vector>
+
+#include "mesh.hpp"
+
+namespace ren {
+
+// Turns a triangle list into GL_TRIANGLES_ADJACENCY indices (v0, a01, v1, a12,
+// v2, a20 per triangle). Vertices are welded by position first, so seams in
+// normals or texture coordinates don't split edges. An edge is paired with an
+// oppositely wound edge where possible; edges shared by more than two
+// triangles are paired first come first served and the rest, like open edges,
+// point back at the triangle's own opposite vertex, which makes them always
+// count as silhouette edges.
+std::vector<GLuint> build_adjacency(std::vector<Vertex> const &vertices,
+                                    std::vector<GLuint> const &indices,
+                                    unsigned n_threads = 0);
+
+} // namespace ren
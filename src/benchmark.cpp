@@ -0,0 +1,222 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+
+#include "log.hpp"
+#include "util.hpp"
+
+namespace ren {
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+double seconds_since(clock::time_point start) {
+  return std::chrono::duration<double>(clock::now() - start).count();
+}
+
+} // namespace
+
+CameraPath CameraPath::orbit(float radius, float height, float duration) {
+  CameraPath path;
+  constexpr int steps = 64;
+  for (int i = 0; i <= steps; ++i) {
+    auto const t = duration * static_cast<float>(i) / steps;
+    auto const angle = 2.f * pi * static_cast<float>(i) / steps;
+    Keyframe k;
+    k.time = t;
+    k.camera = glm::vec3(glm::sin(angle) * radius, height,
+                         glm::cos(angle) * radius);
+    auto const front = glm::normalize(-k.camera);
+    k.yaw = glm::degrees(std::atan2(front.z, front.x));
+    k.pitch = glm::degrees(std::asin(front.y));
+    k.light = glm::vec3(glm::sin(t) * 3.f, 10.f, glm::cos(t) * 3.f);
+    path.add(k);
+  }
+  return path;
+}
+
+std::optional<CameraPath> CameraPath::load(std::filesystem::path const &path) {
+  std::ifstream in(path);
+  if (!in) {
+    Log::the().add_log("CameraPath: cannot open %s\n", path.c_str());
+    return std::nullopt;
+  }
+
+  CameraPath out;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream fields(line);
+    Keyframe k;
+    if (!(fields >> k.time >> k.camera.x >> k.camera.y >> k.camera.z >>
+          k.yaw >> k.pitch >> k.light.x >> k.light.y >> k.light.z)) {
+      Log::the().add_log("CameraPath: bad keyframe '%s'\n", line.c_str());
+      return std::nullopt;
+    }
+    if (!out.empty() && k.time < out.duration()) {
+      Log::the().add_log("CameraPath: keyframes out of order in %s\n",
+                         path.c_str());
+      return std::nullopt;
+    }
+    out.add(k);
+  }
+  return out;
+}
+
+bool CameraPath::save(std::filesystem::path const &path) const {
+  std::ofstream out(path);
+  out << "# time camera.xyz yaw pitch light.xyz\n";
+  for (auto const &k : m_keyframes)
+    out << k.time << ' ' << k.camera.x << ' ' << k.camera.y << ' '
+        << k.camera.z << ' ' << k.yaw << ' ' << k.pitch << ' ' << k.light.x
+        << ' ' << k.light.y << ' ' << k.light.z << '\n';
+  Log::the().add_log("CameraPath: wrote %zu keyframes to %s\n",
+                     m_keyframes.size(), path.c_str());
+  return out.good();
+}
+
+Keyframe CameraPath::sample(float time) const {
+  if (m_keyframes.empty())
+    return {};
+  auto const next = std::upper_bound(
+      m_keyframes.begin(), m_keyframes.end(), time,
+      [](float t, Keyframe const &k) { return t < k.time; });
+  if (next == m_keyframes.begin())
+    return m_keyframes.front();
+  if (next == m_keyframes.end())
+    return m_keyframes.back();
+
+  auto const &a = *(next - 1);
+  auto const &b = *next;
+  auto const span = b.time - a.time;
+  auto const f = span > 0.f ? (time - a.time) / span : 0.f;
+  Keyframe k;
+  k.time = time;
+  k.camera = glm::mix(a.camera, b.camera, f);
+  // take the short way around
+  auto yaw_delta = std::fmod(b.yaw - a.yaw + 540.f, 360.f) - 180.f;
+  k.yaw = a.yaw + yaw_delta * f;
+  k.pitch = a.pitch + (b.pitch - a.pitch) * f;
+  k.light = glm::mix(a.light, b.light, f);
+  return k;
+}
+
+double Benchmark::Result::min() const {
+  return frame_ms.empty() ? 0.0
+                          : *std::min_element(frame_ms.begin(), frame_ms.end());
+}
+
+double Benchmark::Result::mean() const {
+  return frame_ms.empty() ? 0.0
+                          : std::accumulate(frame_ms.begin(), frame_ms.end(),
+                                            0.0) /
+                                frame_ms.size();
+}
+
+double Benchmark::Result::percentile(double p) const {
+  if (frame_ms.empty())
+    return 0.0;
+  auto sorted = frame_ms;
+  std::sort(sorted.begin(), sorted.end());
+  auto const rank = static_cast<std::size_t>(
+      std::ceil(std::clamp(p, 0.0, 1.0) * sorted.size()));
+  return sorted[std::max<std::size_t>(rank, 1) - 1];
+}
+
+void Benchmark::start(CameraPath path, std::vector<std::string> renderers,
+                      Settings const &settings) {
+  m_path = std::move(path);
+  if (m_path.empty())
+    m_path = CameraPath::orbit();
+  m_renderers = std::move(renderers);
+  m_settings = settings;
+  // the last warmup frame is where rays and time start counting
+  m_settings.warmup_frames = std::max(m_settings.warmup_frames, 1);
+  m_settings.frames = std::max(m_settings.frames, 1);
+  m_results.clear();
+  m_renderer = 0;
+  m_frame = 0;
+  m_running = !m_renderers.empty();
+  if (m_running)
+    Log::the().add_log("Benchmark: %zu renderers, %d frames each, seed %u\n",
+                       m_renderers.size(), m_settings.frames,
+                       m_settings.seed);
+}
+
+Benchmark::Step Benchmark::step() const {
+  Step s{};
+  s.renderer = m_renderer;
+  s.first = m_frame == 0;
+  s.measured = m_frame >= m_settings.warmup_frames;
+  s.ticks = m_frame * m_settings.timestep;
+  auto const duration = m_path.duration();
+  auto const t = duration > 0.f
+                     ? std::fmod(static_cast<float>(s.ticks), duration)
+                     : 0.f;
+  s.pose = m_path.sample(t);
+  return s;
+}
+
+void Benchmark::finish_frame(double ms, std::uint64_t rays) {
+  if (!m_running)
+    return;
+
+  if (m_frame == m_settings.warmup_frames - 1) {
+    m_results.push_back({m_renderers[m_renderer], {}, 0, 0.0});
+    m_results.back().frame_ms.reserve(m_settings.frames);
+    m_first_rays = rays;
+    m_start = clock::now();
+  } else if (m_frame >= m_settings.warmup_frames) {
+    auto &result = m_results.back();
+    result.frame_ms.push_back(ms);
+    result.rays = rays - m_first_rays;
+    result.seconds = seconds_since(m_start);
+  }
+
+  if (++m_frame < m_settings.warmup_frames + m_settings.frames)
+    return;
+
+  auto const &result = m_results.back();
+  Log::the().add_log("Benchmark %s: min %.3f ms, mean %.3f ms, p99 %.3f ms, "
+                     "%.0f rays/s\n",
+                     result.renderer.c_str(), result.min(), result.mean(),
+                     result.percentile(0.99), result.rays_per_second());
+  m_frame = 0;
+  if (++m_renderer == m_renderers.size())
+    m_running = false;
+}
+
+void Benchmark::write_json(std::ostream &out) const {
+  out << "{\"seed\": " << m_settings.seed
+      << ", \"timestep\": " << m_settings.timestep
+      << ", \"warmup_frames\": " << m_settings.warmup_frames
+      << ", \"frames\": " << m_settings.frames
+      << ", \"path_seconds\": " << m_path.duration() << ", \"renderers\": [";
+  for (std::size_t i = 0; i < m_results.size(); ++i) {
+    auto const &r = m_results[i];
+    out << (i == 0 ? "" : ", ") << "{\"name\": \"" << r.renderer
+        << "\", \"frames\": " << r.frame_ms.size()
+        << ", \"min_ms\": " << r.min() << ", \"mean_ms\": " << r.mean()
+        << ", \"p50_ms\": " << r.percentile(0.5)
+        << ", \"p99_ms\": " << r.percentile(0.99)
+        << ", \"max_ms\": " << r.percentile(1.0) << ", \"rays\": " << r.rays
+        << ", \"rays_per_second\": " << r.rays_per_second() << "}";
+  }
+  out << "]}";
+}
+
+bool Benchmark::dump(std::filesystem::path const &path) const {
+  std::ofstream out(path);
+  write_json(out);
+  out << '\n';
+  Log::the().add_log("Benchmark: wrote %s\n", path.c_str());
+  return out.good();
+}
+
+} // namespace ren
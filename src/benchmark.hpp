@@ -0,0 +1,112 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+namespace ren {
+
+// camera and light state at a point in time of a flythrough
+struct Keyframe {
+  float time{0.f};
+  glm::vec3 camera{0.f};
+  float yaw{-90.f};
+  float pitch{0.f};
+  glm::vec3 light{0.f};
+};
+
+// A recorded camera and light path, sampled by linear interpolation between
+// keyframes. Stored as text, one `time cx cy cz yaw pitch lx ly lz` per line.
+class CameraPath {
+public:
+  // circles the origin looking at it while the light circles overhead, like
+  // the interactive scene does
+  static CameraPath orbit(float radius = 8.f, float height = 3.f,
+                          float duration = 10.f);
+  static std::optional<CameraPath> load(std::filesystem::path const &path);
+  bool save(std::filesystem::path const &path) const;
+
+  // keyframes have to be added in time order
+  void add(Keyframe const &keyframe) { m_keyframes.push_back(keyframe); }
+  void clear() { m_keyframes.clear(); }
+
+  Keyframe sample(float time) const;
+  float duration() const {
+    return m_keyframes.empty() ? 0.f : m_keyframes.back().time;
+  }
+  bool empty() const { return m_keyframes.empty(); }
+  std::size_t size() const { return m_keyframes.size(); }
+
+private:
+  std::vector<Keyframe> m_keyframes;
+};
+
+// Replays a CameraPath against a list of renderers with a fixed timestep and
+// RNG seed, so two runs of the same build render the same frames. The caller
+// drives it from the main loop: step() says what to render, finish_frame()
+// hands back how long it took.
+class Benchmark {
+public:
+  struct Settings {
+    int warmup_frames{30};
+    int frames{600};
+    double timestep{1.0 / 60.0};
+    std::uint32_t seed{5489};
+  };
+
+  struct Result {
+    std::string renderer;
+    std::vector<double> frame_ms;
+    std::uint64_t rays{0};
+    double seconds{0.0};
+
+    double min() const;
+    double mean() const;
+    double percentile(double p) const;
+    double rays_per_second() const {
+      return seconds > 0.0 ? static_cast<double>(rays) / seconds : 0.0;
+    }
+  };
+
+  struct Step {
+    std::size_t renderer; // index into the list passed to start()
+    bool first;           // first frame of this renderer, reseed and reset
+    bool measured;        // false during warmup
+    double ticks;         // scene time of the frame
+    Keyframe pose;
+  };
+
+  void start(CameraPath path, std::vector<std::string> renderers,
+             Settings const &settings);
+  bool running() const { return m_running; }
+  Settings const &settings() const { return m_settings; }
+
+  Step step() const;
+  // `rays` is the running total of traced rays, measured frames use the
+  // difference to the first one
+  void finish_frame(double ms, std::uint64_t rays);
+
+  std::vector<Result> const &results() const { return m_results; }
+  void write_json(std::ostream &out) const;
+  bool dump(std::filesystem::path const &path) const;
+
+private:
+  CameraPath m_path;
+  std::vector<std::string> m_renderers;
+  Settings m_settings;
+  std::vector<Result> m_results;
+
+  bool m_running{false};
+  std::size_t m_renderer{0};
+  int m_frame{0}; // counts warmup frames too
+  std::uint64_t m_first_rays{0};
+  std::chrono::steady_clock::time_point m_start;
+};
+
+} // namespace ren
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+
+#include "glm/glm.hpp"
+
+namespace ren {
+
+struct Aabb {
+  glm::vec3 min{0.f};
+  glm::vec3 max{0.f};
+
+  std::array<glm::vec3, 8> corners() const {
+    std::array<glm::vec3, 8> c;
+    for (int i = 0; i < 8; ++i)
+      c[i] = glm::vec3(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y,
+                       i & 4 ? max.z : min.z);
+    return c;
+  }
+
+  // bounds of the transformed box
+  Aabb transformed(glm::mat4 const &m) const {
+    auto const c = corners();
+    Aabb out;
+    out.min = out.max = glm::vec3(m * glm::vec4(c[0], 1.f));
+    for (auto const &p : c) {
+      auto const q = glm::vec3(m * glm::vec4(p, 1.f));
+      out.min = glm::min(out.min, q);
+      out.max = glm::max(out.max, q);
+    }
+    return out;
+  }
+
+  glm::vec3 center() const { return (min + max) * 0.5f; }
+  glm::vec3 extent() const { return (max - min) * 0.5f; }
+  // radius of the bounding sphere around center()
+  float radius() const { return glm::length(extent()); }
+
+  bool intersects(Aabb const &o) const {
+    return min.x <= o.max.x && max.x >= o.min.x && min.y <= o.max.y &&
+           max.y >= o.min.y && min.z <= o.max.z && max.z >= o.min.z;
+  }
+};
+
+// Planes of a view frustum with inward facing normals, p is inside a plane
+// when dot(plane.xyz, p) + plane.w >= 0.
+struct Frustum {
+  std::array<glm::vec4, 6> planes;
+
+  static Frustum from_matrix(glm::mat4 const &view_proj) {
+    auto const row = [&](int i) {
+      return glm::vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i],
+                       view_proj[3][i]);
+    };
+    return {{row(3) + row(0), row(3) - row(0), row(3) + row(1),
+             row(3) - row(1), row(3) + row(2), row(3) - row(2)}};
+  }
+
+  // conservative, true only if the box is entirely behind one plane
+  bool outside(Aabb const &box) const {
+    for (auto const &plane : planes) {
+      // the corner furthest along the plane normal
+      auto const p = glm::vec3(plane.x >= 0.f ? box.max.x : box.min.x,
+                               plane.y >= 0.f ? box.max.y : box.min.y,
+                               plane.z >= 0.f ? box.max.z : box.min.z);
+      if (glm::dot(glm::vec3(plane), p) + plane.w < 0.f)
+        return true;
+    }
+    return false;
+  }
+};
+
+} // namespace ren
@@ -43,6 +43,16 @@ public:
                lower_left_corner + s * horizontal + t * vertical - origin);
   }
   auto pos() const { return m_position; }
+  auto yaw() const { return m_yaw; }
+  auto pitch() const { return m_pitch; }
+
+  // places the camera directly, used to replay recorded paths
+  void set_pose(glm::vec3 const &position, float yaw, float pitch) {
+    m_position = position;
+    m_yaw = yaw;
+    m_pitch = std::clamp(pitch, -89.0f, 89.0f);
+    update_vectors();
+  }
 
   void move(glm::vec3 const m, float const speed) {
     if (m.x != 0)
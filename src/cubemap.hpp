@@ -1,41 +1,38 @@
 #pragma once
 
 #include "glad/glad.h"
-#include <string>
-#include <vector>
+#include <array>
+#include <filesystem>
 
 #include "object.hpp"
-#include "resource_manager.hpp"
-#include "texture.hpp"
+#include "texture_loader.hpp"
 
 namespace ren {
+// A skybox, its faces are loaded in the background by the TextureLoader and
+// show the placeholder until all six are uploaded.
 class CubeMap {
 public:
-  CubeMap(std::vector<std::string> faces) : m_tex({}) {
+  // +x, -x, +y, -y, +z, -z
+  CubeMap(TextureLoader &loader,
+          std::array<std::filesystem::path, 6> const &faces)
+      : m_loader(loader), m_texture(loader.load_cubemap(faces)) {
     m_box_obj = create_skybox();
-    glBindTexture(GL_TEXTURE_CUBE_MAP, m_tex.id);
-    for (size_t i = 0; i < faces.size(); i++) {
-      auto img = Image(faces[i]);
-      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, img.width(),
-                   img.heigth(), 0, GL_RGB, GL_UNSIGNED_BYTE, img.data());
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
   }
 
   void draw() {
-    glActiveTexture(GL_TEXTURE0);
-    // TODO:
-    glBindTexture(GL_TEXTURE_CUBE_MAP, m_tex.id);
+    bind(GL_TEXTURE0);
     m_box_obj.draw();
   }
 
-  void bind() { glBindTexture(GL_TEXTURE_CUBE_MAP, m_tex.id); }
+  void bind(GLenum unit = GL_TEXTURE0) const {
+    m_loader.bind(m_texture, unit);
+  }
+  bool ready() const { return m_loader.ready(m_texture); }
 
-  Texture m_tex;
   Object m_box_obj;
+
+private:
+  TextureLoader &m_loader;
+  TextureLoader::Handle m_texture;
 };
 } // namespace ren
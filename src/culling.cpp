@@ -0,0 +1,69 @@
+#include "culling.hpp"
+
+#include <cmath>
+
+#include "object.hpp"
+#include "parallel.hpp"
+#include "zone_profiler.hpp"
+
+namespace ren {
+
+void FrustumCuller::gather(std::vector<Object> const &objects) {
+  auto const n = objects.size();
+  for (auto *v : {&m_cx, &m_cy, &m_cz, &m_ex, &m_ey, &m_ez})
+    v->resize(n);
+  m_valid.resize(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    auto const &box = objects[i].world_bounds();
+    auto const c = box.center();
+    auto const e = box.extent();
+    m_cx[i] = c.x;
+    m_cy[i] = c.y;
+    m_cz[i] = c.z;
+    m_ex[i] = e.x;
+    m_ey[i] = e.y;
+    m_ez[i] = e.z;
+    m_valid[i] = objects[i].is_valid();
+  }
+}
+
+void FrustumCuller::test(Frustum const &frustum, std::size_t begin,
+                         std::size_t end) {
+  auto *inside = m_inside.data();
+  for (auto i = begin; i < end; ++i)
+    inside[i] = m_valid[i];
+
+  // a box is outside a plane if even its corner furthest along the normal
+  // is behind it: dot(n, c) + w + dot(|n|, e) < 0
+  for (auto const &plane : frustum.planes) {
+    auto const nx = plane.x, ny = plane.y, nz = plane.z, w = plane.w;
+    auto const ax = std::abs(nx), ay = std::abs(ny), az = std::abs(nz);
+    auto const *cx = m_cx.data(), *cy = m_cy.data(), *cz = m_cz.data();
+    auto const *ex = m_ex.data(), *ey = m_ey.data(), *ez = m_ez.data();
+    for (auto i = begin; i < end; ++i) {
+      auto const d = nx * cx[i] + ny * cy[i] + nz * cz[i] + w + ax * ex[i] +
+                     ay * ey[i] + az * ez[i];
+      inside[i] &= static_cast<std::uint8_t>(d >= 0.f);
+    }
+  }
+}
+
+void FrustumCuller::cull(Frustum const &frustum,
+                         std::vector<std::size_t> &visible) {
+  REN_ZONE("FrustumCuller::cull");
+  auto const n = size();
+  m_inside.resize(n);
+  if (n < parallel_threshold) {
+    test(frustum, 0, n);
+  } else {
+    parallel_for(n, [&](std::size_t begin, std::size_t end,
+                        unsigned) { test(frustum, begin, end); });
+  }
+
+  visible.clear();
+  for (std::size_t i = 0; i < n; ++i)
+    if (m_inside[i])
+      visible.push_back(i);
+}
+
+} // namespace ren
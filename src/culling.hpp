@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "bounds.hpp"
+
+namespace ren {
+
+class Object;
+
+// Frustum culling of the objects' world_bounds(). The boxes are gathered once
+// per frame as centres and extents in separate arrays, every plane is then
+// tested against all of them in a branch free loop the compiler turns into
+// SIMD code. Large sets are split over threads.
+class FrustumCuller final {
+public:
+  // below this many objects one thread is faster than starting more
+  static constexpr std::size_t parallel_threshold = 16384;
+
+  // takes the bounds of `objects`, invalid objects are never visible
+  void gather(std::vector<Object> const &objects);
+  // indices of the gathered objects not entirely outside `frustum`, ascending
+  void cull(Frustum const &frustum, std::vector<std::size_t> &visible);
+
+  std::size_t size() const { return m_valid.size(); }
+
+private:
+  void test(Frustum const &frustum, std::size_t begin, std::size_t end);
+
+  std::vector<float> m_cx, m_cy, m_cz;
+  std::vector<float> m_ex, m_ey, m_ez;
+  std::vector<std::uint8_t> m_valid;
+  std::vector<std::uint8_t> m_inside;
+};
+
+} // namespace ren
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+
+namespace ren {
+
+// GLSL compiled into the executable, looked up by file name such as
+// "material.frag". Built from shaders/ by tools/embed_shaders.py when the
+// embed_shaders option is on, otherwise nothing is embedded.
+std::optional<std::string_view> embedded_shader(std::string_view name);
+
+} // namespace ren
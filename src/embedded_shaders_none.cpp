@@ -0,0 +1,10 @@
+#include "embedded_shaders.hpp"
+
+namespace ren {
+
+// built without embed_shaders, every shader is read from disk
+std::optional<std::string_view> embedded_shader(std::string_view) {
+  return std::nullopt;
+}
+
+} // namespace ren
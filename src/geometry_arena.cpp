@@ -0,0 +1,270 @@
+#include "geometry_arena.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "gl_profiler.hpp"
+#include "log.hpp"
+
+namespace ren {
+
+RangeAllocator::RangeAllocator(std::size_t capacity) : m_capacity(capacity) {
+  m_free.push_back({0, capacity});
+}
+
+std::optional<std::size_t> RangeAllocator::allocate(std::size_t size) {
+  for (auto it = m_free.begin(); it != m_free.end(); ++it) {
+    if (it->size < size)
+      continue;
+    auto const offset = it->offset;
+    it->offset += size;
+    it->size -= size;
+    if (it->size == 0)
+      m_free.erase(it);
+    m_used += size;
+    return offset;
+  }
+  return std::nullopt;
+}
+
+void RangeAllocator::free(std::size_t offset, std::size_t size) {
+  m_used -= size;
+  auto it = std::lower_bound(
+      m_free.begin(), m_free.end(), offset,
+      [](Block const &b, std::size_t o) { return b.offset < o; });
+  it = m_free.insert(it, {offset, size});
+  // merge with the following and then the preceding block
+  if (auto next = it + 1;
+      next != m_free.end() && it->offset + it->size == next->offset) {
+    it->size += next->size;
+    m_free.erase(next);
+  }
+  if (it != m_free.begin()) {
+    auto prev = it - 1;
+    if (prev->offset + prev->size == it->offset) {
+      prev->size += it->size;
+      m_free.erase(it);
+    }
+  }
+}
+
+void RangeAllocator::grow(std::size_t capacity) {
+  if (capacity <= m_capacity)
+    return;
+  if (!m_free.empty() &&
+      m_free.back().offset + m_free.back().size == m_capacity)
+    m_free.back().size += capacity - m_capacity;
+  else
+    m_free.push_back({m_capacity, capacity - m_capacity});
+  m_capacity = capacity;
+}
+
+GeometryArena::GeometryArena(std::size_t vertex_capacity,
+                             std::size_t index_capacity)
+    : m_vertices(vertex_capacity), m_indices(index_capacity) {
+  m_multi_draw_indirect =
+      GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_base_instance;
+  if (!m_multi_draw_indirect)
+    Log::the().add_log("GeometryArena: no ARB_multi_draw_indirect, "
+                       "drawing command by command\n");
+
+  glGenVertexArrays(1, &m_vao);
+  glGenBuffers(1, &m_vbo);
+  glGenBuffers(1, &m_ebo);
+  glGenBuffers(1, &m_indirect);
+
+  glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertex_capacity * sizeof(Vertex), nullptr,
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_ebo);
+  glBufferData(GL_COPY_WRITE_BUFFER, index_capacity * sizeof(GLuint), nullptr,
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  setup_attributes();
+}
+
+GeometryArena::~GeometryArena() {
+  glDeleteVertexArrays(1, &m_vao);
+  glDeleteBuffers(1, &m_vbo);
+  glDeleteBuffers(1, &m_ebo);
+  glDeleteBuffers(1, &m_indirect);
+}
+
+void GeometryArena::setup_attributes() {
+  glBindVertexArray(m_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                        (void *)offsetof(Vertex, norm));
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                        (void *)offsetof(Vertex, tex));
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+GLuint GeometryArena::grow_buffer(GLuint buffer, std::size_t old_size,
+                                  std::size_t new_size) {
+  GLuint grown = 0;
+  glGenBuffers(1, &grown);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+  glBufferData(GL_COPY_WRITE_BUFFER, new_size, nullptr, GL_STATIC_DRAW);
+  glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                      old_size);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  glDeleteBuffers(1, &buffer);
+  return grown;
+}
+
+void GeometryArena::reserve(std::size_t n_vertices, std::size_t n_indices) {
+  // growing by at least the requested size leaves a free block at the end
+  // that fits it, however fragmented the rest is
+  auto const grown_size = [](std::size_t capacity, std::size_t needed) {
+    auto size = capacity;
+    while (size < capacity + needed)
+      size *= 2;
+    return size;
+  };
+
+  if (n_vertices != 0) {
+    auto const capacity = grown_size(m_vertices.capacity(), n_vertices);
+    m_vbo = grow_buffer(m_vbo, m_vertices.capacity() * sizeof(Vertex),
+                        capacity * sizeof(Vertex));
+    m_vertices.grow(capacity);
+  }
+  if (n_indices != 0) {
+    auto const capacity = grown_size(m_indices.capacity(), n_indices);
+    m_ebo = grow_buffer(m_ebo, m_indices.capacity() * sizeof(GLuint),
+                        capacity * sizeof(GLuint));
+    m_indices.grow(capacity);
+  }
+  setup_attributes();
+  Log::the().add_log("GeometryArena: grew to %zu vertices, %zu indices\n",
+                     m_vertices.capacity(), m_indices.capacity());
+}
+
+std::optional<GeometryArena::Range>
+GeometryArena::find_or_add(std::shared_ptr<Mesh> const &mesh) {
+  if (mesh == nullptr)
+    return std::nullopt;
+  if (auto it = m_entries.find(mesh.get()); it != m_entries.end()) {
+    if (!it->second.mesh.expired())
+      return it->second.range;
+    // a new mesh at the address of a freed one
+    release(it->second.range);
+    m_entries.erase(it);
+  }
+  if (mesh->format() != VertexFormat::full || !mesh->has_cpu_data() ||
+      mesh->n_vertices() == 0)
+    return std::nullopt;
+
+  // the arena only draws GL_TRIANGLES, adjacency indices are reduced to the
+  // triangle corners and unindexed meshes get a trivial index list
+  auto const &vertices = mesh->vertices();
+  std::vector<GLuint> indices;
+  if (mesh->has_adjacencies()) {
+    indices.reserve(mesh->n_indices() / 2);
+    for (std::size_t i = 0; i < mesh->n_indices(); i += 2)
+      indices.push_back(mesh->indices()[i]);
+  } else if (mesh->n_indices() != 0) {
+    indices = mesh->indices();
+  } else {
+    indices.resize(vertices.size());
+    for (std::size_t i = 0; i < indices.size(); ++i)
+      indices[i] = i;
+  }
+
+  auto first_vertex = m_vertices.allocate(vertices.size());
+  auto first_index = m_indices.allocate(indices.size());
+  if (!first_vertex || !first_index) {
+    reserve(first_vertex ? 0 : vertices.size(),
+            first_index ? 0 : indices.size());
+    if (!first_vertex)
+      first_vertex = m_vertices.allocate(vertices.size());
+    if (!first_index)
+      first_index = m_indices.allocate(indices.size());
+  }
+  assert(first_vertex && first_index);
+
+  glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+  glBufferSubData(GL_ARRAY_BUFFER, *first_vertex * sizeof(Vertex),
+                  vertices.size() * sizeof(Vertex), vertices.data());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  // GL_ELEMENT_ARRAY_BUFFER is VAO state, upload through the copy target
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_ebo);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, *first_index * sizeof(GLuint),
+                  indices.size() * sizeof(GLuint), indices.data());
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  GlProfiler::the().count_upload(vertices.size() * sizeof(Vertex) +
+                                 indices.size() * sizeof(GLuint));
+
+  Range const range{static_cast<GLuint>(*first_index),
+                    static_cast<GLuint>(indices.size()),
+                    static_cast<GLint>(*first_vertex),
+                    static_cast<GLuint>(vertices.size())};
+  m_entries.emplace(mesh.get(), Entry{mesh, range});
+  return range;
+}
+
+void GeometryArena::release(Range const &range) {
+  m_vertices.free(range.base_vertex, range.n_vertices);
+  m_indices.free(range.first_index, range.n_indices);
+}
+
+void GeometryArena::collect() {
+  for (auto it = m_entries.begin(); it != m_entries.end();) {
+    if (it->second.mesh.expired()) {
+      release(it->second.range);
+      it = m_entries.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  m_gl_draws = 0;
+}
+
+void GeometryArena::draw(GLuint instance_buffer,
+                         std::vector<DrawCommand> const &commands) {
+  if (commands.empty())
+    return;
+
+  glBindVertexArray(m_vao);
+  auto &profiler = GlProfiler::the();
+  profiler.count_state_change();
+  if (m_multi_draw_indirect) {
+    if (m_instance_buffer != instance_buffer) {
+      set_instance_attributes(instance_buffer, 0);
+      m_instance_buffer = instance_buffer;
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirect);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawCommand),
+                 commands.data(), GL_STREAM_DRAW);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
+                                commands.size(), 0);
+    profiler.count_upload(commands.size() * sizeof(DrawCommand));
+    profiler.count_draw();
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    ++m_gl_draws;
+  } else {
+    for (auto const &c : commands) {
+      set_instance_attributes(instance_buffer,
+                              c.base_instance * sizeof(InstanceData));
+      glDrawElementsInstancedBaseVertex(
+          GL_TRIANGLES, c.count, GL_UNSIGNED_INT,
+          (void *)(c.first_index * sizeof(GLuint)), c.instance_count,
+          c.base_vertex);
+    }
+    m_instance_buffer = 0;
+    m_gl_draws += commands.size();
+    profiler.count_draw(commands.size());
+  }
+  glBindVertexArray(0);
+}
+
+} // namespace ren
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "glad/glad.h"
+
+#include "mesh.hpp"
+
+namespace ren {
+
+// layout of GL_DRAW_INDIRECT_BUFFER entries for glMultiDrawElementsIndirect
+struct DrawCommand {
+  GLuint count;
+  GLuint instance_count;
+  GLuint first_index;
+  GLint base_vertex;
+  GLuint base_instance;
+};
+static_assert(sizeof(DrawCommand) == 20);
+
+// First fit over a sorted free list, offsets and sizes are in elements.
+class RangeAllocator {
+public:
+  explicit RangeAllocator(std::size_t capacity);
+
+  std::optional<std::size_t> allocate(std::size_t size);
+  void free(std::size_t offset, std::size_t size);
+  // adds [capacity(), capacity) to the free space
+  void grow(std::size_t capacity);
+
+  std::size_t capacity() const { return m_capacity; }
+  std::size_t used() const { return m_used; }
+
+private:
+  struct Block {
+    std::size_t offset;
+    std::size_t size;
+  };
+
+  std::vector<Block> m_free;
+  std::size_t m_capacity;
+  std::size_t m_used{0};
+};
+
+// Static triangle geometry of many meshes suballocated from one vertex and
+// one index buffer behind a single VAO, so a whole pass is one bind and, with
+// ARB_multi_draw_indirect and ARB_base_instance, one glMultiDrawElementsIndirect.
+// Without them every command becomes a glDrawElementsInstancedBaseVertex.
+// Buffers double in size when full. Compact meshes keep their own buffers,
+// the arena stores full precision vertices only.
+class GeometryArena final {
+public:
+  struct Range {
+    GLuint first_index;
+    GLuint n_indices;
+    GLint base_vertex;
+    GLuint n_vertices;
+  };
+
+  explicit GeometryArena(std::size_t vertex_capacity = 1 << 16,
+                         std::size_t index_capacity = 1 << 18);
+  ~GeometryArena();
+  GeometryArena(GeometryArena const &) = delete;
+  GeometryArena &operator=(GeometryArena const &) = delete;
+
+  // uploads the mesh's triangles on first use, nullopt for meshes that
+  // can't be stored (compact or without CPU data)
+  std::optional<Range> find_or_add(std::shared_ptr<Mesh> const &mesh);
+  // frees the ranges of meshes that no longer exist and resets the draw
+  // count, called once per frame
+  void collect();
+
+  // draws GL_TRIANGLES, `base_instance` indexes into `instance_buffer`
+  void draw(GLuint instance_buffer, std::vector<DrawCommand> const &commands);
+
+  bool multi_draw_indirect() const { return m_multi_draw_indirect; }
+  std::size_t n_meshes() const { return m_entries.size(); }
+  std::size_t vertices_used() const { return m_vertices.used(); }
+  std::size_t indices_used() const { return m_indices.used(); }
+  // GL draw calls since the last collect()
+  std::size_t n_gl_draws() const { return m_gl_draws; }
+
+private:
+  struct Entry {
+    std::weak_ptr<Mesh> mesh;
+    Range range;
+  };
+
+  void release(Range const &range);
+  void reserve(std::size_t n_vertices, std::size_t n_indices);
+  static GLuint grow_buffer(GLuint buffer, std::size_t old_size,
+                            std::size_t new_size);
+  void setup_attributes();
+
+  GLuint m_vao{0};
+  GLuint m_vbo{0};
+  GLuint m_ebo{0};
+  GLuint m_indirect{0};
+  // buffer the instance attributes currently source from with offset 0
+  GLuint m_instance_buffer{0};
+  bool m_multi_draw_indirect{false};
+  RangeAllocator m_vertices;
+  RangeAllocator m_indices;
+  std::unordered_map<Mesh const *, Entry> m_entries;
+  std::size_t m_gl_draws{0};
+};
+
+} // namespace ren
@@ -0,0 +1,192 @@
+#include "gl_profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include "imgui.h"
+#include "log.hpp"
+
+namespace ren {
+
+namespace {
+
+char const *debug_type_name(GLenum type) {
+  switch (type) {
+  case GL_DEBUG_TYPE_ERROR:
+    return "error";
+  case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+    return "deprecated";
+  case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+    return "undefined behavior";
+  case GL_DEBUG_TYPE_PORTABILITY:
+    return "portability";
+  case GL_DEBUG_TYPE_PERFORMANCE:
+    return "performance";
+  default:
+    return "other";
+  }
+}
+
+char const *debug_severity_name(GLenum severity) {
+  switch (severity) {
+  case GL_DEBUG_SEVERITY_HIGH:
+    return "high";
+  case GL_DEBUG_SEVERITY_MEDIUM:
+    return "medium";
+  default:
+    return "low";
+  }
+}
+
+// may be called from a driver thread, which gets its own log ring
+void APIENTRY debug_callback(GLenum, GLenum type, GLuint id, GLenum severity,
+                             GLsizei, GLchar const *message, void const *) {
+  if (severity == GL_DEBUG_SEVERITY_NOTIFICATION)
+    return;
+  Log::the().add_log("GL %s (%s, %u): %s\n", debug_type_name(type),
+                     debug_severity_name(severity), id, message);
+}
+
+} // namespace
+
+GlProfiler &GlProfiler::the() {
+  static GlProfiler profiler;
+  return profiler;
+}
+
+void GlProfiler::init() {
+  auto &p = the();
+  if (p.m_initialized)
+    return;
+  p.m_initialized = true;
+
+  if (GLAD_GL_KHR_debug) {
+    // asynchronous, errors show up in the log a little after the call
+    glEnable(GL_DEBUG_OUTPUT);
+    glDebugMessageCallback(debug_callback, nullptr);
+    p.m_debug_output = true;
+    GLint flags = 0;
+    glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+    p.m_debug_context = (flags & GL_CONTEXT_FLAG_DEBUG_BIT) != 0;
+  } else {
+    Log::the().add_log("GlProfiler: no KHR_debug, errors are only reported "
+                       "where check_gl_error() polls\n");
+  }
+}
+
+void GlProfiler::destroy() {
+  auto &p = the();
+  if (!p.m_initialized)
+    return;
+  if (p.m_debug_output) {
+    glDebugMessageCallback(nullptr, nullptr);
+    glDisable(GL_DEBUG_OUTPUT);
+  }
+  for (auto &pass : p.m_passes)
+    glDeleteQueries(2, pass.queries.data());
+  p.m_passes.clear();
+  p.m_initialized = false;
+  p.m_debug_output = false;
+  p.m_debug_context = false;
+}
+
+void GlProfiler::collect(std::size_t slot) {
+  for (auto &pass : m_passes) {
+    if (!pass.issued[slot])
+      continue;
+    // issued a frame ago, usually done by now
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(pass.queries[slot], GL_QUERY_RESULT, &ns);
+    pass.issued[slot] = false;
+    pass.ms = ns / 1e6;
+    pass.average = pass.average == 0.0 ? pass.ms
+                                       : pass.average * 0.95 + pass.ms * 0.05;
+    m_last.passes.push_back({pass.name, pass.ms, pass.average});
+  }
+}
+
+void GlProfiler::begin_frame() {
+  m_last.frame = m_frame++;
+  m_last.counters = m_counters;
+  m_counters = {};
+
+  // only passes that ran show up, switching renderers drops the others
+  m_last.passes.clear();
+  m_slot ^= 1;
+  if (m_initialized)
+    collect(m_slot);
+}
+
+GlProfiler::Scope GlProfiler::scope(char const *name) {
+  if (!m_initialized || m_timing)
+    return Scope(false);
+
+  auto it = std::find_if(m_passes.begin(), m_passes.end(),
+                         [name](Pass const &p) { return p.name == name; });
+  if (it == m_passes.end()) {
+    m_passes.push_back({name, {}, {}, 0.0, 0.0});
+    it = m_passes.end() - 1;
+    glGenQueries(2, it->queries.data());
+  }
+  // a pass timed twice in one frame keeps its first measurement
+  if (it->issued[m_slot])
+    return Scope(false);
+
+  glBeginQuery(GL_TIME_ELAPSED, it->queries[m_slot]);
+  it->issued[m_slot] = true;
+  m_timing = true;
+  return Scope(true);
+}
+
+void GlProfiler::end_scope() {
+  glEndQuery(GL_TIME_ELAPSED);
+  m_timing = false;
+}
+
+GlProfiler::Scope::~Scope() {
+  if (m_active)
+    GlProfiler::the().end_scope();
+}
+
+void GlProfiler::draw_dialog() {
+  if (!ImGui::CollapsingHeader("GL profiler"))
+    return;
+  double total = 0.0;
+  for (auto const &pass : m_last.passes) {
+    ImGui::Text("%-16s %7.3f ms (avg %7.3f)", pass.name.c_str(), pass.ms,
+                pass.average);
+    total += pass.ms;
+  }
+  ImGui::Text("%-16s %7.3f ms", "gpu total", total);
+  ImGui::Separator();
+  ImGui::Text("draws %llu, state changes %llu",
+              static_cast<unsigned long long>(m_last.counters.draws),
+              static_cast<unsigned long long>(m_last.counters.state_changes));
+  ImGui::Text("uploaded %.1f KiB", m_last.counters.uploaded_bytes / 1024.0);
+  if (ImGui::Button("Dump GL stats"))
+    dump("./gl_stats.json");
+}
+
+void GlProfiler::write_json(std::ostream &out, Snapshot const &s) {
+  out << "{\"frame\": " << s.frame << ", \"draws\": " << s.counters.draws
+      << ", \"state_changes\": " << s.counters.state_changes
+      << ", \"uploaded_bytes\": " << s.counters.uploaded_bytes
+      << ", \"passes\": [";
+  for (std::size_t i = 0; i < s.passes.size(); ++i) {
+    auto const &pass = s.passes[i];
+    out << (i == 0 ? "" : ", ") << "{\"name\": \"" << pass.name
+        << "\", \"gpu_ms\": " << pass.ms << ", \"gpu_ms_avg\": " << pass.average
+        << "}";
+  }
+  out << "]}";
+}
+
+bool GlProfiler::dump(std::filesystem::path const &path) const {
+  std::ofstream out(path);
+  write_json(out, m_last);
+  out << '\n';
+  Log::the().add_log("GlProfiler: wrote %s\n", path.c_str());
+  return out.good();
+}
+
+} // namespace ren
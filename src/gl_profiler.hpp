@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "glad/glad.h"
+
+namespace ren {
+
+// GPU time per pass from GL_TIME_ELAPSED queries and per frame counts of the
+// GL work issued. Every pass owns two queries used on alternating frames, so
+// a result is read one frame after it was issued and normally without a
+// stall. Counters are bumped by the code issuing the calls; before init()
+// and without a context only the counters work.
+class GlProfiler {
+public:
+  struct Counters {
+    std::uint64_t draws{0};
+    std::uint64_t state_changes{0}; // program, VAO, framebuffer, texture binds
+    std::uint64_t uploaded_bytes{0};
+  };
+
+  struct PassTime {
+    std::string name;
+    double ms{0.0};      // latest result
+    double average{0.0}; // exponential moving average
+  };
+
+  // one frame, as shown in the dialog and written by write_json(); the pass
+  // times are a frame older than the counters
+  struct Snapshot {
+    std::uint64_t frame{0};
+    Counters counters;
+    std::vector<PassTime> passes;
+  };
+
+  // Times the GPU work issued during its lifetime. Queries of the same
+  // target can't nest, a scope opened inside another one is not timed.
+  class Scope {
+  public:
+    Scope(Scope const &) = delete;
+    Scope &operator=(Scope const &) = delete;
+    ~Scope();
+
+  private:
+    friend class GlProfiler;
+    explicit Scope(bool active) : m_active(active) {}
+    bool m_active;
+  };
+
+  static GlProfiler &the();
+  // creates queries and installs the KHR_debug callback, needs a context
+  static void init();
+  // releases the queries while the context is still alive
+  static void destroy();
+
+  // reads the results of the previous use of this frame's queries into
+  // last_frame() and starts counting a new frame
+  void begin_frame();
+  [[nodiscard]] Scope scope(char const *pass);
+
+  void count_draw(std::uint64_t n = 1) { m_counters.draws += n; }
+  void count_state_change() { ++m_counters.state_changes; }
+  void count_upload(std::uint64_t bytes) { m_counters.uploaded_bytes += bytes; }
+
+  // true while KHR_debug delivers messages to the log
+  bool debug_output() const { return m_debug_output; }
+  // a debug context with debug output, only then is the driver required to
+  // report every error and glGetError polling is skipped
+  bool reports_errors() const { return m_debug_output && m_debug_context; }
+
+  Snapshot const &last_frame() const { return m_last; }
+  void draw_dialog();
+  static void write_json(std::ostream &out, Snapshot const &snapshot);
+  bool dump(std::filesystem::path const &path) const;
+
+private:
+  struct Pass {
+    std::string name;
+    std::array<GLuint, 2> queries{};
+    std::array<bool, 2> issued{};
+    double ms{0.0};
+    double average{0.0};
+  };
+
+  void end_scope();
+  void collect(std::size_t slot);
+
+  bool m_initialized{false};
+  bool m_debug_output{false};
+  bool m_debug_context{false};
+  bool m_timing{false}; // a query is running
+  std::size_t m_slot{0};
+  std::uint64_t m_frame{0};
+  std::vector<Pass> m_passes;
+  Counters m_counters;
+  Snapshot m_last;
+};
+
+} // namespace ren
@@ -5,9 +5,16 @@
 
 #include "glad/glad.h"
 
+#include "gl_profiler.hpp"
+
 namespace {
 GLenum _check_gl_error(std::string_view check, std::string_view file,
                        size_t line) {
+  // a debug context reports errors through debug output itself, polling
+  // would only stall the pipeline. Elsewhere the driver may stay silent.
+  if (ren::GlProfiler::the().reports_errors())
+    return GL_NO_ERROR;
+
   GLenum error_code;
   while ((error_code = glGetError()) != GL_NO_ERROR) {
     std::cout << check << " -> ERROR (" << file << ", " << line << ":\n";
@@ -0,0 +1,139 @@
+#include "instancing.hpp"
+
+#include <algorithm>
+
+#include "gl_profiler.hpp"
+#include "object.hpp"
+
+namespace ren {
+
+InstanceBatcher::InstanceBatcher(std::shared_ptr<GeometryArena> arena)
+    : m_arena(std::move(arena)) {
+  glGenBuffers(1, &m_buffer);
+}
+
+InstanceBatcher::~InstanceBatcher() { glDeleteBuffers(1, &m_buffer); }
+
+std::vector<InstanceBatcher::Batch> const &
+InstanceBatcher::prepare(std::vector<Object> const &objects) {
+  if (m_arena)
+    m_arena->collect();
+
+  m_order.clear();
+  for (std::size_t i = 0; i < objects.size(); ++i)
+    if (objects[i].is_valid())
+      m_order.push_back(i);
+  auto const key = [&](std::size_t i) {
+    return std::pair{objects[i].mesh(), objects[i].material().get()};
+  };
+  std::stable_sort(m_order.begin(), m_order.end(),
+                   [&](auto a, auto b) { return key(a) < key(b); });
+
+  m_instances.clear();
+  m_batches.clear();
+  m_instance_of.assign(objects.size(), no_batch);
+  m_batch_of.assign(objects.size(), no_batch);
+  m_batch_of_instance.clear();
+  for (auto const i : m_order) {
+    auto const &obj = objects[i];
+    auto const model = obj.model();
+    auto normal_matrix = glm::transpose(glm::inverse(model));
+    normal_matrix[3] = obj.material() ? obj.material()->base_color()
+                                      : glm::vec4(0.7f, 0.7f, 0.7f, 32.f);
+    m_instances.push_back({model, normal_matrix});
+
+    auto const [mesh, material] = key(i);
+    if (m_batches.empty() || m_batches.back().mesh != mesh ||
+        m_batches.back().material != material) {
+      auto range = m_arena ? m_arena->find_or_add(obj.shared_mesh())
+                           : std::nullopt;
+      m_batches.push_back(
+          {mesh, material, m_instances.size() - 1, 0, range});
+    }
+    ++m_batches.back().count;
+    m_instance_of[i] = m_instances.size() - 1;
+    m_batch_of[i] = m_batches.size() - 1;
+    m_batch_of_instance.push_back(m_batches.size() - 1);
+  }
+
+  // orphan the old storage instead of waiting for last frame's draws
+  glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+  glBufferData(GL_ARRAY_BUFFER, m_instances.size() * sizeof(InstanceData),
+               nullptr, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0,
+                  m_instances.size() * sizeof(InstanceData),
+                  m_instances.data());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  GlProfiler::the().count_upload(m_instances.size() * sizeof(InstanceData));
+  return m_batches;
+}
+
+void InstanceBatcher::draw_direct(Batch const &batch, std::size_t first,
+                                  GLsizei count) const {
+  batch.mesh->set_instance_buffer(m_buffer, first * sizeof(InstanceData));
+  batch.mesh->draw_instanced(count);
+}
+
+void InstanceBatcher::draw(Batch const &batch) {
+  if (!batch.range) {
+    draw_direct(batch, batch.first, batch.count);
+    return;
+  }
+  auto const &r = *batch.range;
+  m_commands.assign(1, {r.n_indices, static_cast<GLuint>(batch.count),
+                        r.first_index, r.base_vertex,
+                        static_cast<GLuint>(batch.first)});
+  m_arena->draw(m_buffer, m_commands);
+}
+
+void InstanceBatcher::draw_all() {
+  m_commands.clear();
+  for (auto const &batch : m_batches) {
+    if (!batch.range) {
+      draw_direct(batch, batch.first, batch.count);
+      continue;
+    }
+    auto const &r = *batch.range;
+    m_commands.push_back({r.n_indices, static_cast<GLuint>(batch.count),
+                          r.first_index, r.base_vertex,
+                          static_cast<GLuint>(batch.first)});
+  }
+  if (m_arena)
+    m_arena->draw(m_buffer, m_commands);
+}
+
+void InstanceBatcher::draw_objects(std::vector<std::size_t> const &objects) {
+  // back in instance order, so neighbours from one batch become one
+  // instanced draw
+  m_selected.clear();
+  for (auto const i : objects)
+    if (m_batch_of[i] != no_batch)
+      m_selected.push_back(m_instance_of[i]);
+  std::sort(m_selected.begin(), m_selected.end());
+
+  m_commands.clear();
+  for (std::size_t k = 0; k < m_selected.size();) {
+    auto const first = m_selected[k];
+    auto const batch_index = m_batch_of_instance[first];
+    std::size_t count = 1;
+    while (k + count < m_selected.size() &&
+           m_selected[k + count] == first + count &&
+           m_batch_of_instance[first + count] == batch_index)
+      ++count;
+    k += count;
+
+    auto const &batch = m_batches[batch_index];
+    if (!batch.range) {
+      draw_direct(batch, first, static_cast<GLsizei>(count));
+      continue;
+    }
+    auto const &r = *batch.range;
+    m_commands.push_back({r.n_indices, static_cast<GLuint>(count),
+                          r.first_index, r.base_vertex,
+                          static_cast<GLuint>(first)});
+  }
+  if (m_arena)
+    m_arena->draw(m_buffer, m_commands);
+}
+
+} // namespace ren
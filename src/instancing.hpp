@@ -0,0 +1,67 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "glad/glad.h"
+
+#include "geometry_arena.hpp"
+#include "material.hpp"
+#include "mesh.hpp"
+
+namespace ren {
+
+class Object;
+
+// Groups objects sharing a mesh and material into batches and streams their
+// transforms into one instance buffer, so each batch is a single instanced
+// draw. With a GeometryArena the batches become indirect commands and a whole
+// pass is submitted at once; meshes the arena can't hold are drawn through
+// their own VAO.
+class InstanceBatcher final {
+public:
+  struct Batch {
+    Mesh const *mesh;
+    Material const *material;
+    std::size_t first; // index of the first instance in the buffer
+    GLsizei count;
+    std::optional<GeometryArena::Range> range; // set when in the arena
+  };
+
+  explicit InstanceBatcher(std::shared_ptr<GeometryArena> arena = nullptr);
+  ~InstanceBatcher();
+  InstanceBatcher(InstanceBatcher const &) = delete;
+  InstanceBatcher &operator=(InstanceBatcher const &) = delete;
+
+  // rebuilds the batches and uploads one InstanceData per object
+  std::vector<Batch> const &prepare(std::vector<Object> const &objects);
+  void draw(Batch const &batch);
+  // every batch, one multi draw for those in the arena
+  void draw_all();
+  // single objects by their index in the prepared vector, e.g. the ones that
+  // survived culling; runs of a batch are drawn instanced, all of them
+  // compacted into one multi draw
+  void draw_objects(std::vector<std::size_t> const &objects);
+
+  auto const &batches() const { return m_batches; }
+  std::size_t n_instances() const { return m_instances.size(); }
+  auto const &arena() const { return m_arena; }
+
+private:
+  static constexpr std::size_t no_batch = ~std::size_t{0};
+
+  void draw_direct(Batch const &batch, std::size_t first, GLsizei count) const;
+
+  std::shared_ptr<GeometryArena> m_arena;
+  GLuint m_buffer{0};
+  std::vector<std::size_t> m_order;
+  std::vector<InstanceData> m_instances;
+  std::vector<Batch> m_batches;
+  std::vector<std::size_t> m_instance_of; // per object
+  std::vector<std::size_t> m_batch_of;    // per object
+  std::vector<std::size_t> m_batch_of_instance;
+  std::vector<std::size_t> m_selected; // instances picked by draw_objects
+  std::vector<DrawCommand> m_commands;
+};
+
+} // namespace ren
@@ -0,0 +1,164 @@
+#include "light_clusters.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#include "parallel.hpp"
+#include "zone_profiler.hpp"
+
+namespace ren {
+
+void LightClusters::set_projection(glm::mat4 const &projection) {
+  if (projection == m_projection && !m_slices.empty())
+    return;
+  m_projection = projection;
+  // the planes of a glm::perspective matrix
+  m_near = projection[3][2] / (projection[2][2] - 1.f);
+  m_far = projection[3][2] / (projection[2][2] + 1.f);
+  m_slice_scale = slices / std::log(m_far / m_near);
+  m_slice_bias = std::log(m_near) * m_slice_scale;
+
+  m_slice_depth.resize(slices + 1);
+  for (int s = 0; s <= slices; ++s)
+    m_slice_depth[s] =
+        m_near * std::pow(m_far / m_near, static_cast<float>(s) / slices);
+
+  // view space direction through each tile corner, scaled to depth 1
+  auto const inverse = glm::inverse(projection);
+  std::vector<glm::vec3> corners;
+  for (int y = 0; y <= tiles_y; ++y) {
+    for (int x = 0; x <= tiles_x; ++x) {
+      auto const ndc = glm::vec4(-1.f + 2.f * x / tiles_x,
+                                 -1.f + 2.f * y / tiles_y, -1.f, 1.f);
+      auto p = inverse * ndc;
+      auto const dir = glm::vec3(p) / p.w;
+      corners.push_back(dir / -dir.z);
+    }
+  }
+
+  for (auto *v : {&m_min_x, &m_min_y, &m_min_z, &m_max_x, &m_max_y, &m_max_z})
+    v->resize(n_clusters);
+  for (int s = 0; s < slices; ++s) {
+    for (int y = 0; y < tiles_y; ++y) {
+      for (int x = 0; x < tiles_x; ++x) {
+        auto lo = glm::vec3(std::numeric_limits<float>::max());
+        auto hi = glm::vec3(std::numeric_limits<float>::lowest());
+        for (auto const depth : {m_slice_depth[s], m_slice_depth[s + 1]}) {
+          for (int c = 0; c < 4; ++c) {
+            auto const &dir =
+                corners[(y + c / 2) * (tiles_x + 1) + x + c % 2];
+            lo = glm::min(lo, dir * depth);
+            hi = glm::max(hi, dir * depth);
+          }
+        }
+        auto const i = index(x, y, s);
+        m_min_x[i] = lo.x;
+        m_min_y[i] = lo.y;
+        m_min_z[i] = lo.z;
+        m_max_x[i] = hi.x;
+        m_max_y[i] = hi.y;
+        m_max_z[i] = hi.z;
+      }
+    }
+  }
+
+  m_slices.resize(slices);
+  for (auto &slice : m_slices) {
+    slice.tiles.resize(tiles_per_slice);
+    slice.hit.resize(tiles_per_slice);
+  }
+}
+
+int LightClusters::slice_of(float depth) const {
+  if (depth <= m_near)
+    return 0;
+  auto const s =
+      static_cast<int>(std::floor(std::log(depth) * m_slice_scale -
+                                  m_slice_bias));
+  return std::clamp(s, 0, slices - 1);
+}
+
+void LightClusters::assign_slice(int s) {
+  auto &slice = m_slices[s];
+  for (auto &tile : slice.tiles)
+    tile.clear();
+
+  auto const base = static_cast<std::size_t>(s) * tiles_per_slice;
+  auto const *min_x = m_min_x.data() + base, *max_x = m_max_x.data() + base;
+  auto const *min_y = m_min_y.data() + base, *max_y = m_max_y.data() + base;
+  auto const *min_z = m_min_z.data() + base, *max_z = m_max_z.data() + base;
+  auto *hit = slice.hit.data();
+
+  for (std::size_t i = 0; i < m_cx.size(); ++i) {
+    if (s < m_first_slice[i] || s > m_last_slice[i])
+      continue;
+    // squared distance from the centre to the box, zero inside it
+    auto const cx = m_cx[i], cy = m_cy[i], cz = m_cz[i];
+    auto const r2 = m_radius[i] * m_radius[i];
+    for (int t = 0; t < tiles_per_slice; ++t) {
+      auto const dx = std::max(std::max(min_x[t] - cx, 0.f), cx - max_x[t]);
+      auto const dy = std::max(std::max(min_y[t] - cy, 0.f), cy - max_y[t]);
+      auto const dz = std::max(std::max(min_z[t] - cz, 0.f), cz - max_z[t]);
+      hit[t] = static_cast<std::uint8_t>(dx * dx + dy * dy + dz * dz <= r2);
+    }
+    for (int t = 0; t < tiles_per_slice; ++t)
+      if (hit[t] && slice.tiles[t].size() < max_lights_per_cluster)
+        slice.tiles[t].push_back(static_cast<std::uint32_t>(i));
+  }
+}
+
+void LightClusters::assign(std::vector<PointLight> const &lights,
+                           glm::mat4 const &view) {
+  REN_ZONE("LightClusters::assign");
+  assert(!m_slices.empty());
+
+  auto const n = lights.size();
+  for (auto *v : {&m_cx, &m_cy, &m_cz, &m_radius})
+    v->resize(n);
+  m_first_slice.resize(n);
+  m_last_slice.resize(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    auto const c = glm::vec3(view * glm::vec4(glm::vec3(lights[i].pos_radius),
+                                              1.f));
+    auto const r = lights[i].pos_radius.w;
+    m_cx[i] = c.x;
+    m_cy[i] = c.y;
+    m_cz[i] = c.z;
+    m_radius[i] = r;
+    // an empty range for lights entirely in front of or behind the frustum
+    auto const depth = -c.z;
+    auto const outside = depth + r < m_near || depth - r > m_far;
+    m_first_slice[i] = outside ? slices : slice_of(depth - r);
+    m_last_slice[i] = outside ? -1 : slice_of(depth + r);
+  }
+
+  if (n < parallel_threshold) {
+    for (int s = 0; s < slices; ++s)
+      assign_slice(s);
+  } else {
+    parallel_for(slices, [&](std::size_t begin, std::size_t end, unsigned) {
+      for (auto s = begin; s < end; ++s)
+        assign_slice(static_cast<int>(s));
+    });
+  }
+
+  m_grid.resize(n_clusters);
+  m_indices.clear();
+  m_max_count = 0;
+  m_occupied = 0;
+  for (int s = 0; s < slices; ++s) {
+    for (int t = 0; t < tiles_per_slice; ++t) {
+      auto const &tile = m_slices[s].tiles[t];
+      auto const count = static_cast<std::uint32_t>(tile.size());
+      m_grid[s * tiles_per_slice + t] = {
+          static_cast<std::uint32_t>(m_indices.size()), count};
+      m_indices.insert(m_indices.end(), tile.begin(), tile.end());
+      m_max_count = std::max(m_max_count, count);
+      m_occupied += count > 0;
+    }
+  }
+}
+
+} // namespace ren
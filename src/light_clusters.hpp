@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "point_lights.hpp"
+
+namespace ren {
+
+// Splits the view frustum into tiles_x * tiles_y screen tiles times `slices`
+// depth slices, spaced exponentially between the near and far plane, and
+// lists the lights whose sphere touches each cluster. The cluster bounds are
+// view space boxes kept per slice in separate arrays; each light is tested
+// against a whole slice in a branch free loop the compiler turns into SIMD
+// code. Slices are split over threads once there are enough lights.
+class LightClusters final {
+public:
+  static constexpr int tiles_x = 16;
+  static constexpr int tiles_y = 9;
+  static constexpr int slices = 24;
+  static constexpr int n_clusters = tiles_x * tiles_y * slices;
+  static constexpr int tiles_per_slice = tiles_x * tiles_y;
+  // bounds the per fragment loop, further lights in a cluster are dropped
+  static constexpr std::uint32_t max_lights_per_cluster = 128;
+  // below this many lights one thread is faster than starting more
+  static constexpr std::size_t parallel_threshold = 64;
+
+  // rebuilds the cluster bounds, only does work when `projection` changed
+  void set_projection(glm::mat4 const &projection);
+  void assign(std::vector<PointLight> const &lights, glm::mat4 const &view);
+
+  // tiles count from the bottom left like gl_FragCoord
+  static int index(int x, int y, int slice) {
+    return x + tiles_x * (y + tiles_y * slice);
+  }
+  // slice of a positive view space depth
+  int slice_of(float depth) const;
+
+  // per cluster the offset of its first light in indices() and the count
+  std::vector<glm::uvec2> const &grid() const { return m_grid; }
+  std::vector<std::uint32_t> const &indices() const { return m_indices; }
+
+  float near_plane() const { return m_near; }
+  float far_plane() const { return m_far; }
+  // slice_of(d) is floor(log(d) * slice_scale() - slice_bias())
+  float slice_scale() const { return m_slice_scale; }
+  float slice_bias() const { return m_slice_bias; }
+
+  std::uint32_t max_count() const { return m_max_count; }
+  std::size_t occupied() const { return m_occupied; }
+
+private:
+  // light lists of the clusters of one slice, filled by one worker
+  struct Slice {
+    std::vector<std::vector<std::uint32_t>> tiles;
+    std::vector<std::uint8_t> hit; // per tile, scratch
+  };
+
+  void assign_slice(int slice);
+
+  glm::mat4 m_projection{0.f};
+  float m_near{0.1f};
+  float m_far{50.f};
+  float m_slice_scale{1.f};
+  float m_slice_bias{0.f};
+  std::vector<float> m_slice_depth; // slices + 1 boundaries
+
+  // bounds of every cluster in view space, indexed like index()
+  std::vector<float> m_min_x, m_min_y, m_min_z;
+  std::vector<float> m_max_x, m_max_y, m_max_z;
+
+  // the lights in view space
+  std::vector<float> m_cx, m_cy, m_cz, m_radius;
+  std::vector<int> m_first_slice, m_last_slice;
+
+  std::vector<Slice> m_slices;
+  std::vector<glm::uvec2> m_grid;
+  std::vector<std::uint32_t> m_indices;
+  std::uint32_t m_max_count{0};
+  std::size_t m_occupied{0};
+};
+
+} // namespace ren
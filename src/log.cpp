@@ -1,10 +1,26 @@
 #include "log.hpp"
 
-#include <mutex>
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
 
 namespace ren {
 static Log *_log;
-static std::mutex log_mutex;
+
+namespace {
+
+// gives the thread's ring back to the log when the thread exits
+struct ThreadSlot {
+  std::atomic<bool> *in_use{nullptr};
+  ~ThreadSlot() {
+    if (_log != nullptr && in_use != nullptr)
+      *in_use = false;
+  }
+};
+thread_local ThreadSlot thread_slot;
+
+} // namespace
 
 Log &Log::the() { return *_log; }
 
@@ -16,17 +32,114 @@ void Log::init() {
 void Log::destroy() {
   if (_log != nullptr)
     delete _log;
+  _log = nullptr;
+}
+
+Log::~Log() = default;
+
+Log::ThreadLog &Log::thread_log() {
+  thread_local ThreadLog *ring = nullptr;
+  if (ring != nullptr)
+    return *ring;
+
+  std::lock_guard<std::mutex> const lock(m_threads_mutex);
+  auto const free = std::find_if(
+      m_threads.begin(), m_threads.end(),
+      [](auto const &t) { return !t->in_use.load(); });
+  if (free != m_threads.end()) {
+    ring = free->get();
+  } else {
+    m_threads.push_back(std::make_unique<ThreadLog>());
+    ring = m_threads.back().get();
+  }
+  ring->in_use = true;
+  thread_slot.in_use = &ring->in_use;
+  return *ring;
 }
 
 void Log::add_log(const char *fmt, ...) {
-  std::lock_guard<std::mutex> const lock(log_mutex);
-  int old_size = Buf.size();
+  char text[message_size];
   va_list args;
   va_start(args, fmt);
-  Buf.appendfv(fmt, args);
+  auto const n = std::vsnprintf(text, sizeof(text), fmt, args);
   va_end(args);
-  for (int new_size = Buf.size(); old_size < new_size; old_size++)
-    if (Buf[old_size] == '\n')
-      LineOffsets.push_back(old_size + 1);
+  if (n <= 0)
+    return;
+
+  auto &ring = thread_log();
+  auto const head = ring.head.load(std::memory_order_relaxed);
+  if (head - ring.tail.load(std::memory_order_acquire) == ring_size) {
+    ring.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  auto &message = ring.messages[head % ring_size];
+  message.size =
+      static_cast<std::uint32_t>(std::min<std::size_t>(n, message_size - 1));
+  std::memcpy(message.text, text, message.size);
+  ring.head.store(head + 1, std::memory_order_release);
 }
+
+void Log::drain() {
+  std::lock_guard<std::mutex> const lock(m_threads_mutex);
+  for (auto const &ring : m_threads) {
+    auto const tail = ring->tail.load(std::memory_order_relaxed);
+    auto const head = ring->head.load(std::memory_order_acquire);
+    for (auto i = tail; i < head; ++i) {
+      auto const &message = ring->messages[i % ring_size];
+      append(message.text, message.size);
+    }
+    ring->tail.store(head, std::memory_order_release);
+
+    if (auto const dropped = ring->dropped.exchange(0); dropped > 0) {
+      char text[64];
+      auto const n = std::snprintf(
+          text, sizeof(text), "Log: dropped %llu messages\n",
+          static_cast<unsigned long long>(dropped));
+      append(text, static_cast<std::size_t>(n));
+    }
+  }
+
+  while (m_lines.size() > max_lines) {
+    m_lines.pop_front();
+    ++m_first_line;
+  }
+  while (!m_matches.empty() && m_matches.front() < m_first_line)
+    m_matches.pop_front();
+}
+
+void Log::append(char const *text, std::size_t size) {
+  auto const *end = text + size;
+  while (text < end) {
+    auto const *newline =
+        static_cast<char const *>(std::memchr(text, '\n', end - text));
+    auto const *line_end = newline != nullptr ? newline : end;
+
+    if (m_open_line && !m_lines.empty()) {
+      m_lines.back().append(text, line_end);
+      if (!m_matches.empty() &&
+          m_matches.back() == m_first_line + m_lines.size() - 1)
+        m_matches.pop_back();
+    } else {
+      m_lines.emplace_back(text, line_end);
+    }
+    auto const &line = m_lines.back();
+    if (Filter.IsActive() &&
+        Filter.PassFilter(line.data(), line.data() + line.size()))
+      m_matches.push_back(m_first_line + m_lines.size() - 1);
+
+    m_open_line = newline == nullptr;
+    text = newline != nullptr ? newline + 1 : end;
+  }
+}
+
+void Log::refilter() {
+  m_matches.clear();
+  if (!Filter.IsActive())
+    return;
+  for (std::size_t i = 0; i < m_lines.size(); ++i)
+    if (Filter.PassFilter(m_lines[i].data(),
+                          m_lines[i].data() + m_lines[i].size()))
+      m_matches.push_back(m_first_line + i);
+}
+
 } // namespace ren
@@ -1,38 +1,59 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "imgui.h"
 
 namespace ren {
 
+// add_log() may be called from any thread and never blocks: the message is
+// formatted on the stack and pushed into a ring owned by the calling thread.
+// The main thread drains all rings once per frame into a store capped at
+// max_lines, the oldest lines are dropped first. Lines passing the filter are
+// remembered, so drawing only touches the visible ones.
 class Log {
 public:
-  ImGuiTextBuffer Buf;
+  // longer messages are cut
+  static constexpr std::size_t message_size = 256;
+  // messages a thread can log between two drains, more are counted and dropped
+  static constexpr std::size_t ring_size = 512;
+  static constexpr std::size_t max_lines = 16384;
+
   ImGuiTextFilter Filter;
-  ImVector<int> LineOffsets; // Index to lines offset. We maintain this with
-                             // AddLog() calls.
-  bool AutoScroll;           // Keep scrolling if already at the bottom.
+  bool AutoScroll; // Keep scrolling if already at the bottom.
 
   Log() {
     AutoScroll = true;
     clear();
   }
+  ~Log();
 
   static Log &the();
   static void init();
   static void destroy();
-  static void display_log(Log &l, bool *p_open);
 
   void clear() {
-    Buf.clear();
-    LineOffsets.clear();
-    LineOffsets.push_back(0);
+    m_first_line += m_lines.size();
+    m_lines.clear();
+    m_matches.clear();
+    m_open_line = false;
   }
 
   void add_log(const char *fmt, ...) IM_FMTARGS(2);
 
+  // moves the messages of every thread into the store, main thread only
+  void drain();
+
   void draw(const char *title, bool *p_open = NULL) {
+    drain();
+
     if (!ImGui::Begin(title, p_open)) {
       ImGui::End();
       return;
@@ -52,7 +73,8 @@ public:
     ImGui::SameLine();
     bool b_copy = ImGui::Button("Copy");
     ImGui::SameLine();
-    Filter.Draw("Filter", -100.0f);
+    if (Filter.Draw("Filter", -100.0f))
+      refilter();
 
     ImGui::Separator();
     ImGui::BeginChild("scrolling", ImVec2(0, 0), false,
@@ -63,57 +85,21 @@ public:
     if (b_copy)
       ImGui::LogToClipboard();
 
+    // with an active filter only the matching lines are clipped over
     ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0, 0));
-    const char *buf = Buf.begin();
-    const char *buf_end = Buf.end();
-    if (Filter.IsActive()) {
-      // In this example we don't use the clipper when Filter is enabled.
-      // This is because we don't have a random access on the result on
-      // our filter. A real application processing logs with ten of
-      // thousands of entries may want to store the result of
-      // search/filter.. especially if the filtering function is not
-      // trivial (e.g. reg-exp).
-      for (int line_no = 0; line_no < LineOffsets.Size; line_no++) {
-        const char *line_start = buf + LineOffsets[line_no];
-        const char *line_end = (line_no + 1 < LineOffsets.Size)
-                                   ? (buf + LineOffsets[line_no + 1] - 1)
-                                   : buf_end;
-        if (Filter.PassFilter(line_start, line_end))
-          ImGui::TextUnformatted(line_start, line_end);
+    auto const filtered = Filter.IsActive();
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(filtered ? m_matches.size()
+                                            : m_lines.size()));
+    while (clipper.Step()) {
+      for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+        auto const index = filtered ? m_matches[row] - m_first_line
+                                    : static_cast<std::uint64_t>(row);
+        auto const &line = m_lines[index];
+        ImGui::TextUnformatted(line.data(), line.data() + line.size());
       }
-    } else {
-      // The simplest and easy way to display the entire buffer:
-      //   ImGui::TextUnformatted(buf_begin, buf_end);
-      // And it'll just work. TextUnformatted() has specialization for
-      // large blob of text and will fast-forward to skip non-visible
-      // lines. Here we instead demonstrate using the clipper to only
-      // process lines that are within the visible area. If you have tens
-      // of thousands of items and their processing cost is
-      // non-negligible, coarse clipping them on your side is recommended.
-      // Using ImGuiListClipper requires
-      // - A) random access into your data
-      // - B) items all being the  same height,
-      // both of which we can handle since we an array pointing to the
-      // beginning of each line of text. When using the filter (in the
-      // block of code above) we don't have random access into the data to
-      // display anymore, which is why we don't use the clipper. Storing
-      // or skimming through the search result would make it possible (and
-      // would be recommended if you want to search through tens of
-      // thousands of entries).
-      ImGuiListClipper clipper;
-      clipper.Begin(LineOffsets.Size);
-      while (clipper.Step()) {
-        for (int line_no = clipper.DisplayStart; line_no < clipper.DisplayEnd;
-             line_no++) {
-          const char *line_start = buf + LineOffsets[line_no];
-          const char *line_end = (line_no + 1 < LineOffsets.Size)
-                                     ? (buf + LineOffsets[line_no + 1] - 1)
-                                     : buf_end;
-          ImGui::TextUnformatted(line_start, line_end);
-        }
-      }
-      clipper.End();
     }
+    clipper.End();
     ImGui::PopStyleVar();
 
     if (AutoScroll && ImGui::GetScrollY() >= ImGui::GetScrollMaxY())
@@ -122,6 +108,36 @@ public:
     ImGui::EndChild();
     ImGui::End();
   }
+
+private:
+  struct Message {
+    std::uint32_t size;
+    char text[message_size];
+  };
+
+  // single producer (its thread), single consumer (drain)
+  struct ThreadLog {
+    std::atomic<bool> in_use{false};
+    std::atomic<std::uint64_t> head{0};
+    std::atomic<std::uint64_t> tail{0};
+    std::atomic<std::uint64_t> dropped{0};
+    std::array<Message, ring_size> messages;
+  };
+
+  ThreadLog &thread_log();
+  void append(char const *text, std::size_t size);
+  void refilter();
+
+  std::mutex m_threads_mutex; // only taken when a thread logs the first time
+  std::vector<std::unique_ptr<ThreadLog>> m_threads;
+
+  std::deque<std::string> m_lines;
+  // number of the line at m_lines.front(), lines are numbered from the start
+  std::uint64_t m_first_line{0};
+  // numbers of the stored lines passing an active Filter, ascending
+  std::deque<std::uint64_t> m_matches;
+  // the last line ended without a newline, the next message continues it
+  bool m_open_line{false};
 };
 
 } // namespace ren
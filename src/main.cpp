@@ -11,25 +11,36 @@
 #include <iostream>
 #include <memory>
 #include <random>
+#include <string_view>
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 
+#include "benchmark.hpp"
 #include "camera.hpp"
 #include "cubemap.hpp"
+#include "geometry_arena.hpp"
+#include "gl_profiler.hpp"
 #include "input.hpp"
 #include "log.hpp"
 #include "material.hpp"
+#include "mesh_import.hpp"
+#include "mesh_registry.hpp"
 #include "object.hpp"
+#include "renderer_pool.hpp"
 #include "resource_manager.hpp"
 #include "scene.hpp"
+#include "scene_file.hpp"
 #include "shader.hpp"
 #include "texture.hpp"
+#include "texture_loader.hpp"
 #include "util.hpp"
 #include "window.hpp"
+#include "zone_profiler.hpp"
 
-#include "renderers/material.hpp"
+#include "renderers/clustered.hpp"
+#include "renderers/deferred.hpp"
 #include "renderers/raytracing.hpp"
 #include "renderers/shadow_mapping.hpp"
 #include "renderers/shadow_volume.hpp"
@@ -38,14 +49,16 @@ enum RenderIndex {
   simple_shadow_mapping = 0,
   shadow_volume,
   raytracing,
+  deferred,
+  clustered,
 };
 
 int const screen_width = 1024;
 int const screen_height = 768;
 float const screen_aspect = 4.f / 3.f;
 // static_cast<float>(screen_width) / static_cast<float>(screen_height);
-int const shadow_width = screen_width * 4;
-int const shadow_height = shadow_width;
+// depth memory of the shadow atlas
+std::size_t const shadow_budget = 64u << 20;
 ;
 
 bool should_close = false;
@@ -74,34 +87,7 @@ auto get_root_directory() -> std::filesystem::path {
   return path;
 }
 
-int main() {
-  auto const ren_directory = get_root_directory();
-
-  // Initialization -------------------
-  auto window = ren::Window("ren", screen_width, screen_height, false);
-  window.set_input_mode(GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-  window.set_input_mode(GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
-
-  auto cam = std::make_shared<ren::Camera>(
-      ren::Camera(glm::vec3(-2.0f, 2.0f, 1.0f), glm::vec3(0.f, 0.f, -1.f),
-                  glm::vec3(0.0f, 1.0f, 0.0f), 100.0f, screen_aspect));
-
-  glEnable(GL_DEPTH_TEST);
-
-  auto no_tex_img = ren::Image(ren_directory / "res/tex/no-tex.png");
-  auto no_tex = ren::Texture(no_tex_img);
-
-  ImGui::CreateContext();
-  auto &io = ImGui::GetIO();
-
-  ImGui_ImplGlfw_InitForOpenGL(window.get_ptr(), true);
-  ImGui_ImplOpenGL3_Init("#version 330 core");
-
-  ren::Log::init();
-
-  // Setup the scene -------------------
-  ren::Scene scene{};
-
+void create_default_scene(ren::Scene &scene) {
   auto material_plane =
       ren::Material::create_material_from_scatter<ren::lambertian>(
           color(0.8, 0.8, 0.0));
@@ -130,6 +116,82 @@ int main() {
 
     scene.add_object(ren::create_sphere(point3(x, y, z), 1.f, material_sphere));
   }
+}
+
+int main(int argc, char **argv) {
+  auto const ren_directory = get_root_directory();
+
+  // Initialization -------------------
+#ifdef NDEBUG
+  constexpr bool debug_context = false;
+#else
+  constexpr bool debug_context = true;
+#endif
+  auto window =
+      ren::Window("ren", screen_width, screen_height, debug_context);
+  window.set_input_mode(GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+  window.set_input_mode(GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
+
+  auto cam = std::make_shared<ren::Camera>(
+      ren::Camera(glm::vec3(-2.0f, 2.0f, 1.0f), glm::vec3(0.f, 0.f, -1.f),
+                  glm::vec3(0.0f, 1.0f, 0.0f), 100.0f, screen_aspect));
+
+  glEnable(GL_DEPTH_TEST);
+
+  // textures decode in the background and show no-tex.png until uploaded
+  auto textures = ren::TextureLoader(ren_directory / "res/tex/no-tex.png");
+
+  ImGui::CreateContext();
+  auto &io = ImGui::GetIO();
+
+  ImGui_ImplGlfw_InitForOpenGL(window.get_ptr(), true);
+  ImGui_ImplOpenGL3_Init("#version 330 core");
+
+  ren::Log::init();
+  ren::GlProfiler::init();
+  ren::Shader::init_cache(ren::Shader::default_cache_directory());
+
+  // Setup the scene -------------------
+  ren::Scene scene{};
+
+  // a scene file given on the command line replaces the procedural scene,
+  // a mesh file is added to it
+  // --benchmark runs the flythrough on every renderer, writes
+  // ./benchmark.json and exits, --path replays a recorded path instead of the
+  // default orbit
+  std::filesystem::path input;
+  std::filesystem::path path_file;
+  bool benchmark_and_exit = false;
+  for (int i = 1; i < argc; ++i) {
+    auto const arg = std::string_view(argv[i]);
+    if (arg == "--benchmark")
+      benchmark_and_exit = true;
+    else if (arg == "--path" && i + 1 < argc)
+      path_file = argv[++i];
+    else
+      input = argv[i];
+  }
+  auto const extension = input.extension();
+  if (extension == ".obj" || extension == ".gltf" || extension == ".glb") {
+    create_default_scene(scene);
+    auto const importer = ren::MeshImporter(ren_directory / ".cache/meshes");
+    if (auto mesh = importer.load(input)) {
+      auto object = ren::Object(ren::MeshRegistry::the().get_with_adjacencies(
+          std::move(mesh->vertices), std::move(mesh->indices),
+          ren::VertexFormat::compact));
+      object.set_material(
+          ren::Material::create_material_from_scatter<ren::lambertian>(
+              color(0.7, 0.7, 0.7)));
+      object.update_model();
+      scene.add_object(std::move(object));
+    } else {
+      ren::Log::the().add_log("failed to import %s\n", input.c_str());
+    }
+  } else if (input.empty() || !ren::scene_file::load(input, scene) ||
+             scene.lights().empty()) {
+    scene = ren::Scene{};
+    create_default_scene(scene);
+  }
 
   auto const speed = 0.05f;
   auto keymap = ren::Keymap{};
@@ -165,74 +227,128 @@ int main() {
       cam,
   };
 
-  auto smrenderer = std::make_shared<ren::ShadowMappingRenderer>(
-      ren_directory, shadow_width, shadow_height);
-  auto svrenderer = std::make_shared<ren::ShadowVolumeRenderer>(
-      ren_directory, transformations);
-  auto materialrenderer =
-      std::make_shared<ren::MaterialRenderer>(ren_directory);
-  auto raytracing_renderer =
-      std::make_shared<ren::RayTracingRenderer>(ren_directory);
-
-  std::shared_ptr<ren::Renderer> current_renderer = smrenderer;
+  // static geometry shared by the rasterizers
+  auto const arena = std::make_shared<ren::GeometryArena>();
+  // in RenderIndex order, each is constructed when it is first selected
+  ren::RendererPool renderers;
+  renderers.add("Simple Shadow Mapping", [&] {
+    return std::make_shared<ren::ShadowMappingRenderer>(
+        ren_directory, shadow_budget, arena);
+  });
+  renderers.add("Shadow Volume", [&] {
+    return std::make_shared<ren::ShadowVolumeRenderer>(ren_directory,
+                                                       transformations);
+  });
+  renderers.add("RayTracing", [&] {
+    return std::make_shared<ren::RayTracingRenderer>(ren_directory);
+  });
+  renderers.add("Deferred", [&] {
+    return std::make_shared<ren::DeferredRenderer>(ren_directory, arena);
+  });
+  renderers.add("Clustered", [&] {
+    return std::make_shared<ren::ClusteredRenderer>(ren_directory, arena);
+  });
+  auto raytracing_renderer = [&renderers] {
+    return renderers.get_if<ren::RayTracingRenderer>(RenderIndex::raytracing);
+  };
 
   RenderIndex current_render_index = RenderIndex::simple_shadow_mapping;
   auto new_render_index = current_render_index;
 
+  auto flythrough = ren::CameraPath{};
+  if (!path_file.empty())
+    flythrough = ren::CameraPath::load(path_file).value_or(ren::CameraPath{});
+  auto const renderer_names = std::vector<std::string>{
+      "shadow mapping", "shadow volume", "ray tracing", "deferred",
+      "clustered"};
+  auto benchmark = ren::Benchmark{};
+  auto benchmark_settings = ren::Benchmark::Settings{};
+  if (benchmark_and_exit)
+    benchmark.start(flythrough, renderer_names, benchmark_settings);
+  bool recording = false;
+  double record_start = 0.0;
+
   bool pause_scene = false;
-  bool benchmark = false;
+  REN_THREAD_NAME("main");
+  auto frame_start = ren::ZoneProfiler::now_ns();
   while (!window.should_close()) {
+    REN_ZONE("frame");
+    ren::GlProfiler::the().begin_frame();
     glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     auto ticks = glfwGetTime();
 
-    if (!pause_scene) {
+    // a running benchmark owns time, camera, light and renderer choice
+    auto const benchmarking = benchmark.running();
+    auto bench_step = ren::Benchmark::Step{};
+    if (benchmarking) {
+      bench_step = benchmark.step();
+      ticks = bench_step.ticks;
+      new_render_index = static_cast<RenderIndex>(bench_step.renderer);
+      if (bench_step.first)
+        seed_random(benchmark.settings().seed);
+      cam->set_pose(bench_step.pose.camera, bench_step.pose.yaw,
+                    bench_step.pose.pitch);
+    }
+
+    if (!pause_scene || benchmarking) {
       auto const light_pos =
-          glm::vec3(glm::sin(ticks) * 3, 10.f, glm::cos(ticks) * 3);
+          benchmarking
+              ? bench_step.pose.light
+              : glm::vec3(glm::sin(ticks) * 3, 10.f, glm::cos(ticks) * 3);
 
       scene.light_at(0)->set_translation(light_pos);
-      scene.light_at(0)->update_model();
     }
+    scene.update_transforms();
 
-    if (current_render_index != new_render_index) {
-      current_render_index = new_render_index;
-      switch (current_render_index) {
-      case RenderIndex::simple_shadow_mapping:
-        current_renderer = smrenderer;
-        break;
-      case RenderIndex::shadow_volume:
-        current_renderer = svrenderer;
-        break;
-      case RenderIndex::raytracing:
-        current_renderer = raytracing_renderer;
-        break;
-      }
+    if (recording) {
+      auto const &light = *scene.light_at(0);
+      flythrough.add({static_cast<float>(ticks - record_start), cam->pos(),
+                      cam->yaw(), cam->pitch(), light.translation()});
     }
 
+    current_render_index = new_render_index;
+    auto &current_renderer =
+        renderers.use(current_render_index, glfwGetTime(), benchmarking);
+    if (benchmarking)
+      if (auto *const rt = raytracing_renderer())
+        rt->set_realtime(current_render_index == RenderIndex::raytracing);
+
     auto start = std::chrono::system_clock::now();
-    current_renderer->render(scene, transformations, ticks);
+    {
+      REN_ZONE("render");
+      current_renderer.render(scene, transformations, ticks);
+      // wait for the GPU so frame times are not just command submission
+      if (benchmarking)
+        glFinish();
+    }
     auto end = std::chrono::system_clock::now();
-    
-    auto const elapsed =
-      std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-    
+
+    if (benchmarking) {
+      auto const ms =
+          std::chrono::duration<double, std::milli>(end - start).count();
+      benchmark.finish_frame(ms, ren::RayTracingRenderer::rays_traced());
+      if (!benchmark.running()) {
+        // the dialog that would stop the realtime threads may not be shown
+        if (auto *const rt = raytracing_renderer()) {
+          rt->set_realtime(false);
+          rt->destroy();
+        }
+        benchmark.dump("./benchmark.json");
+        if (benchmark_and_exit)
+          window.set_should_close(true);
+      }
+    }
+
     window.poll_events();
     window.exec_keymap();
-    if (!debug)
+    if (!debug && !benchmarking)
       cam->rotate_offset(window.get_cursor_pos());
 
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
-    
-    if (benchmark) {
-      if (current_render_index == RenderIndex::raytracing) {
-       ren::Log::the().add_log("Render of a frame took: %zu us\n", raytracing_renderer->elapsed()); 
-      } else 
-       ren::Log::the().add_log("Render of a frame took: %zu us\n", elapsed.count()); 
-      benchmark = false;
-    }
 
     auto frametime = glfwGetTime() - ticks;
     ImGui::Text("FPS: %f", ImGui::GetIO().Framerate);
@@ -245,20 +361,71 @@ int main() {
 
     ImGui::Begin("Renderer");
     ImGui::Checkbox("Puase scene", &pause_scene);
-    ImGui::Checkbox("Benchmark", &benchmark);
+    if (ImGui::CollapsingHeader("Benchmark")) {
+      ImGui::InputInt("Frames", &benchmark_settings.frames);
+      ImGui::InputInt("Warmup frames", &benchmark_settings.warmup_frames);
+      ImGui::InputScalar("Seed", ImGuiDataType_U32, &benchmark_settings.seed);
+      ImGui::Text("Path: %zu keyframes, %.1f s", flythrough.size(),
+                  flythrough.duration());
+      if (!benchmark.running() && !recording &&
+          ImGui::Button("Run flythrough"))
+        benchmark.start(flythrough, renderer_names, benchmark_settings);
+      if (ImGui::Checkbox("Record path", &recording) && recording) {
+        flythrough.clear();
+        record_start = glfwGetTime();
+      }
+      if (!recording && !flythrough.empty() && ImGui::Button("Save path"))
+        flythrough.save("./flythrough.path");
+    }
+    if (ImGui::Button("Save scene")) {
+      ren::scene_file::save(scene, "./scene.zrs");
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Release mesh CPU data")) {
+      // the arena copies what it can store first, the rest is only drawn
+      // from its own buffers from now on
+      for (auto const &obj : scene.objects())
+        arena->find_or_add(obj.shared_mesh());
+      auto const freed = scene.release_mesh_data();
+      ren::Log::the().add_log("Scene: released %.1f MiB of mesh data\n",
+                              freed / (1024.0 * 1024.0));
+    }
     const char *items[] = {"Simple Shadow Mapping", "Shadow Volume",
-                           "RayTracing"};
+                           "RayTracing", "Deferred", "Clustered"};
     static int combo_index = static_cast<int>(current_render_index);
     ImGui::Combo("Renderer", &combo_index, items, IM_ARRAYSIZE(items));
-    new_render_index = static_cast<RenderIndex>(combo_index);
+    if (!benchmark.running())
+      new_render_index = static_cast<RenderIndex>(combo_index);
+    ImGui::Separator();
+    current_renderer.draw_dialog();
     ImGui::Separator();
-    current_renderer->draw_dialog();
+    renderers.draw_dialog(glfwGetTime());
+    textures.draw_dialog();
+    ren::GlProfiler::the().draw_dialog();
+    ren::ZoneProfiler::the().draw_dialog();
 
     ImGui::End();
     ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-    window.swap_buffers();
+    {
+      REN_ZONE("imgui");
+      auto const timer = ren::GlProfiler::the().scope("imgui");
+      ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    }
+    {
+      REN_ZONE("swap");
+      window.swap_buffers();
+    }
+
+    textures.update();
+    // construction would show up in the benchmark's frame times
+    if (!benchmark.running())
+      renderers.update(current_render_index, glfwGetTime());
+
+    auto const frame_end = ren::ZoneProfiler::now_ns();
+    ren::ZoneProfiler::the().add_frame_time((frame_end - frame_start) / 1e6);
+    frame_start = frame_end;
   }
-  raytracing_renderer->destroy();
+  renderers.release_all();
+  ren::GlProfiler::destroy();
   ren::Log::destroy();
 }
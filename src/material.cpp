@@ -6,4 +6,22 @@ float schlick(float cosine, float ref_idx) {
   r0 = r0 * r0;
   return r0 + (1 - r0) * pow((1 - cosine), 5);
 }
+
+glm::vec4 Material::base_color() const {
+  if (!scatter)
+    return glm::vec4(diffuse, shininess);
+  switch (scatter->type()) {
+  case ScatterType::diffuse_light:
+    return glm::vec4(static_cast<diffuse_light const &>(*scatter).emit, 1.f);
+  case ScatterType::lambertian:
+    return glm::vec4(static_cast<lambertian const &>(*scatter).albedo, 16.f);
+  case ScatterType::metal:
+    return glm::vec4(static_cast<metal const &>(*scatter).albedo, 128.f);
+  case ScatterType::dielectric:
+    return glm::vec4(1.f, 1.f, 1.f, 128.f);
+  case ScatterType::none:
+    break;
+  }
+  return glm::vec4(0.7f, 0.7f, 0.7f, 32.f);
+}
 } // namespace ren
@@ -22,6 +22,7 @@ enum class ScatterType {
 class Scatter {
 public:
   virtual ~Scatter() = default;
+  virtual ScatterType type() const { return ScatterType::none; }
   virtual color emitted() const { return color(0, 0, 0); }
   virtual bool scatter(ray const &r_in, hit_record const &rec,
                        color &attenuation, ray &scattered, float &pdf) const {
@@ -37,6 +38,8 @@ class diffuse_light : public Scatter {
 public:
   diffuse_light(color c) : emit(c) {}
 
+  ScatterType type() const override { return ScatterType::diffuse_light; }
+
   virtual bool scatter(const ray &r_in, const hit_record &rec,
                        color &attenuation, ray &scattered,
                        float &pdf) const override {
@@ -52,6 +55,8 @@ class lambertian : public Scatter {
 public:
   lambertian(color const &a) : albedo(a) {}
 
+  ScatterType type() const override { return ScatterType::lambertian; }
+
   virtual bool scatter(ray const &r_in, hit_record const &rec,
                        color &attenuation, ray &scattered,
                        float &pdf) const override {
@@ -75,6 +80,8 @@ class metal : public Scatter {
 public:
   metal(color const &a, float f) : albedo(a), fuzz(f) {}
 
+  ScatterType type() const override { return ScatterType::metal; }
+
   virtual bool scatter(ray const &r_in, hit_record const &rec,
                        color &attenuation, ray &scattered,
                        float &pdf) const override {
@@ -93,6 +100,8 @@ class dielectric : public Scatter {
 public:
   dielectric(float ri) : ref_idx(ri) {}
 
+  ScatterType type() const override { return ScatterType::dielectric; }
+
   virtual bool scatter(ray const &r_in, hit_record const &rec,
                        color &attenuation, ray &scattered,
                        float &pdf) const override {
@@ -140,5 +149,9 @@ struct Material {
   Material(std::shared_ptr<Scatter> s) : scatter(s) {}
   Material(glm::vec3 amb, glm::vec3 diff, glm::vec3 spec, float shin)
       : ambient(amb), diffuse(diff), specular(spec), shininess(shin) {}
+
+  // a single color (rgb) and shininess (a) for rasterizers, taken from the
+  // scatter when there is one
+  glm::vec4 base_color() const;
 };
 } // namespace ren
@@ -0,0 +1,117 @@
+#include "mesh.hpp"
+
+#include <cstddef>
+
+#include "adjacency.hpp"
+#include "log.hpp"
+#include "mesh_optimize.hpp"
+
+namespace ren {
+
+void Mesh::generate_adjacencies() {
+  m_indices = build_adjacency(m_verts, m_indices);
+}
+
+void Mesh::setup(VertexFormat format) {
+  m_n_vertices = m_verts.size();
+  m_n_indices = m_indices.size();
+
+  if (!m_verts.empty()) {
+    m_bounds.min = m_bounds.max = m_verts[0].pos;
+    for (auto const &v : m_verts) {
+      m_bounds.min = glm::min(m_bounds.min, v.pos);
+      m_bounds.max = glm::max(m_bounds.max, v.pos);
+    }
+  }
+
+  if (format == VertexFormat::compact && !can_compact(m_verts)) {
+    Log::the().add_log("Mesh: vertices don't fit the compact format, "
+                       "uploading them at full precision\n");
+    format = VertexFormat::full;
+  }
+  m_format = format;
+
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &EBO);
+
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+
+  if (format == VertexFormat::compact) {
+    auto const compact = compact_vertices(m_verts);
+    glBufferData(GL_ARRAY_BUFFER, compact.size() * sizeof(CompactVertex),
+                 compact.data(), GL_STATIC_DRAW);
+    GlProfiler::the().count_upload(compact.size() * sizeof(CompactVertex));
+  } else {
+    glBufferData(GL_ARRAY_BUFFER, m_verts.size() * sizeof(Vertex),
+                 m_verts.data(), GL_STATIC_DRAW);
+    GlProfiler::the().count_upload(m_verts.size() * sizeof(Vertex));
+  }
+
+  if (m_indices.size() != 0) {
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(GLuint),
+                 m_indices.data(), GL_STATIC_DRAW);
+    GlProfiler::the().count_upload(m_indices.size() * sizeof(GLuint));
+  }
+
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+  if (format == VertexFormat::compact) {
+    // the shaders still see vec3/vec3/vec2, the conversion happens on fetch
+    glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex),
+                          (void *)offsetof(CompactVertex, pos));
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+                          sizeof(CompactVertex),
+                          (void *)offsetof(CompactVertex, norm));
+    glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE,
+                          sizeof(CompactVertex),
+                          (void *)offsetof(CompactVertex, tex));
+  } else {
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                          (void *)offsetof(Vertex, norm));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                          (void *)offsetof(Vertex, tex));
+  }
+
+  glBindVertexArray(0);
+}
+
+void Mesh::draw_instanced(GLsizei count) const {
+  bind_vao();
+  GlProfiler::the().count_draw();
+  if (m_has_adjacencies) {
+    glDrawElementsInstanced(GL_TRIANGLES_ADJACENCY, m_n_indices,
+                            GL_UNSIGNED_INT, 0, count);
+  } else if (m_n_indices != 0) {
+    glDrawElementsInstanced(GL_TRIANGLES, m_n_indices, GL_UNSIGNED_INT, 0,
+                            count);
+  } else {
+    glDrawArraysInstanced(GL_TRIANGLES, 0, m_n_vertices, count);
+  }
+  glBindVertexArray(0);
+}
+
+void Mesh::set_instance_buffer(GLuint buffer, std::size_t offset) const {
+  glBindVertexArray(VAO);
+  set_instance_attributes(buffer, offset);
+  glBindVertexArray(0);
+}
+
+void set_instance_attributes(GLuint buffer, std::size_t offset) {
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  // GL 3.3 has no base instance, so batches are selected by moving the
+  // attribute offsets instead
+  for (GLuint column = 0; column < 8; ++column) {
+    auto const location = instance_location + column;
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                          (void *)(offset + column * sizeof(glm::vec4)));
+    glVertexAttribDivisor(location, 1);
+  }
+}
+
+} // namespace ren
@@ -7,6 +7,8 @@
 #include "glad/glad.h"
 #include "glm/glm.hpp"
 
+#include "bounds.hpp"
+#include "gl_profiler.hpp"
 #include "gl_util.hpp"
 
 namespace ren {
@@ -17,23 +19,79 @@ struct Vertex {
   glm::vec2 tex;
 };
 
+// Per instance attributes of instanced draws, the columns of both matrices
+// are fed to locations instance_location .. instance_location + 7. Shaders
+// only use the upper 3x3 of normal_matrix, its last column carries the
+// object's Material::base_color().
+struct InstanceData {
+  glm::mat4 model;
+  glm::mat4 normal_matrix;
+};
+constexpr GLuint instance_location = 3;
+
+// points the InstanceData attributes of the bound VAO at `buffer`
+void set_instance_attributes(GLuint buffer, std::size_t offset);
+
+// Layout of the vertex buffer on the GPU. compact is 16 bytes per vertex (see
+// CompactVertex) and falls back to full when the data can't be represented.
+enum class VertexFormat {
+  full,
+  compact,
+};
+
 class Mesh {
 public:
-  static std::unique_ptr<Mesh> construct(std::vector<Vertex> vertices,
-                                         std::vector<GLuint> indices,
-                                         bool has_adjacencies = false) {
+  static std::unique_ptr<Mesh>
+  construct(std::vector<Vertex> vertices, std::vector<GLuint> indices,
+            bool has_adjacencies = false,
+            VertexFormat format = VertexFormat::full) {
     auto m = std::make_unique<Mesh>(has_adjacencies);
-    m->m_verts = vertices;
-    m->m_indices = indices;
-    m->setup();
+    m->m_verts = std::move(vertices);
+    m->m_indices = std::move(indices);
+    m->setup(format);
 
     return m;
   }
   static std::unique_ptr<Mesh> construct(std::vector<Vertex> vertices,
                                          bool find_adjacencies = false) {
     auto m = std::make_unique<Mesh>(find_adjacencies);
-    m->m_verts = vertices;
-    m->setup();
+    m->m_verts = std::move(vertices);
+    if (find_adjacencies) {
+      m->m_indices.resize(m->m_verts.size());
+      for (std::size_t i = 0; i < m->m_indices.size(); ++i)
+        m->m_indices[i] = i;
+      m->generate_adjacencies();
+    }
+    m->setup(VertexFormat::full);
+
+    return m;
+  }
+
+  // `indices` is a plain triangle list, the adjacency is generated from it
+  static std::unique_ptr<Mesh>
+  construct_with_adjacencies(std::vector<Vertex> vertices,
+                             std::vector<GLuint> indices,
+                             VertexFormat format = VertexFormat::full) {
+    auto m = std::make_unique<Mesh>(true);
+    m->m_verts = std::move(vertices);
+    m->m_indices = std::move(indices);
+    m->generate_adjacencies();
+    m->setup(format);
+
+    return m;
+  }
+
+  // copies the caller owned arrays, e.g. of a mapped scene file, into the
+  // mesh and uploads them
+  static std::unique_ptr<Mesh> construct(Vertex const *vertices,
+                                         std::size_t n_vertices,
+                                         GLuint const *indices,
+                                         std::size_t n_indices,
+                                         bool has_adjacencies = false) {
+    auto m = std::make_unique<Mesh>(has_adjacencies);
+    m->m_verts.assign(vertices, vertices + n_vertices);
+    m->m_indices.assign(indices, indices + n_indices);
+    m->setup(VertexFormat::full);
 
     return m;
   }
@@ -46,54 +104,57 @@ public:
   }
   void draw() const {
     bind_vao();
+    GlProfiler::the().count_draw();
     if (m_has_adjacencies) {
-      glDrawElements(GL_TRIANGLES_ADJACENCY, m_indices.size(), GL_UNSIGNED_INT,
-                     0);
-    } else if (m_indices.size() != 0) {
-      glDrawElements(GL_TRIANGLES, m_indices.size(), GL_UNSIGNED_INT, 0);
+      glDrawElements(GL_TRIANGLES_ADJACENCY, m_n_indices, GL_UNSIGNED_INT, 0);
+    } else if (m_n_indices != 0) {
+      glDrawElements(GL_TRIANGLES, m_n_indices, GL_UNSIGNED_INT, 0);
     } else {
-      glDrawArrays(GL_TRIANGLES, 0, m_verts.size());
+      glDrawArrays(GL_TRIANGLES, 0, m_n_vertices);
     }
     glBindVertexArray(0);
   }
 
-  void bind_vao() const { glBindVertexArray(VAO); }
-
-  std::size_t n_indices() const { return m_indices.size(); }
-
-private:
-  void generate_adjacencies();
-  void setup() {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+  // draws `count` instances, set_instance_buffer() must have been called
+  void draw_instanced(GLsizei count) const;
+  // sources the InstanceData attributes from `buffer` starting at `offset`,
+  // the binding is part of the VAO and stays until changed
+  void set_instance_buffer(GLuint buffer, std::size_t offset) const;
 
+  void bind_vao() const {
     glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    glBufferData(GL_ARRAY_BUFFER, m_verts.size() * sizeof(Vertex),
-                 m_verts.data(), GL_STATIC_DRAW);
-
-    if (m_indices.size() != 0) {
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(GLuint),
-                   m_indices.data(), GL_STATIC_DRAW);
-    }
-
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void *)offsetof(Vertex, norm));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void *)offsetof(Vertex, tex));
+    GlProfiler::the().count_state_change();
+  }
 
-    glBindVertexArray(0);
+  std::size_t n_indices() const { return m_n_indices; }
+  std::size_t n_vertices() const { return m_n_vertices; }
+  // empty after release_cpu_data()
+  auto const &vertices() const { return m_verts; }
+  auto const &indices() const { return m_indices; }
+  bool has_cpu_data() const { return m_verts.size() == m_n_vertices; }
+  bool has_adjacencies() const { return m_has_adjacencies; }
+  VertexFormat format() const { return m_format; }
+  // object space bounds, kept after release_cpu_data()
+  Aabb const &bounds() const { return m_bounds; }
+
+  // Frees the CPU side copies, the mesh can still be drawn. Opt-in: the
+  // geometry arena, CPU shadow volumes, scene saving and the mesh registry
+  // read them, and skip meshes they didn't copy from before the release.
+  void release_cpu_data() {
+    m_verts = {};
+    m_indices = {};
   }
 
+private:
+  void generate_adjacencies();
+  void setup(VertexFormat format);
+
   bool m_has_adjacencies;
+  VertexFormat m_format{VertexFormat::full};
   GLuint VAO, VBO, EBO;
+  std::size_t m_n_vertices{0};
+  std::size_t m_n_indices{0};
+  Aabb m_bounds;
   std::vector<Vertex> m_verts;
   std::vector<GLuint> m_indices;
 };
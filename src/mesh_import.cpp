@@ -0,0 +1,1003 @@
+#include "mesh_import.hpp"
+
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+#include "log.hpp"
+#include "mesh_optimize.hpp"
+#include "parallel.hpp"
+#include "zone_profiler.hpp"
+
+namespace ren {
+
+namespace {
+
+constexpr char cache_magic[8] = {'Z', 'R', 'M', 'E', 'S', 'H', '\0', '\0'};
+constexpr std::uint32_t cache_version = 2;
+// the content hash is defined over fixed size blocks so it does not depend on
+// the number of threads used to compute it
+constexpr std::size_t hash_block_size = 4 << 20;
+
+struct CacheHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t vertex_size;
+  std::uint64_t content_hash;
+  std::uint64_t n_vertices;
+  std::uint64_t n_indices;
+};
+
+std::uint64_t fnv1a(void const *data, std::size_t size,
+                    std::uint64_t h = 14695981039346656037ull) {
+  auto const *bytes = static_cast<unsigned char const *>(data);
+  for (std::size_t i = 0; i < size; ++i) {
+    h ^= bytes[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+std::optional<std::vector<char>> read_file(std::filesystem::path const &path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.is_open())
+    return std::nullopt;
+  auto const size = static_cast<std::size_t>(file.tellg());
+  file.seekg(0);
+  std::vector<char> bytes(size);
+  file.read(bytes.data(), size);
+  if (!file)
+    return std::nullopt;
+  return bytes;
+}
+
+// Replaces missing (zero) normals with area weighted vertex normals.
+void fill_missing_normals(MeshData &mesh) {
+  std::vector<bool> missing(mesh.vertices.size());
+  bool any_missing = false;
+  for (std::size_t i = 0; i < mesh.vertices.size(); ++i) {
+    missing[i] = glm::length2(mesh.vertices[i].norm) == 0.f;
+    any_missing |= missing[i];
+  }
+  if (!any_missing)
+    return;
+
+  for (std::size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+    auto const a = mesh.indices[i], b = mesh.indices[i + 1],
+               c = mesh.indices[i + 2];
+    auto const n = glm::cross(mesh.vertices[b].pos - mesh.vertices[a].pos,
+                              mesh.vertices[c].pos - mesh.vertices[a].pos);
+    for (auto const v : {a, b, c}) {
+      if (missing[v])
+        mesh.vertices[v].norm += n;
+    }
+  }
+  for (std::size_t i = 0; i < mesh.vertices.size(); ++i) {
+    if (missing[i] && glm::length2(mesh.vertices[i].norm) > 0.f)
+      mesh.vertices[i].norm = glm::normalize(mesh.vertices[i].norm);
+  }
+}
+
+// OBJ -----------------------------------------------------------------------
+
+// A face corner after parsing. Positive OBJ indices are global and resolved
+// right away, negative ones are relative to the elements seen so far and can
+// only be made global once the element counts of earlier chunks are known.
+// Bit 0, 1 and 2 of the masks refer to v, vt and vn.
+struct ObjCorner {
+  int v{-1};
+  int vt{-1};
+  int vn{-1};
+  std::uint8_t present{0};
+  std::uint8_t relative{0};
+};
+
+struct ObjKey {
+  int v, vt, vn;
+  bool operator==(ObjKey const &o) const {
+    return v == o.v && vt == o.vt && vn == o.vn;
+  }
+};
+
+struct ObjKeyHash {
+  std::size_t operator()(ObjKey const &k) const {
+    auto h = static_cast<std::uint64_t>(static_cast<std::uint32_t>(k.v));
+    h = h * 0x9E3779B97F4A7C15ull ^ static_cast<std::uint32_t>(k.vt);
+    h = h * 0x9E3779B97F4A7C15ull ^ static_cast<std::uint32_t>(k.vn);
+    return static_cast<std::size_t>(h ^ (h >> 29));
+  }
+};
+
+struct ObjChunk {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  std::vector<glm::vec2> texcoords;
+  std::vector<ObjCorner> corners; // three per triangle
+
+  // filled by the dedup pass
+  std::vector<ObjKey> unique;
+  std::vector<GLuint> local_indices;
+
+  bool ok{true};
+};
+
+char const *skip_spaces(char const *p, char const *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    ++p;
+  return p;
+}
+
+char const *parse_float(char const *p, char const *end, float &out) {
+  p = skip_spaces(p, end);
+  if (p < end && *p == '+')
+    ++p;
+  auto const [ptr, ec] = std::from_chars(p, end, out);
+  return ec == std::errc() ? ptr : nullptr;
+}
+
+// Parses one "v", "v/vt", "v//vn" or "v/vt/vn" token.
+char const *parse_corner(char const *p, char const *end, ObjCorner &c,
+                         ObjChunk const &chunk) {
+  int *fields[3] = {&c.v, &c.vt, &c.vn};
+  std::size_t const counts[3] = {chunk.positions.size(),
+                                 chunk.texcoords.size(), chunk.normals.size()};
+  for (int f = 0; f < 3; ++f) {
+    if (f > 0) {
+      if (p >= end || *p != '/')
+        break;
+      ++p;
+      if (p < end && *p == '/')
+        continue;
+    }
+    int value = 0;
+    auto const [ptr, ec] = std::from_chars(p, end, value);
+    if (ec != std::errc() || value == 0)
+      return nullptr;
+    p = ptr;
+    c.present |= 1u << f;
+    if (value < 0) {
+      *fields[f] = static_cast<int>(counts[f]) + value;
+      c.relative |= 1u << f;
+    } else {
+      *fields[f] = value - 1;
+    }
+  }
+  return p;
+}
+
+void parse_obj_chunk(char const *p, char const *end, ObjChunk &chunk) {
+  std::vector<ObjCorner> polygon;
+  while (p < end) {
+    auto const *line_end =
+        static_cast<char const *>(std::memchr(p, '\n', end - p));
+    if (!line_end)
+      line_end = end;
+    auto const *q = skip_spaces(p, line_end);
+
+    if (line_end - q > 2 && q[0] == 'v' && (q[1] == ' ' || q[1] == '\t')) {
+      glm::vec3 v;
+      q += 2;
+      for (int i = 0; i < 3 && q; ++i)
+        q = parse_float(q, line_end, v[i]);
+      if (!q) {
+        chunk.ok = false;
+        return;
+      }
+      chunk.positions.push_back(v);
+    } else if (line_end - q > 3 && q[0] == 'v' && q[1] == 'n') {
+      glm::vec3 n;
+      q += 2;
+      for (int i = 0; i < 3 && q; ++i)
+        q = parse_float(q, line_end, n[i]);
+      if (!q) {
+        chunk.ok = false;
+        return;
+      }
+      chunk.normals.push_back(n);
+    } else if (line_end - q > 3 && q[0] == 'v' && q[1] == 't') {
+      glm::vec2 t;
+      q += 2;
+      for (int i = 0; i < 2 && q; ++i)
+        q = parse_float(q, line_end, t[i]);
+      if (!q) {
+        chunk.ok = false;
+        return;
+      }
+      chunk.texcoords.push_back(t);
+    } else if (line_end - q > 2 && q[0] == 'f' &&
+               (q[1] == ' ' || q[1] == '\t')) {
+      polygon.clear();
+      q = skip_spaces(q + 2, line_end);
+      while (q < line_end) {
+        ObjCorner c;
+        q = parse_corner(q, line_end, c, chunk);
+        if (!q) {
+          chunk.ok = false;
+          return;
+        }
+        polygon.push_back(c);
+        q = skip_spaces(q, line_end);
+      }
+      // fan triangulation
+      for (std::size_t i = 2; i < polygon.size(); ++i) {
+        chunk.corners.push_back(polygon[0]);
+        chunk.corners.push_back(polygon[i - 1]);
+        chunk.corners.push_back(polygon[i]);
+      }
+    }
+    // everything else (o, g, s, usemtl, comments, ...) is ignored
+    p = line_end + 1;
+  }
+}
+
+// GLTF ----------------------------------------------------------------------
+
+struct Json {
+  enum class Type { null, boolean, number, string, array, object };
+
+  Type type{Type::null};
+  bool boolean{false};
+  double number{0};
+  std::string string;
+  std::vector<Json> array;
+  std::vector<std::pair<std::string, Json>> object;
+
+  Json const *find(std::string_view key) const {
+    for (auto const &[k, v] : object) {
+      if (k == key)
+        return &v;
+    }
+    return nullptr;
+  }
+  double number_or(std::string_view key, double fallback) const {
+    auto const *v = find(key);
+    return v && v->type == Type::number ? v->number : fallback;
+  }
+  // a finite, non-negative integer that fits a size_t, casting anything
+  // else would be undefined
+  std::optional<std::size_t> as_size() const {
+    constexpr auto max = static_cast<double>(~std::size_t{0});
+    if (type != Type::number || !(number >= 0) || number >= max ||
+        number != std::floor(number))
+      return std::nullopt;
+    return static_cast<std::size_t>(number);
+  }
+  std::optional<std::size_t> size(std::string_view key) const {
+    auto const *v = find(key);
+    return v ? v->as_size() : std::nullopt;
+  }
+  // `fallback` only when the key is missing, not when it is invalid
+  std::optional<std::size_t> size_or(std::string_view key,
+                                     std::size_t fallback) const {
+    auto const *v = find(key);
+    return v ? v->as_size() : fallback;
+  }
+};
+
+class JsonParser {
+public:
+  JsonParser(std::string_view text)
+      : m_p(text.data()), m_end(text.data() + text.size()) {}
+
+  std::optional<Json> parse() {
+    Json value;
+    if (!parse_value(value, 0))
+      return std::nullopt;
+    return value;
+  }
+
+private:
+  static constexpr int max_depth = 128;
+
+  void skip() {
+    while (m_p < m_end &&
+           (*m_p == ' ' || *m_p == '\n' || *m_p == '\r' || *m_p == '\t'))
+      ++m_p;
+  }
+  bool consume(char c) {
+    skip();
+    if (m_p < m_end && *m_p == c) {
+      ++m_p;
+      return true;
+    }
+    return false;
+  }
+  bool literal(std::string_view word) {
+    if (static_cast<std::size_t>(m_end - m_p) < word.size() ||
+        std::string_view(m_p, word.size()) != word)
+      return false;
+    m_p += word.size();
+    return true;
+  }
+
+  bool parse_string(std::string &out) {
+    if (!consume('"'))
+      return false;
+    while (m_p < m_end && *m_p != '"') {
+      char c = *m_p++;
+      if (c != '\\') {
+        out.push_back(c);
+        continue;
+      }
+      if (m_p >= m_end)
+        return false;
+      switch (char e = *m_p++) {
+      case 'b': out.push_back('\b'); break;
+      case 'f': out.push_back('\f'); break;
+      case 'n': out.push_back('\n'); break;
+      case 'r': out.push_back('\r'); break;
+      case 't': out.push_back('\t'); break;
+      case 'u': {
+        if (m_end - m_p < 4)
+          return false;
+        unsigned code = 0;
+        auto const [ptr, ec] = std::from_chars(m_p, m_p + 4, code, 16);
+        if (ec != std::errc() || ptr != m_p + 4)
+          return false;
+        m_p += 4;
+        // surrogate pairs are not joined, URIs and names in practice are ASCII
+        if (code < 0x80) {
+          out.push_back(static_cast<char>(code));
+        } else if (code < 0x800) {
+          out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+          out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else {
+          out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+          out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+          out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+        break;
+      }
+      default: out.push_back(e); break;
+      }
+    }
+    return consume('"');
+  }
+
+  bool parse_value(Json &v, int depth) {
+    if (depth > max_depth)
+      return false;
+    skip();
+    if (m_p >= m_end)
+      return false;
+
+    switch (*m_p) {
+    case '{':
+      ++m_p;
+      v.type = Json::Type::object;
+      if (consume('}'))
+        return true;
+      do {
+        std::string key;
+        Json member;
+        if (!parse_string(key) || !consume(':') ||
+            !parse_value(member, depth + 1))
+          return false;
+        v.object.emplace_back(std::move(key), std::move(member));
+      } while (consume(','));
+      return consume('}');
+    case '[':
+      ++m_p;
+      v.type = Json::Type::array;
+      if (consume(']'))
+        return true;
+      do {
+        v.array.emplace_back();
+        if (!parse_value(v.array.back(), depth + 1))
+          return false;
+      } while (consume(','));
+      return consume(']');
+    case '"':
+      v.type = Json::Type::string;
+      return parse_string(v.string);
+    case 't':
+      v.type = Json::Type::boolean;
+      v.boolean = true;
+      return literal("true");
+    case 'f':
+      v.type = Json::Type::boolean;
+      return literal("false");
+    case 'n':
+      return literal("null");
+    default: {
+      v.type = Json::Type::number;
+      auto const [ptr, ec] = std::from_chars(m_p, m_end, v.number);
+      if (ec != std::errc())
+        return false;
+      m_p = ptr;
+      return true;
+    }
+    }
+  }
+
+  char const *m_p;
+  char const *m_end;
+};
+
+struct GltfDocument {
+  Json json;
+  std::vector<std::vector<char>> buffers;
+};
+
+std::optional<std::vector<char>> decode_base64(std::string_view in) {
+  auto const value = [](char c) -> int {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+  };
+  std::vector<char> out;
+  out.reserve(in.size() / 4 * 3);
+  std::uint32_t acc = 0;
+  int bits = 0;
+  for (char c : in) {
+    if (c == '=')
+      break;
+    auto const v = value(c);
+    if (v < 0)
+      return std::nullopt;
+    acc = (acc << 6) | v;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out.push_back(static_cast<char>((acc >> bits) & 0xFF));
+    }
+  }
+  return out;
+}
+
+// Parses the JSON part and pulls in every buffer, either from the GLB binary
+// chunk, from a data: URI or from a file next to the document.
+std::optional<GltfDocument> resolve_gltf(std::filesystem::path const &path,
+                                         std::vector<char> const &bytes) {
+  std::string_view json_text(bytes.data(), bytes.size());
+  std::string_view glb_bin;
+
+  auto const read_u32 = [&bytes](std::size_t at) {
+    std::uint32_t v;
+    std::memcpy(&v, bytes.data() + at, sizeof(v));
+    return v;
+  };
+  if (bytes.size() >= 12 && read_u32(0) == 0x46546C67) { // "glTF"
+    json_text = {};
+    std::size_t at = 12;
+    while (at + 8 <= bytes.size()) {
+      auto const length = read_u32(at);
+      auto const type = read_u32(at + 4);
+      if (at + 8 + length > bytes.size())
+        return std::nullopt;
+      std::string_view data(bytes.data() + at + 8, length);
+      if (type == 0x4E4F534A) // JSON
+        json_text = data;
+      else if (type == 0x004E4942) // BIN
+        glb_bin = data;
+      at += 8 + length;
+    }
+  }
+
+  auto json = JsonParser(json_text).parse();
+  if (!json || json->type != Json::Type::object)
+    return std::nullopt;
+
+  GltfDocument doc;
+  doc.json = std::move(*json);
+  if (auto const *buffers = doc.json.find("buffers")) {
+    for (auto const &buffer : buffers->array) {
+      auto const *uri = buffer.find("uri");
+      if (!uri) {
+        doc.buffers.emplace_back(glb_bin.begin(), glb_bin.end());
+        continue;
+      }
+      std::string_view u = uri->string;
+      if (u.rfind("data:", 0) == 0) {
+        auto const comma = u.find(',');
+        if (comma == std::string_view::npos)
+          return std::nullopt;
+        auto data = decode_base64(u.substr(comma + 1));
+        if (!data)
+          return std::nullopt;
+        doc.buffers.push_back(std::move(*data));
+      } else {
+        auto data = read_file(path.parent_path() / uri->string);
+        if (!data)
+          return std::nullopt;
+        doc.buffers.push_back(std::move(*data));
+      }
+    }
+  }
+  return doc;
+}
+
+// Strided view of an accessor's elements inside its buffer.
+struct AccessorView {
+  char const *data;
+  std::size_t count;
+  std::size_t stride;
+  int component_type;
+  std::size_t component_size;
+};
+
+std::size_t component_size(std::size_t component_type) {
+  switch (component_type) {
+  case 5126: return 4; // float
+  case 5125: return 4; // unsigned int
+  case 5123: return 2; // unsigned short
+  case 5121: return 1; // unsigned byte
+  default: return 0;
+  }
+}
+
+std::optional<AccessorView> view_accessor(GltfDocument const &doc,
+                                          std::size_t index,
+                                          int n_components) {
+  auto const *accessors = doc.json.find("accessors");
+  auto const *views = doc.json.find("bufferViews");
+  if (!accessors || !views || index >= accessors->array.size())
+    return std::nullopt;
+  auto const &accessor = accessors->array[index];
+  // accessors without a buffer view (sparse or all zero) are not supported
+  auto const view_index = accessor.size("bufferView");
+  if (!view_index || *view_index >= views->array.size())
+    return std::nullopt;
+  auto const &view = views->array[*view_index];
+  auto const buffer_index = view.size("buffer");
+  if (!buffer_index || *buffer_index >= doc.buffers.size())
+    return std::nullopt;
+  auto const &buffer = doc.buffers[*buffer_index];
+
+  auto const count = accessor.size("count");
+  auto const component_type = accessor.size("componentType");
+  if (!count || !component_type || component_size(*component_type) == 0)
+    return std::nullopt;
+  AccessorView v{};
+  v.count = *count;
+  v.component_type = static_cast<int>(*component_type);
+  v.component_size = component_size(*component_type);
+  auto const element_size = v.component_size * n_components;
+  auto const stride = view.size_or("byteStride", element_size);
+  auto const view_offset = view.size_or("byteOffset", 0);
+  auto const accessor_offset = accessor.size_or("byteOffset", 0);
+  if (!stride || !view_offset || !accessor_offset)
+    return std::nullopt;
+  v.stride = *stride;
+
+  // in this order nothing below can overflow
+  if (*view_offset > buffer.size() ||
+      *accessor_offset > buffer.size() - *view_offset)
+    return std::nullopt;
+  auto const offset = *view_offset + *accessor_offset;
+  if (v.count > 0) {
+    if (element_size > buffer.size() - offset)
+      return std::nullopt;
+    auto const room = buffer.size() - offset - element_size;
+    if (v.stride != 0 && v.count - 1 > room / v.stride)
+      return std::nullopt;
+  }
+  v.data = buffer.data() + offset;
+  return v;
+}
+
+// Reads an accessor as floats, `n_components` per element. Float, and
+// normalized unsigned byte / short data are supported.
+bool read_accessor(GltfDocument const &doc, std::size_t index,
+                   int n_components, std::vector<float> &out) {
+  auto const view = view_accessor(doc, index, n_components);
+  if (!view || view->component_type == 5125)
+    return false;
+
+  out.resize(view->count * n_components);
+  for (std::size_t i = 0; i < view->count; ++i) {
+    auto const *src = view->data + i * view->stride;
+    for (int c = 0; c < n_components; ++c) {
+      float value = 0.f;
+      if (view->component_type == 5126) {
+        std::memcpy(&value, src + c * 4, 4);
+      } else if (view->component_type == 5123) {
+        std::uint16_t v;
+        std::memcpy(&v, src + c * 2, 2);
+        value = v / 65535.f;
+      } else {
+        value = static_cast<std::uint8_t>(src[c]) / 255.f;
+      }
+      out[i * n_components + c] = value;
+    }
+  }
+  return true;
+}
+
+bool read_indices(GltfDocument const &doc, std::size_t index,
+                  std::vector<GLuint> &out) {
+  auto const view = view_accessor(doc, index, 1);
+  if (!view || view->component_type == 5126)
+    return false;
+
+  out.resize(view->count);
+  for (std::size_t i = 0; i < view->count; ++i) {
+    auto const *src = view->data + i * view->stride;
+    std::uint32_t v = 0;
+    if (view->component_size == 4) {
+      std::memcpy(&v, src, 4);
+    } else if (view->component_size == 2) {
+      std::uint16_t s;
+      std::memcpy(&s, src, 2);
+      v = s;
+    } else {
+      v = static_cast<std::uint8_t>(*src);
+    }
+    out[i] = v;
+  }
+  return true;
+}
+
+std::optional<MeshData> decode_primitive(GltfDocument const &doc,
+                                         Json const &primitive) {
+  if (primitive.number_or("mode", 4) != 4) // triangles only
+    return MeshData{};
+  auto const *attributes = primitive.find("attributes");
+  if (!attributes)
+    return std::nullopt;
+  auto const position = attributes->size("POSITION");
+  if (!position)
+    return std::nullopt;
+
+  std::vector<float> positions, normals, texcoords;
+  if (!read_accessor(doc, *position, 3, positions))
+    return std::nullopt;
+  if (auto const *n = attributes->find("NORMAL")) {
+    auto const index = n->as_size();
+    if (!index || !read_accessor(doc, *index, 3, normals))
+      return std::nullopt;
+  }
+  if (auto const *t = attributes->find("TEXCOORD_0")) {
+    auto const index = t->as_size();
+    if (!index || !read_accessor(doc, *index, 2, texcoords))
+      return std::nullopt;
+  }
+
+  MeshData mesh;
+  auto const n_vertices = positions.size() / 3;
+  mesh.vertices.resize(n_vertices);
+  for (std::size_t i = 0; i < n_vertices; ++i) {
+    auto &v = mesh.vertices[i];
+    v.pos = {positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]};
+    v.norm = normals.size() == positions.size()
+                 ? glm::vec3(normals[i * 3], normals[i * 3 + 1],
+                             normals[i * 3 + 2])
+                 : glm::vec3(0.f);
+    v.tex = texcoords.size() == n_vertices * 2
+                ? glm::vec2(texcoords[i * 2], texcoords[i * 2 + 1])
+                : glm::vec2(0.f);
+  }
+
+  if (auto const *indices = primitive.find("indices")) {
+    auto const index = indices->as_size();
+    if (!index || !read_indices(doc, *index, mesh.indices))
+      return std::nullopt;
+  } else {
+    mesh.indices.resize(n_vertices);
+    for (std::size_t i = 0; i < n_vertices; ++i)
+      mesh.indices[i] = i;
+  }
+  for (auto const i : mesh.indices) {
+    if (i >= n_vertices)
+      return std::nullopt;
+  }
+  mesh.indices.resize(mesh.indices.size() / 3 * 3);
+  return mesh;
+}
+
+// Decodes every triangle primitive of every mesh in parallel and appends
+// them into one mesh. Node transforms are not applied.
+std::optional<MeshData> decode_gltf(GltfDocument const &doc,
+                                    unsigned n_threads) {
+  REN_ZONE("decode_gltf");
+  std::vector<Json const *> primitives;
+  if (auto const *meshes = doc.json.find("meshes")) {
+    for (auto const &mesh : meshes->array) {
+      if (auto const *p = mesh.find("primitives")) {
+        for (auto const &primitive : p->array)
+          primitives.push_back(&primitive);
+      }
+    }
+  }
+
+  std::vector<std::optional<MeshData>> decoded(primitives.size());
+  parallel_for(
+      primitives.size(),
+      [&](std::size_t begin, std::size_t end, unsigned) {
+        for (auto i = begin; i < end; ++i)
+          decoded[i] = decode_primitive(doc, *primitives[i]);
+      },
+      n_threads);
+
+  MeshData mesh;
+  for (auto &part : decoded) {
+    if (!part)
+      return std::nullopt;
+    auto const base = static_cast<GLuint>(mesh.vertices.size());
+    mesh.vertices.insert(mesh.vertices.end(), part->vertices.begin(),
+                         part->vertices.end());
+    for (auto const i : part->indices)
+      mesh.indices.push_back(base + i);
+  }
+  fill_missing_normals(mesh);
+  return mesh;
+}
+
+} // namespace
+
+MeshImporter::MeshImporter(std::filesystem::path cache_dir, unsigned n_threads)
+    : m_cache_dir(std::move(cache_dir)),
+      m_n_threads(n_threads == 0 ? default_thread_count() : n_threads) {}
+
+std::optional<MeshData>
+MeshImporter::load(std::filesystem::path const &path) const {
+  REN_ZONE("MeshImporter::load");
+  auto bytes = read_file(path);
+  if (!bytes) {
+    Log::the().add_log("MeshImporter: can't read %s\n", path.c_str());
+    return std::nullopt;
+  }
+
+  auto const ext = path.extension().string();
+  bool const is_obj = ext == ".obj" || ext == ".OBJ";
+  std::optional<GltfDocument> gltf;
+  auto hash = content_hash({bytes->data(), bytes->size()}, is_obj ? 1 : 2);
+  if (!is_obj) {
+    gltf = resolve_gltf(path, *bytes);
+    if (!gltf) {
+      Log::the().add_log("MeshImporter: %s is not a valid glTF file\n",
+                         path.c_str());
+      return std::nullopt;
+    }
+    for (auto const &buffer : gltf->buffers)
+      hash = content_hash({buffer.data(), buffer.size()}, hash);
+  }
+
+  if (auto cached = read_cache(hash))
+    return cached;
+
+  auto mesh = is_obj ? parse_obj({bytes->data(), bytes->size()})
+                     : decode_gltf(*gltf, m_n_threads);
+  if (!mesh) {
+    Log::the().add_log("MeshImporter: failed to parse %s\n", path.c_str());
+    return std::nullopt;
+  }
+  auto const acmr_before = average_cache_miss_ratio(mesh->indices,
+                                                    mesh->vertices.size());
+  optimize_mesh(mesh->vertices, mesh->indices);
+  Log::the().add_log(
+      "MeshImporter: %s -> %zu vertices, %zu indices, ACMR %.2f -> %.2f\n",
+      path.c_str(), mesh->vertices.size(), mesh->indices.size(), acmr_before,
+      average_cache_miss_ratio(mesh->indices, mesh->vertices.size()));
+  write_cache(hash, *mesh);
+  return mesh;
+}
+
+std::optional<MeshData> MeshImporter::parse_obj(std::string_view text) const {
+  REN_ZONE("MeshImporter::parse_obj");
+  // split at line boundaries, one chunk per thread
+  auto const *text_end = text.data() + text.size();
+  std::vector<char const *> bounds{text.data()};
+  auto const chunk_size = text.size() / m_n_threads + 1;
+  for (unsigned i = 1; i < m_n_threads; ++i) {
+    auto const *p = std::max(bounds.back(), text.data() + i * chunk_size);
+    if (p >= text_end)
+      break;
+    auto const *nl =
+        static_cast<char const *>(std::memchr(p, '\n', text_end - p));
+    if (!nl)
+      break;
+    bounds.push_back(nl + 1);
+  }
+  bounds.push_back(text_end);
+  auto const n_chunks = bounds.size() - 1;
+
+  std::vector<ObjChunk> chunks(n_chunks);
+  parallel_for(
+      n_chunks,
+      [&](std::size_t begin, std::size_t end, unsigned) {
+        for (auto i = begin; i < end; ++i)
+          parse_obj_chunk(bounds[i], bounds[i + 1], chunks[i]);
+      },
+      m_n_threads);
+
+  // element counts of the preceding chunks turn relative indices global
+  std::vector<std::array<int, 3>> base(n_chunks);
+  std::array<int, 3> total{0, 0, 0};
+  for (std::size_t i = 0; i < n_chunks; ++i) {
+    if (!chunks[i].ok)
+      return std::nullopt;
+    base[i] = total;
+    total[0] += chunks[i].positions.size();
+    total[1] += chunks[i].texcoords.size();
+    total[2] += chunks[i].normals.size();
+  }
+
+  std::vector<glm::vec3> positions, normals;
+  std::vector<glm::vec2> texcoords;
+  positions.reserve(total[0]);
+  texcoords.reserve(total[1]);
+  normals.reserve(total[2]);
+  for (auto const &c : chunks) {
+    positions.insert(positions.end(), c.positions.begin(), c.positions.end());
+    texcoords.insert(texcoords.end(), c.texcoords.begin(), c.texcoords.end());
+    normals.insert(normals.end(), c.normals.begin(), c.normals.end());
+  }
+
+  // resolve and dedup corners per chunk
+  std::vector<char> valid(n_chunks, 1);
+  parallel_for(
+      n_chunks,
+      [&](std::size_t begin, std::size_t end, unsigned) {
+        for (auto i = begin; i < end; ++i) {
+          auto &chunk = chunks[i];
+          std::unordered_map<ObjKey, GLuint, ObjKeyHash> lookup;
+          lookup.reserve(chunk.corners.size() / 2);
+          chunk.local_indices.reserve(chunk.corners.size());
+          for (auto const &c : chunk.corners) {
+            int key_fields[3] = {c.v, c.vt, c.vn};
+            bool corner_valid = (c.present & 1) != 0;
+            for (int f = 0; f < 3; ++f) {
+              if (!(c.present & (1u << f))) {
+                key_fields[f] = -1;
+                continue;
+              }
+              if (c.relative & (1u << f))
+                key_fields[f] += base[i][f];
+              corner_valid &= key_fields[f] >= 0 && key_fields[f] < total[f];
+            }
+            if (!corner_valid) {
+              valid[i] = 0;
+              break;
+            }
+            ObjKey const key{key_fields[0], key_fields[1], key_fields[2]};
+            auto [it, inserted] = lookup.try_emplace(
+                key, static_cast<GLuint>(chunk.unique.size()));
+            if (inserted)
+              chunk.unique.push_back(key);
+            chunk.local_indices.push_back(it->second);
+          }
+          chunk.corners = {};
+        }
+      },
+      m_n_threads);
+
+  // merge the per chunk vertex sets; only unique corners go through the map
+  MeshData mesh;
+  std::unordered_map<ObjKey, GLuint, ObjKeyHash> lookup;
+  std::vector<std::vector<GLuint>> remap(n_chunks);
+  for (std::size_t i = 0; i < n_chunks; ++i) {
+    if (!valid[i])
+      return std::nullopt;
+    remap[i].reserve(chunks[i].unique.size());
+    for (auto const &key : chunks[i].unique) {
+      auto [it, inserted] = lookup.try_emplace(
+          key, static_cast<GLuint>(mesh.vertices.size()));
+      if (inserted) {
+        Vertex v{};
+        v.pos = positions[key.v];
+        v.norm = key.vn >= 0 ? normals[key.vn] : glm::vec3(0.f);
+        v.tex = key.vt >= 0 ? texcoords[key.vt] : glm::vec2(0.f);
+        mesh.vertices.push_back(v);
+      }
+      remap[i].push_back(it->second);
+    }
+  }
+
+  std::vector<std::size_t> index_base(n_chunks + 1, 0);
+  for (std::size_t i = 0; i < n_chunks; ++i)
+    index_base[i + 1] = index_base[i] + chunks[i].local_indices.size();
+  mesh.indices.resize(index_base.back());
+  parallel_for(
+      n_chunks,
+      [&](std::size_t begin, std::size_t end, unsigned) {
+        for (auto i = begin; i < end; ++i) {
+          auto *out = mesh.indices.data() + index_base[i];
+          for (auto const local : chunks[i].local_indices)
+            *out++ = remap[i][local];
+        }
+      },
+      m_n_threads);
+
+  fill_missing_normals(mesh);
+  return mesh;
+}
+
+std::uint64_t MeshImporter::content_hash(std::string_view bytes,
+                                         std::uint64_t seed) const {
+  auto const n_blocks = (bytes.size() + hash_block_size - 1) / hash_block_size;
+  std::vector<std::uint64_t> block_hashes(n_blocks);
+  parallel_for(
+      n_blocks,
+      [&](std::size_t begin, std::size_t end, unsigned) {
+        for (auto i = begin; i < end; ++i) {
+          auto const offset = i * hash_block_size;
+          auto const size = std::min(hash_block_size, bytes.size() - offset);
+          block_hashes[i] = fnv1a(bytes.data() + offset, size);
+        }
+      },
+      m_n_threads);
+
+  auto const size = static_cast<std::uint64_t>(bytes.size());
+  auto h = fnv1a(&seed, sizeof(seed));
+  h = fnv1a(&size, sizeof(size), h);
+  return fnv1a(block_hashes.data(), block_hashes.size() * sizeof(std::uint64_t),
+               h);
+}
+
+std::filesystem::path MeshImporter::cache_path(std::uint64_t hash) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.zrm",
+                static_cast<unsigned long long>(hash));
+  return m_cache_dir / name;
+}
+
+std::optional<MeshData> MeshImporter::read_cache(std::uint64_t hash) const {
+  REN_ZONE("MeshImporter::read_cache");
+  if (m_cache_dir.empty())
+    return std::nullopt;
+  std::ifstream file(cache_path(hash), std::ios::binary);
+  if (!file.is_open())
+    return std::nullopt;
+
+  CacheHeader header{};
+  file.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!file || std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) ||
+      header.version != cache_version || header.vertex_size != sizeof(Vertex) ||
+      header.content_hash != hash)
+    return std::nullopt;
+
+  MeshData mesh;
+  mesh.vertices.resize(header.n_vertices);
+  mesh.indices.resize(header.n_indices);
+  file.read(reinterpret_cast<char *>(mesh.vertices.data()),
+            mesh.vertices.size() * sizeof(Vertex));
+  file.read(reinterpret_cast<char *>(mesh.indices.data()),
+            mesh.indices.size() * sizeof(GLuint));
+  if (!file)
+    return std::nullopt;
+  return mesh;
+}
+
+void MeshImporter::write_cache(std::uint64_t hash, MeshData const &mesh) const {
+  REN_ZONE("MeshImporter::write_cache");
+  if (m_cache_dir.empty())
+    return;
+  std::error_code ec;
+  std::filesystem::create_directories(m_cache_dir, ec);
+
+  CacheHeader header{};
+  std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+  header.version = cache_version;
+  header.vertex_size = sizeof(Vertex);
+  header.content_hash = hash;
+  header.n_vertices = mesh.vertices.size();
+  header.n_indices = mesh.indices.size();
+
+  // write next to the final name and rename so readers never see a partial
+  // file
+  auto const path = cache_path(hash);
+  auto tmp = path;
+  tmp += ".tmp";
+  {
+    std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    file.write(reinterpret_cast<char const *>(mesh.vertices.data()),
+               mesh.vertices.size() * sizeof(Vertex));
+    file.write(reinterpret_cast<char const *>(mesh.indices.data()),
+               mesh.indices.size() * sizeof(GLuint));
+    if (!file)
+      return;
+  }
+  std::filesystem::rename(tmp, path, ec);
+}
+
+} // namespace ren
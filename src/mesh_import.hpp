@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "mesh.hpp"
+
+namespace ren {
+
+struct MeshData {
+  std::vector<Vertex> vertices;
+  std::vector<GLuint> indices;
+};
+
+// Imports OBJ, glTF (.gltf with external or data: buffers) and binary .glb
+// files into indexed triangle lists ready for Mesh::construct(). Parsing is
+// split across threads, the result is reordered by optimize_mesh() and stored
+// in a cache keyed by a hash of the source contents, so a second import of the
+// same data is a single read.
+class MeshImporter final {
+public:
+  // an empty cache directory disables the cache, 0 threads means one per core
+  MeshImporter(std::filesystem::path cache_dir = {}, unsigned n_threads = 0);
+
+  std::optional<MeshData> load(std::filesystem::path const &path) const;
+
+  std::optional<MeshData> parse_obj(std::string_view text) const;
+
+private:
+  std::uint64_t content_hash(std::string_view bytes,
+                             std::uint64_t seed = 0) const;
+  std::filesystem::path cache_path(std::uint64_t hash) const;
+  std::optional<MeshData> read_cache(std::uint64_t hash) const;
+  void write_cache(std::uint64_t hash, MeshData const &mesh) const;
+
+  std::filesystem::path m_cache_dir;
+  unsigned m_n_threads;
+};
+
+} // namespace ren
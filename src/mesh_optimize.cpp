@@ -0,0 +1,367 @@
+#include "mesh_optimize.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#include "zone_profiler.hpp"
+
+namespace ren {
+
+namespace {
+
+// parameters from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+constexpr int forsyth_cache_size = 32;
+constexpr float cache_decay_power = 1.5f;
+constexpr float last_tri_score = 0.75f;
+constexpr float valence_boost_scale = 2.0f;
+constexpr float valence_boost_power = 0.5f;
+constexpr int max_valence = 32;
+
+// largest finite half float
+constexpr float max_half = 65504.f;
+
+struct ScoreTable {
+  float cache[forsyth_cache_size];
+  float valence[max_valence + 1];
+
+  ScoreTable() {
+    for (int i = 0; i < forsyth_cache_size; ++i) {
+      if (i < 3) {
+        cache[i] = last_tri_score;
+      } else {
+        auto const s = 1.f - static_cast<float>(i - 3) /
+                                 static_cast<float>(forsyth_cache_size - 3);
+        cache[i] = std::pow(s, cache_decay_power);
+      }
+    }
+    valence[0] = 0.f;
+    for (int i = 1; i <= max_valence; ++i)
+      valence[i] = valence_boost_scale *
+                   std::pow(static_cast<float>(i), -valence_boost_power);
+  }
+
+  float score(int cache_pos, std::uint32_t remaining) const {
+    if (remaining == 0)
+      return -1.f;
+    auto s = valence[std::min<std::uint32_t>(remaining, max_valence)];
+    if (cache_pos >= 0)
+      s += cache[cache_pos];
+    return s;
+  }
+};
+
+} // namespace
+
+void optimize_vertex_cache(std::vector<GLuint> &indices,
+                           std::size_t n_vertices) {
+  static ScoreTable const table;
+
+  auto const n_tris = indices.size() / 3;
+  if (n_tris == 0)
+    return;
+
+  // triangles per vertex, the live ones are kept at the front of each range
+  std::vector<std::uint32_t> remaining(n_vertices, 0);
+  for (auto const i : indices)
+    ++remaining[i];
+  std::vector<std::uint32_t> offsets(n_vertices + 1, 0);
+  std::partial_sum(remaining.begin(), remaining.end(), offsets.begin() + 1);
+  std::vector<std::uint32_t> vertex_tris(indices.size());
+  {
+    auto fill = offsets;
+    for (std::size_t t = 0; t < n_tris; ++t)
+      for (int k = 0; k < 3; ++k)
+        vertex_tris[fill[indices[t * 3 + k]]++] = t;
+  }
+
+  std::vector<int> cache_pos(n_vertices, -1);
+  std::vector<float> vertex_score(n_vertices);
+  for (std::size_t v = 0; v < n_vertices; ++v)
+    vertex_score[v] = table.score(-1, remaining[v]);
+
+  std::vector<float> tri_score(n_tris);
+  for (std::size_t t = 0; t < n_tris; ++t)
+    tri_score[t] = vertex_score[indices[t * 3]] +
+                   vertex_score[indices[t * 3 + 1]] +
+                   vertex_score[indices[t * 3 + 2]];
+
+  std::vector<bool> emitted(n_tris, false);
+  std::vector<GLuint> out;
+  out.reserve(indices.size());
+
+  std::vector<GLuint> cache, next_cache;
+  cache.reserve(forsyth_cache_size + 3);
+  next_cache.reserve(forsyth_cache_size + 3);
+
+  std::size_t cursor = 0;
+  auto best = static_cast<std::size_t>(std::max_element(tri_score.begin(),
+                                                        tri_score.end()) -
+                                       tri_score.begin());
+  while (out.size() < indices.size()) {
+    if (best == n_tris) {
+      // nothing in the cache is usable, continue with the next unused one
+      while (emitted[cursor])
+        ++cursor;
+      best = cursor;
+    }
+
+    emitted[best] = true;
+    GLuint const *tri = &indices[best * 3];
+    out.insert(out.end(), tri, tri + 3);
+
+    next_cache.assign(tri, tri + 3);
+    for (int k = 0; k < 3; ++k) {
+      auto const v = tri[k];
+      auto const begin = vertex_tris.begin() + offsets[v];
+      auto const end = begin + remaining[v];
+      std::iter_swap(std::find(begin, end, best), end - 1);
+      --remaining[v];
+    }
+    for (auto const v : cache)
+      if (v != tri[0] && v != tri[1] && v != tri[2])
+        next_cache.push_back(v);
+    std::swap(cache, next_cache);
+
+    for (std::size_t i = 0; i < cache.size(); ++i) {
+      auto const v = cache[i];
+      auto const pos =
+          i < static_cast<std::size_t>(forsyth_cache_size) ? int(i) : -1;
+      cache_pos[v] = pos;
+      vertex_score[v] = table.score(pos, remaining[v]);
+    }
+    if (cache.size() > static_cast<std::size_t>(forsyth_cache_size))
+      cache.resize(forsyth_cache_size);
+
+    // only triangles touching the cache changed their score
+    best = n_tris;
+    auto best_score = -1.f;
+    for (auto const v : cache) {
+      auto const begin = vertex_tris.begin() + offsets[v];
+      for (auto it = begin; it != begin + remaining[v]; ++it) {
+        auto const t = *it;
+        auto const s = vertex_score[indices[t * 3]] +
+                       vertex_score[indices[t * 3 + 1]] +
+                       vertex_score[indices[t * 3 + 2]];
+        tri_score[t] = s;
+        if (s > best_score) {
+          best_score = s;
+          best = t;
+        }
+      }
+    }
+  }
+
+  indices = std::move(out);
+}
+
+float average_cache_miss_ratio(std::vector<GLuint> const &indices,
+                               std::size_t n_vertices,
+                               std::size_t cache_size) {
+  auto const n_tris = indices.size() / 3;
+  if (n_tris == 0)
+    return 0.f;
+
+  // FIFO cache: a vertex hits while fewer than cache_size misses happened
+  // since it was inserted
+  std::vector<std::size_t> inserted(n_vertices, 0);
+  std::size_t time = cache_size + 1;
+  std::size_t misses = 0;
+  for (auto const i : indices) {
+    if (time - inserted[i] > cache_size) {
+      inserted[i] = time++;
+      ++misses;
+    }
+  }
+  return static_cast<float>(misses) / static_cast<float>(n_tris);
+}
+
+void optimize_overdraw(std::vector<GLuint> &indices,
+                       std::vector<Vertex> const &vertices, float threshold) {
+  constexpr std::size_t cache_size = 16;
+
+  auto const n_tris = indices.size() / 3;
+  if (n_tris < 2)
+    return;
+
+  // misses of each triangle under the current order
+  std::vector<std::uint8_t> tri_misses(n_tris, 0);
+  {
+    std::vector<std::size_t> inserted(vertices.size(), 0);
+    std::size_t time = cache_size + 1;
+    for (std::size_t t = 0; t < n_tris; ++t) {
+      for (int k = 0; k < 3; ++k) {
+        auto const v = indices[t * 3 + k];
+        if (time - inserted[v] > cache_size) {
+          inserted[v] = time++;
+          ++tri_misses[t];
+        }
+      }
+    }
+  }
+  auto const total_misses = std::accumulate(
+      tri_misses.begin(), tri_misses.end(), std::size_t{0});
+  auto const acmr =
+      static_cast<float>(total_misses) / static_cast<float>(n_tris);
+
+  // a triangle missing all three vertices starts a cluster for free, one
+  // missing two does if the cluster can absorb the extra miss within the
+  // threshold
+  std::vector<std::size_t> clusters{0};
+  std::size_t cluster_misses = 0;
+  for (std::size_t t = 1; t < n_tris; ++t) {
+    auto const cluster_tris = t - clusters.back();
+    bool const hard = tri_misses[t] == 3;
+    bool const soft =
+        tri_misses[t] == 2 &&
+        static_cast<float>(cluster_misses + 1) /
+                static_cast<float>(cluster_tris) <=
+            acmr * threshold;
+    if (hard || soft) {
+      clusters.push_back(t);
+      cluster_misses = 0;
+    }
+    cluster_misses += tri_misses[t];
+  }
+  if (clusters.size() < 2)
+    return;
+  clusters.push_back(n_tris);
+
+  glm::vec3 mesh_center(0.f);
+  for (auto const &v : vertices)
+    mesh_center += v.pos;
+  mesh_center /= static_cast<float>(vertices.size());
+
+  // area weighted centroid and normal per cluster
+  auto const n_clusters = clusters.size() - 1;
+  std::vector<float> sort_key(n_clusters);
+  for (std::size_t c = 0; c < n_clusters; ++c) {
+    glm::vec3 centroid(0.f), normal(0.f);
+    float area = 0.f;
+    for (auto t = clusters[c]; t < clusters[c + 1]; ++t) {
+      auto const &a = vertices[indices[t * 3]].pos;
+      auto const &b = vertices[indices[t * 3 + 1]].pos;
+      auto const &d = vertices[indices[t * 3 + 2]].pos;
+      auto const n = glm::cross(b - a, d - a);
+      auto const tri_area = glm::length(n);
+      centroid += (a + b + d) * (tri_area / 3.f);
+      normal += n;
+      area += tri_area;
+    }
+    if (area > 0.f)
+      centroid /= area;
+    auto const normal_length = glm::length(normal);
+    sort_key[c] =
+        normal_length > 0.f
+            ? glm::dot(centroid - mesh_center, normal / normal_length)
+            : 0.f;
+  }
+
+  std::vector<std::size_t> order(n_clusters);
+  std::iota(order.begin(), order.end(), std::size_t{0});
+  std::stable_sort(order.begin(), order.end(),
+                   [&](auto a, auto b) { return sort_key[a] > sort_key[b]; });
+
+  std::vector<GLuint> out;
+  out.reserve(indices.size());
+  for (auto const c : order)
+    out.insert(out.end(), indices.begin() + clusters[c] * 3,
+               indices.begin() + clusters[c + 1] * 3);
+  indices = std::move(out);
+}
+
+void optimize_vertex_fetch(std::vector<Vertex> &vertices,
+                           std::vector<GLuint> &indices) {
+  constexpr auto unused = static_cast<GLuint>(-1);
+  std::vector<GLuint> remap(vertices.size(), unused);
+  std::vector<Vertex> out;
+  out.reserve(vertices.size());
+  for (auto &i : indices) {
+    if (remap[i] == unused) {
+      remap[i] = static_cast<GLuint>(out.size());
+      out.push_back(vertices[i]);
+    }
+    i = remap[i];
+  }
+  vertices = std::move(out);
+}
+
+void optimize_mesh(std::vector<Vertex> &vertices,
+                   std::vector<GLuint> &indices) {
+  REN_ZONE("optimize_mesh");
+  optimize_vertex_cache(indices, vertices.size());
+  optimize_overdraw(indices, vertices);
+  optimize_vertex_fetch(vertices, indices);
+}
+
+std::uint16_t float_to_half(float f) {
+  std::uint32_t x;
+  std::memcpy(&x, &f, sizeof(x));
+
+  std::uint16_t const sign = (x >> 16) & 0x8000;
+  std::uint32_t const abs = x & 0x7FFFFFFF;
+  if (abs > 0x7F800000)
+    return sign | 0x7E00; // nan
+  int const exponent = static_cast<int>(abs >> 23) - 127 + 15;
+  std::uint32_t mantissa = abs & 0x7FFFFF;
+  if (exponent >= 31)
+    return sign | 0x7C00; // overflow to infinity
+  if (exponent <= 0) {
+    if (exponent < -10)
+      return sign;
+    // subnormal half
+    mantissa |= 0x800000;
+    auto const shift = static_cast<std::uint32_t>(14 - exponent);
+    auto half = static_cast<std::uint16_t>(mantissa >> shift);
+    if ((mantissa >> (shift - 1)) & 1)
+      ++half;
+    return sign | half;
+  }
+  auto half = static_cast<std::uint16_t>(sign | (exponent << 10) |
+                                         (mantissa >> 13));
+  if (mantissa & 0x1000)
+    ++half; // a carry into the exponent is still the correctly rounded value
+  return half;
+}
+
+bool can_compact(std::vector<Vertex> const &vertices) {
+  return std::all_of(vertices.begin(), vertices.end(), [](auto const &v) {
+    for (int i = 0; i < 3; ++i)
+      if (!(std::abs(v.pos[i]) <= max_half))
+        return false;
+    for (int i = 0; i < 2; ++i)
+      if (!(v.tex[i] >= 0.f && v.tex[i] <= 1.f))
+        return false;
+    return true;
+  });
+}
+
+std::vector<CompactVertex>
+compact_vertices(std::vector<Vertex> const &vertices) {
+  auto const snorm10 = [](float f) {
+    auto const q = static_cast<std::int32_t>(
+        std::round(std::clamp(f, -1.f, 1.f) * 511.f));
+    return static_cast<std::uint32_t>(q) & 0x3FF;
+  };
+  auto const unorm16 = [](float f) {
+    return static_cast<std::uint16_t>(
+        std::round(std::clamp(f, 0.f, 1.f) * 65535.f));
+  };
+
+  std::vector<CompactVertex> out(vertices.size());
+  for (std::size_t i = 0; i < vertices.size(); ++i) {
+    auto const &v = vertices[i];
+    auto &c = out[i];
+    for (int k = 0; k < 3; ++k)
+      c.pos[k] = float_to_half(v.pos[k]);
+    c.pad = 0;
+    auto const n = glm::length(v.norm) > 0.f ? glm::normalize(v.norm) : v.norm;
+    c.norm = snorm10(n.x) | snorm10(n.y) << 10 | snorm10(n.z) << 20;
+    c.tex[0] = unorm16(v.tex.x);
+    c.tex[1] = unorm16(v.tex.y);
+  }
+  return out;
+}
+
+} // namespace ren
@@ -0,0 +1,134 @@
+#include "mesh_registry.hpp"
+
+#include <cstring>
+
+namespace ren {
+
+MeshRegistry &MeshRegistry::the() {
+  static MeshRegistry registry;
+  return registry;
+}
+
+// FNV-1a over the raw bytes, matches() does the full compare
+std::uint64_t MeshRegistry::hash(Key const &key) {
+  std::uint64_t h = 14695981039346656037ull;
+  auto const add = [&h](void const *data, std::size_t size) {
+    auto const *bytes = static_cast<unsigned char const *>(data);
+    for (std::size_t i = 0; i < size; ++i) {
+      h ^= bytes[i];
+      h *= 1099511628211ull;
+    }
+  };
+  add(key.vertices, key.n_vertices * sizeof(Vertex));
+  add(key.indices, key.n_indices * sizeof(GLuint));
+  auto const kind = static_cast<unsigned char>(key.kind);
+  auto const format = static_cast<unsigned char>(key.format);
+  add(&kind, 1);
+  add(&format, 1);
+  return h;
+}
+
+bool MeshRegistry::matches(Mesh const &mesh, Key const &key) {
+  // released meshes can't be compared, they are simply not shared
+  if (!mesh.has_cpu_data() || mesh.n_vertices() != key.n_vertices)
+    return false;
+  if (mesh.has_adjacencies() != (key.kind != Kind::triangles))
+    return false;
+  if (std::memcmp(mesh.vertices().data(), key.vertices,
+                  key.n_vertices * sizeof(Vertex)) != 0)
+    return false;
+
+  auto const &indices = mesh.indices();
+  if (key.kind != Kind::generated_adjacencies)
+    return indices.size() == key.n_indices &&
+           std::memcmp(indices.data(), key.indices,
+                       key.n_indices * sizeof(GLuint)) == 0;
+
+  // the triangle corners sit at the even positions of the adjacency indices
+  if (indices.size() != key.n_indices * 2)
+    return false;
+  for (std::size_t i = 0; i < key.n_indices; ++i)
+    if (indices[i * 2] != key.indices[i])
+      return false;
+  return true;
+}
+
+std::shared_ptr<Mesh> MeshRegistry::find(Key const &key, std::uint64_t h) {
+  auto [it, end] = m_meshes.equal_range(h);
+  while (it != end) {
+    auto mesh = it->second.lock();
+    if (mesh == nullptr) {
+      it = m_meshes.erase(it);
+      continue;
+    }
+    if (matches(*mesh, key)) {
+      ++m_stats.hits;
+      return mesh;
+    }
+    ++it;
+  }
+  ++m_stats.misses;
+  return nullptr;
+}
+
+void MeshRegistry::add(std::uint64_t h, std::shared_ptr<Mesh> const &mesh) {
+  m_meshes.emplace(h, mesh);
+}
+
+std::shared_ptr<Mesh> MeshRegistry::get(std::vector<Vertex> vertices,
+                                        std::vector<GLuint> indices,
+                                        VertexFormat format) {
+  Key const key{vertices.data(), vertices.size(), indices.data(),
+                indices.size(), Kind::triangles, format};
+  auto const h = hash(key);
+  if (auto mesh = find(key, h))
+    return mesh;
+  std::shared_ptr<Mesh> mesh =
+      Mesh::construct(std::move(vertices), std::move(indices), false, format);
+  add(h, mesh);
+  return mesh;
+}
+
+std::shared_ptr<Mesh>
+MeshRegistry::get_with_adjacencies(std::vector<Vertex> vertices,
+                                   std::vector<GLuint> indices,
+                                   VertexFormat format) {
+  Key const key{vertices.data(), vertices.size(), indices.data(),
+                indices.size(), Kind::generated_adjacencies, format};
+  auto const h = hash(key);
+  if (auto mesh = find(key, h))
+    return mesh;
+  std::shared_ptr<Mesh> mesh = Mesh::construct_with_adjacencies(
+      std::move(vertices), std::move(indices), format);
+  add(h, mesh);
+  return mesh;
+}
+
+std::shared_ptr<Mesh> MeshRegistry::get(Vertex const *vertices,
+                                        std::size_t n_vertices,
+                                        GLuint const *indices,
+                                        std::size_t n_indices,
+                                        bool has_adjacencies) {
+  Key const key{vertices,
+                n_vertices,
+                indices,
+                n_indices,
+                has_adjacencies ? Kind::adjacencies : Kind::triangles,
+                VertexFormat::full};
+  auto const h = hash(key);
+  if (auto mesh = find(key, h))
+    return mesh;
+  std::shared_ptr<Mesh> mesh = Mesh::construct(vertices, n_vertices, indices,
+                                               n_indices, has_adjacencies);
+  add(h, mesh);
+  return mesh;
+}
+
+std::size_t MeshRegistry::size() const {
+  std::size_t n = 0;
+  for (auto const &[h, mesh] : m_meshes)
+    n += !mesh.expired();
+  return n;
+}
+
+} // namespace ren
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh.hpp"
+
+namespace ren {
+
+// Deduplicates meshes by content. Identical geometry handed to get() comes
+// back as the same Mesh, so objects share one set of buffers and can be
+// drawn instanced. Only weak references are kept, a mesh is freed with the
+// last object using it. Meshes are GL objects, so this is main thread only.
+class MeshRegistry {
+public:
+  static MeshRegistry &the();
+
+  // `indices` is a plain triangle list
+  std::shared_ptr<Mesh> get(std::vector<Vertex> vertices,
+                            std::vector<GLuint> indices,
+                            VertexFormat format = VertexFormat::full);
+  // `indices` is a plain triangle list, the adjacency is only generated
+  // when no identical mesh is alive
+  std::shared_ptr<Mesh> get_with_adjacencies(
+      std::vector<Vertex> vertices, std::vector<GLuint> indices,
+      VertexFormat format = VertexFormat::full);
+  // copies from caller owned memory, `indices` are used as they are
+  std::shared_ptr<Mesh> get(Vertex const *vertices, std::size_t n_vertices,
+                            GLuint const *indices, std::size_t n_indices,
+                            bool has_adjacencies);
+
+  struct Stats {
+    std::size_t hits{0};
+    std::size_t misses{0};
+  };
+  auto const &stats() const { return m_stats; }
+  std::size_t size() const;
+
+private:
+  enum class Kind : std::uint8_t {
+    triangles,
+    generated_adjacencies, // compared against every other adjacency index
+    adjacencies,
+  };
+
+  struct Key {
+    Vertex const *vertices;
+    std::size_t n_vertices;
+    GLuint const *indices;
+    std::size_t n_indices;
+    Kind kind;
+    VertexFormat format;
+  };
+
+  static std::uint64_t hash(Key const &key);
+  static bool matches(Mesh const &mesh, Key const &key);
+  std::shared_ptr<Mesh> find(Key const &key, std::uint64_t h);
+  void add(std::uint64_t h, std::shared_ptr<Mesh> const &mesh);
+
+  std::unordered_multimap<std::uint64_t, std::weak_ptr<Mesh>> m_meshes;
+  Stats m_stats;
+};
+
+} // namespace ren
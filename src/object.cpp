@@ -1,5 +1,7 @@
 #include "object.hpp"
 
+#include "mesh_registry.hpp"
+
 // TODO: move objects to separate .cpp files
 namespace ren {
   
@@ -81,6 +83,55 @@ bool sphere_hit(Object const &obj, ray const &r, float t_min, float t_max,
   return false;
 }
 
+bool plane_occluded(Object const &obj, ray const &r, float t_min,
+                    float t_max) {
+  auto const t = obj.translation();
+  auto const s = obj.scale();
+  auto const x_extent = s.x + t.x;
+  auto const z_extent = s.x + t.z;
+
+  auto const hit_t = (t.y - r.origin().y) / r.direction().y;
+  if (!(hit_t >= t_min && hit_t <= t_max))
+    return false;
+  auto const x = r.origin().x + hit_t * r.direction().x;
+  auto const z = r.origin().z + hit_t * r.direction().z;
+  return x >= -x_extent && x <= x_extent && z >= -z_extent && z <= z_extent;
+}
+
+bool sphere_occluded(Object const &obj, ray const &r, float t_min,
+                     float t_max) {
+  auto center = obj.translation();
+  auto radius = obj.scale().x;
+  vec3 oc = r.origin() - center;
+  auto a = glm::length2(r.direction());
+  auto half_b = dot(oc, r.direction());
+  auto c = glm::length2(oc) - radius * radius;
+  auto discriminant = half_b * half_b - a * c;
+  if (discriminant <= 0)
+    return false;
+  auto root = sqrt(discriminant);
+  auto temp = (-half_b - root) / a;
+  if (temp < t_max && temp > t_min)
+    return true;
+  temp = (-half_b + root) / a;
+  return temp < t_max && temp > t_min;
+}
+
+void assign_hit_functions(Object &obj) {
+  switch (obj.type()) {
+  case Object::Type::sphere:
+    obj.set_hit_function(sphere_hit);
+    obj.set_occlusion_function(sphere_occluded);
+    break;
+  case Object::Type::plane:
+    obj.set_hit_function(plane_hit);
+    obj.set_occlusion_function(plane_occluded);
+    break;
+  case Object::Type::custom:
+    break;
+  }
+}
+
 Object create_sphere() {
   // clang-format off
   std::vector<Vertex> verts {
@@ -145,9 +196,9 @@ Object create_sphere() {
     Vertex{vec3(0.276385,0.447215,-0.850640),vec3(0.491100,0.794700,-0.356800),vec2(0.545455,0.685079)},
     Vertex{vec3(0.000000,1.000000,0.000000),vec3(0.491100,0.794700,-0.356800),vec2(0.454546,0.527618)},
 };
-std::vector<GLuint> indices {0,2,1,0,2,1,3,5,4,3,5,4,6,8,7,6,8,7,9,11,10,9,11,10,12,14,13,12,14,13,15,17,16,15,17,16,18,20,19,18,20,19,21,23,22,21,23,22,24,26,25,24,26,25,27,29,28,27,29,28,30,32,31,30,32,31,33,35,34,33,35,34,36,38,37,36,38,37,39,41,40,39,41,40,42,44,43,42,44,43,45,47,46,45,47,46,48,50,49,48,50,49,51,53,52,51,53,52,54,56,55,54,56,55,57,59,58,57,59,58,};
+std::vector<GLuint> indices {0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40,41,42,43,44,45,46,47,48,49,50,51,52,53,54,55,56,57,58,59,};
 // clang-format off
-  auto obj = Object(verts, indices, true);
+  auto obj = Object(MeshRegistry::the().get_with_adjacencies(verts, indices));
   obj.set_type(Object::Type::sphere);
   return obj;
 }
@@ -160,7 +211,7 @@ Object create_sphere(glm::vec3 cen, float r, std::shared_ptr<Material> mat) {
   obj.update_model();
 
   obj.set_material(mat);
-  obj.set_hit_function(sphere_hit);
+  assign_hit_functions(obj);
 
   return obj;
 }
@@ -185,9 +236,9 @@ std::vector<Vertex> verts {
     Vertex{vec3(1.000000,1.000000,-1.000000),vec3(0.333333,0.666667,-0.666667),vec2(2.792410,0.301900)},
     Vertex{vec3(-1.000000,1.000000,-1.000000),vec3(-0.816497,0.408248,-0.408248),vec2(2.094305,1.000000)},
 };
-std::vector<GLuint> indices_with_adj {0,7,1,6,2,3,0,1,2,5,3,4,4,3,5,2,6,7,4,5,6,1,7,0,0,3,4,6,7,1,0,4,7,6,1,2,1,0,7,4,6,2,1,7,6,5,2,0,2,1,6,4,5,3,2,6,5,4,3,0,4,7,0,2,3,5,4,0,3,2,5,6,};
+std::vector<GLuint> indices {0,1,2,0,2,3,4,5,6,4,6,7,0,4,7,0,7,1,1,7,6,1,6,2,2,6,5,2,5,3,4,0,3,4,3,5,};
 // clang-format off
-  return Object(verts, indices_with_adj, true);
+  return Object(MeshRegistry::the().get_with_adjacencies(verts, indices));
 }
 
 Object create_cube(glm::vec3 cen, float r, std::shared_ptr<Material> mat) {
@@ -199,6 +250,7 @@ Object create_cube(glm::vec3 cen, float r, std::shared_ptr<Material> mat) {
 
   cube.set_material(mat);
   cube.set_hit_function(sphere_hit);
+  cube.set_occlusion_function(sphere_occluded);
   
   return cube;
 }
@@ -359,9 +411,11 @@ std::vector<Vertex> verts {
     Vertex{vec3(1.000000,0.000000,-1.000000),vec3(-0.000000,1.000000,-0.000000),vec2(1.000000,0.000000)},
     Vertex{vec3(-1.000000,0.000000,-1.000000),vec3(-0.000000,1.000000,-0.000000),vec2(0.000000,0.000000)},
 };
-std::vector<GLuint> indices_with_adj {0,2,1,0,2,3,0,1,2,0,3,2,};
+std::vector<GLuint> indices {0,1,2,0,2,3,};
 // clang-format off
-	return Object(verts,indices_with_adj, true);
+  auto obj = Object(MeshRegistry::the().get_with_adjacencies(verts, indices));
+  obj.set_type(Object::Type::plane);
+  return obj;
 }
 
 Object create_plane(glm::vec3 cen, vec3 scale, std::shared_ptr<Material> mat) {
@@ -372,7 +426,7 @@ Object create_plane(glm::vec3 cen, vec3 scale, std::shared_ptr<Material> mat) {
   obj.update_model();
 
   obj.set_material(mat);
-  obj.set_hit_function(plane_hit);
+  assign_hit_functions(obj);
 
   return obj;
 }
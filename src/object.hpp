@@ -6,6 +6,9 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
 #include <functional>
 #include <iostream>
 #include <memory>
@@ -16,11 +19,37 @@
 #include "material.hpp"
 
 namespace ren {
+
+// rotate(degrees, axis) * translate(t) * scale(s), written out so the three
+// matrix products become a handful of multiplies
+inline glm::mat4 compose_model(glm::vec3 const &t, glm::vec3 const &s,
+                               glm::vec3 const &axis, float degrees) {
+  auto r0 = glm::vec3(1.f, 0.f, 0.f);
+  auto r1 = glm::vec3(0.f, 1.f, 0.f);
+  auto r2 = glm::vec3(0.f, 0.f, 1.f);
+  if (degrees != 0.f) {
+    auto const angle = glm::radians(degrees);
+    auto const c = std::cos(angle);
+    auto const sn = std::sin(angle);
+    auto const a = glm::normalize(axis);
+    auto const k = (1.f - c) * a;
+    r0 = glm::vec3(c + k.x * a.x, k.x * a.y + sn * a.z, k.x * a.z - sn * a.y);
+    r1 = glm::vec3(k.y * a.x - sn * a.z, c + k.y * a.y, k.y * a.z + sn * a.x);
+    r2 = glm::vec3(k.z * a.x + sn * a.y, k.z * a.y - sn * a.x, c + k.z * a.z);
+  }
+  return glm::mat4(glm::vec4(r0 * s.x, 0.f), glm::vec4(r1 * s.y, 0.f),
+                   glm::vec4(r2 * s.z, 0.f),
+                   glm::vec4(r0 * t.x + r1 * t.y + r2 * t.z, 1.f));
+}
+
 class Object {
 public:
   using hit_function =
       std::function<bool(Object const &obj, ray const &r, float t_min,
                          float t_max, hit_record &rec)>;
+  // any-hit test used for shadow rays, never writes hit data
+  using occlusion_function = std::function<bool(
+      Object const &obj, ray const &r, float t_min, float t_max)>;
 
   enum class Type {
     sphere,
@@ -30,22 +59,40 @@ public:
 
   Object() = default;
   Object(Object &&o) noexcept
-      : m_mesh(std::move(o.m_mesh)), m_material(o.m_material),
-        m_model(o.m_model), m_translation(o.m_translation), m_scale(o.m_scale),
-        m_type(o.m_type), m_hit(o.m_hit) {}
+      : m_hit(o.m_hit), m_occlusion(o.m_occlusion),
+        m_mesh(std::move(o.m_mesh)), m_material(o.m_material),
+        m_model(o.m_model), m_world_bounds(o.m_world_bounds),
+        m_translation(o.m_translation), m_scale(o.m_scale),
+        m_rotation_vector(o.m_rotation_vector),
+        m_rotation_scale(o.m_rotation_scale), m_type(o.m_type),
+        m_transform_dirty(o.m_transform_dirty), m_revision(o.m_revision) {}
   Object(Object &o) = delete;
   Object(std::vector<Vertex> vertices, std::vector<GLuint> indices, bool adjacency = false) {
     m_mesh = Mesh::construct(vertices, indices, adjacency);
+    update_bounds();
+  }
+  Object(std::vector<Vertex> vertices) {
+    m_mesh = Mesh::construct(vertices, false);
+    update_bounds();
+  }
+  // meshes may be shared between objects, see MeshRegistry
+  Object(std::shared_ptr<Mesh> mesh) : m_mesh(std::move(mesh)) {
+    update_bounds();
   }
-  Object(std::vector<Vertex> vertices) { m_mesh = Mesh::construct(vertices, false); }
   Object &operator=(Object &&o) {
     m_mesh = std::move(o.m_mesh);
     m_material = o.m_material;
     m_model = o.m_model;
+    m_world_bounds = o.m_world_bounds;
     m_translation = o.m_translation;
     m_scale = o.m_scale;
+    m_rotation_vector = o.m_rotation_vector;
+    m_rotation_scale = o.m_rotation_scale;
     m_type = o.m_type;
+    m_transform_dirty = o.m_transform_dirty;
     m_hit = o.m_hit;
+    m_occlusion = o.m_occlusion;
+    m_revision = o.m_revision;
 
     return *this;
   }
@@ -55,25 +102,58 @@ public:
     m_mesh->draw();
   }
   bool is_valid() const { return m_mesh != nullptr; }
+  auto const *mesh() const { return m_mesh.get(); }
+  auto const &shared_mesh() const { return m_mesh; }
 
   auto model() const { return m_model; }
-  void set_model(glm::mat4 m) { m_model = m; }
+  void set_model(glm::mat4 m) {
+    m_model = m;
+    m_transform_dirty = false;
+    update_bounds();
+    mark_dirty();
+  }
   void update_model() {
-    auto const rotated = glm::rotate(glm::mat4(1.f), glm::radians(m_rotation_scale), m_rotation_vector);
-    auto const translated = glm::translate(rotated, m_translation);
-    auto const scaled = glm::scale(translated, m_scale);
-    m_model = scaled;
+    m_model = compose_model(m_translation, m_scale, m_rotation_vector,
+                            m_rotation_scale);
+    m_transform_dirty = false;
+    update_bounds();
+    mark_dirty();
   }
+  // translation, scale or rotation changed since the last update_model(),
+  // Scene::update_transforms() catches up on all of them at once
+  bool transform_dirty() const { return m_transform_dirty; }
+  // the mesh bounds under model(), refreshed with the model matrix
+  Aabb const &world_bounds() const { return m_world_bounds; }
+  // changes whenever the transform does, unique across all objects so caches
+  // keyed by it never confuse two objects
+  auto revision() const { return m_revision; }
+  void mark_dirty() { m_revision = next_revision(); }
   // auto model() const { return m_model; }
   // void set_model(glm::mat4 m) { m_model = m; }
   auto translation() const { return m_translation; }
-  void set_translation(vec3 t) { m_translation = t; }
+  void set_translation(vec3 t) {
+    m_translation = t;
+    m_transform_dirty = true;
+    mark_dirty();
+  }
   auto scale() const { return m_scale; }
-  void set_scale(vec3 s) { m_scale = s; }
+  void set_scale(vec3 s) {
+    m_scale = s;
+    m_transform_dirty = true;
+    mark_dirty();
+  }
   auto rotation_vector() const { return m_rotation_vector; }
   auto rotation_scale() const { return m_rotation_scale; }
-  void set_rotation_vector(vec3 rt) { m_rotation_vector = rt; }
-  void set_rotation_scale(float deg) { m_rotation_scale = deg; }
+  void set_rotation_vector(vec3 rt) {
+    m_rotation_vector = rt;
+    m_transform_dirty = true;
+    mark_dirty();
+  }
+  void set_rotation_scale(float deg) {
+    m_rotation_scale = deg;
+    m_transform_dirty = true;
+    mark_dirty();
+  }
  
   auto material() const -> std::shared_ptr<Material> { return m_material; }
   void set_material(std::shared_ptr<Material> m) { m_material = m; }
@@ -81,19 +161,38 @@ public:
   auto type() const { return m_type; }
   auto set_type(Type t) { m_type = t; }
 
-  auto hit() const -> hit_function { return m_hit; }
+  auto hit() const -> hit_function const & { return m_hit; }
   auto set_hit_function(hit_function h) { m_hit = h; }
 
+  auto occlusion() const -> occlusion_function const & { return m_occlusion; }
+  auto set_occlusion_function(occlusion_function o) { m_occlusion = o; }
+
 private:
   hit_function m_hit;
-  std::unique_ptr<Mesh> m_mesh{};
+  occlusion_function m_occlusion;
+  std::shared_ptr<Mesh> m_mesh{};
   std::shared_ptr<Material> m_material{};
   glm::mat4 m_model{1.f};
+  Aabb m_world_bounds{};
   vec3 m_translation{0.f};
   vec3 m_scale{1.f};
   vec3 m_rotation_vector{1.f, 1.f, 1.f};
   float m_rotation_scale{0};
   Type m_type{Type::custom};
+  bool m_transform_dirty{false};
+  std::uint64_t m_revision{next_revision()};
+
+  void update_bounds() {
+    if (m_mesh != nullptr)
+      m_world_bounds = m_mesh->bounds().transformed(m_model);
+    else
+      m_world_bounds = Aabb{glm::vec3(m_model[3]), glm::vec3(m_model[3])};
+  }
+
+  static std::uint64_t next_revision() {
+    static std::atomic<std::uint64_t> counter{0};
+    return ++counter;
+  }
 };
 
 Object create_sphere();
@@ -105,4 +204,17 @@ Object create_plane();
 Object create_plane(glm::vec3 cen, vec3 scale, std::shared_ptr<Material> m);
 Object create_skybox();
 
+// ray tracing intersection kernels, obj.translation() is the centre and
+// obj.scale().x the radius or half extent
+bool sphere_hit(Object const &obj, ray const &r, float t_min, float t_max,
+                hit_record &rec);
+bool plane_hit(Object const &obj, ray const &r, float t_min, float t_max,
+               hit_record &rec);
+bool sphere_occluded(Object const &obj, ray const &r, float t_min,
+                     float t_max);
+bool plane_occluded(Object const &obj, ray const &r, float t_min, float t_max);
+
+// sets the ray tracing hit and occlusion functions matching obj.type()
+void assign_hit_functions(Object &obj);
+
 } // namespace ren
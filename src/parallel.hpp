@@ -0,0 +1,37 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace ren {
+
+inline unsigned default_thread_count() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Splits [0, n) into one contiguous range per worker and runs
+// f(begin, end, worker) on each of them, the calling thread takes the first
+// range. Returns once every range is done.
+template <typename F>
+void parallel_for(std::size_t n, F &&f, unsigned n_threads = 0) {
+  if (n_threads == 0)
+    n_threads = default_thread_count();
+  n_threads = static_cast<unsigned>(
+      std::min<std::size_t>(n_threads, std::max<std::size_t>(n, 1)));
+
+  auto const step = (n + n_threads - 1) / n_threads;
+  std::vector<std::thread> workers;
+  workers.reserve(n_threads - 1);
+  for (unsigned w = 1; w < n_threads; ++w) {
+    auto const begin = std::min(n, w * step);
+    auto const end = std::min(n, begin + step);
+    workers.emplace_back([&f, begin, end, w]() { f(begin, end, w); });
+  }
+  f(0, std::min(n, step), 0u);
+  for (auto &t : workers)
+    t.join();
+}
+
+} // namespace ren
@@ -0,0 +1,49 @@
+#include "point_lights.hpp"
+
+#include <cmath>
+
+#include "imgui.h"
+
+#include "scene.hpp"
+#include "util.hpp"
+
+namespace ren {
+
+std::vector<PointLight> const &LightSet::gather(Scene const &scene,
+                                                double ticks) {
+  m_lights.clear();
+  for (auto const &light : scene.lights()) {
+    auto const material = light.material();
+    auto const color = material && material->scatter
+                           ? material->scatter->emitted()
+                           : glm::vec3(1.f);
+    m_lights.push_back(
+        {glm::vec4(light.translation(), m_scene_light_radius), color});
+  }
+
+  if (static_cast<int>(m_test_lights.size()) != m_n_test_lights) {
+    m_test_lights.resize(m_n_test_lights);
+    for (auto &l : m_test_lights)
+      l = {glm::vec3(random_float(-8.f, 8.f), random_float(-4.f, 4.f),
+                     random_float(-8.f, 8.f)),
+           glm::vec3(random_float(), random_float(), random_float()),
+           random_float(0.5f, 3.f), random_float(0.2f, 1.5f),
+           random_float(0.f, 2.f * pi)};
+  }
+  auto const t = static_cast<float>(ticks);
+  for (auto const &l : m_test_lights) {
+    auto const angle = t * l.speed + l.phase;
+    auto const pos =
+        l.center + l.orbit * glm::vec3(std::sin(angle), 0.f, std::cos(angle));
+    m_lights.push_back({glm::vec4(pos, m_test_light_radius), l.color});
+  }
+  return m_lights;
+}
+
+void LightSet::draw_dialog() {
+  ImGui::SliderInt("Test lights", &m_n_test_lights, 0, 4096);
+  ImGui::SliderFloat("Test light radius", &m_test_light_radius, 0.5f, 20.f);
+  ImGui::SliderFloat("Scene light radius", &m_scene_light_radius, 1.f, 100.f);
+}
+
+} // namespace ren
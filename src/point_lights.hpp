@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+namespace ren {
+
+class Scene;
+
+struct PointLight {
+  glm::vec4 pos_radius;
+  glm::vec3 color; // premultiplied by the intensity
+};
+
+// The light list of the many light renderers: every light of the scene plus
+// a number of animated test lights to load them with.
+class LightSet final {
+public:
+  // all lights at `ticks`, the scene's first
+  std::vector<PointLight> const &gather(Scene const &scene, double ticks);
+  std::vector<PointLight> const &lights() const { return m_lights; }
+
+  void draw_dialog();
+
+private:
+  struct TestLight {
+    glm::vec3 center;
+    glm::vec3 color;
+    float orbit;
+    float speed;
+    float phase;
+  };
+
+  std::vector<PointLight> m_lights;
+  std::vector<TestLight> m_test_lights;
+  int m_n_test_lights{0};
+  float m_scene_light_radius{30.f};
+  float m_test_light_radius{4.f};
+};
+
+} // namespace ren
@@ -25,6 +25,9 @@ public:
   virtual ~Renderer(){};
   virtual void render(Scene const &, Transformations const &, double ticks) = 0;
   virtual void draw_dialog() = 0;
+  // the driver finished compiling the programs, rendering won't wait for
+  // it; never blocks
+  virtual bool ready() const { return true; }
 };
 
 } // namespace ren
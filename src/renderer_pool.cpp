@@ -0,0 +1,117 @@
+#include "renderer_pool.hpp"
+
+#include <cassert>
+#include <chrono>
+
+#include "imgui.h"
+#include "log.hpp"
+#include "zone_profiler.hpp"
+
+namespace ren {
+
+std::size_t RendererPool::add(std::string name, Factory factory) {
+  Slot slot;
+  slot.name = std::move(name);
+  slot.factory = std::move(factory);
+  m_slots.push_back(std::move(slot));
+  return m_slots.size() - 1;
+}
+
+Renderer &RendererPool::use(std::size_t index, double now, bool wait) {
+  assert(index < m_slots.size());
+  auto &slot = m_slots[index];
+  if (!slot.renderer)
+    construct(slot, now);
+  slot.last_used = now;
+
+  // keep drawing with the current renderer until the driver is done
+  if (index != m_current && !wait && m_current != none &&
+      m_slots[m_current].renderer && !slot.renderer->ready()) {
+    auto &current = m_slots[m_current];
+    current.last_used = now;
+    return *current.renderer;
+  }
+  if (index != m_current) {
+    m_previous = m_current;
+    m_current = index;
+    m_current_since = now;
+    m_warm_up_done = false;
+  }
+  slot.warmed = false;
+  return *slot.renderer;
+}
+
+void RendererPool::update(std::size_t current, double now) {
+  REN_ZONE("renderer pool");
+  if (m_settings.idle_timeout > 0.f) {
+    for (std::size_t i = 0; i < m_slots.size(); ++i) {
+      auto &slot = m_slots[i];
+      if (i == current || !slot.renderer ||
+          now - slot.last_used < m_settings.idle_timeout)
+        continue;
+      Log::the().add_log("Renderers: released %s after %.0f s idle\n",
+                         slot.name.c_str(), now - slot.last_used);
+      slot.renderer.reset();
+      slot.warmed = false;
+    }
+  }
+
+  // one attempt per selection, a warmed renderer that timed out stays gone
+  if (!m_settings.warm_up || m_warm_up_done || m_slots.size() < 2 ||
+      now - m_current_since < m_settings.warm_up_delay)
+    return;
+  m_warm_up_done = true;
+  auto &next = m_slots[likely_next(current)];
+  if (next.renderer)
+    return;
+  construct(next, now);
+  next.warmed = true;
+}
+
+void RendererPool::release_all() {
+  for (auto it = m_slots.rbegin(); it != m_slots.rend(); ++it) {
+    it->renderer.reset();
+    it->warmed = false;
+  }
+}
+
+void RendererPool::construct(Slot &slot, double now) {
+  REN_ZONE("construct renderer");
+  auto const start = std::chrono::steady_clock::now();
+  slot.renderer = slot.factory();
+  auto const end = std::chrono::steady_clock::now();
+  slot.construct_ms =
+      std::chrono::duration<double, std::milli>(end - start).count();
+  slot.last_used = now;
+  Log::the().add_log("Renderers: created %s in %.1f ms\n", slot.name.c_str(),
+                     slot.construct_ms);
+}
+
+std::size_t RendererPool::likely_next(std::size_t current) const {
+  if (m_previous != none && m_previous != current)
+    return m_previous;
+  return (current + 1) % m_slots.size();
+}
+
+void RendererPool::draw_dialog(double now) {
+  if (!ImGui::CollapsingHeader("Renderers"))
+    return;
+  ImGui::SliderFloat("Release idle after", &m_settings.idle_timeout, 0.f,
+                     600.f, m_settings.idle_timeout > 0.f ? "%.0f s" : "never");
+  ImGui::Checkbox("Warm up next renderer", &m_settings.warm_up);
+  for (std::size_t i = 0; i < m_slots.size(); ++i) {
+    auto const &slot = m_slots[i];
+    if (!slot.renderer)
+      ImGui::Text("%s: not resident", slot.name.c_str());
+    else if (!slot.renderer->ready())
+      ImGui::Text("%s: compiling", slot.name.c_str());
+    else if (i == m_current)
+      ImGui::Text("%s: current, created in %.1f ms", slot.name.c_str(),
+                  slot.construct_ms);
+    else
+      ImGui::Text("%s: %s, idle %.0f s", slot.name.c_str(),
+                  slot.warmed ? "warmed up" : "resident", now - slot.last_used);
+  }
+}
+
+} // namespace ren
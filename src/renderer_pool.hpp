@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "renderer.hpp"
+
+namespace ren {
+
+// Owns the renderers the user can switch between. A renderer is only
+// constructed when it is first selected, and destroyed again, with all its
+// GL objects and threads, once it has not been used for idle_timeout
+// seconds. While the current renderer runs, the one most likely picked next
+// (the previous one, otherwise the next in the list) can be warmed up: it is
+// constructed ahead of time so its programs compile in the background, and
+// switching to it doesn't wait for the compiler.
+// Main thread only, every method may create or delete GL objects.
+class RendererPool {
+public:
+  static constexpr std::size_t none = ~std::size_t{0};
+
+  using Factory = std::function<std::shared_ptr<Renderer>()>;
+
+  struct Settings {
+    float idle_timeout{60.f}; // seconds, 0 keeps everything resident
+    bool warm_up{true};
+    float warm_up_delay{2.f}; // seconds the current renderer ran first
+  };
+
+  // renderers are addressed by the order they were added in
+  std::size_t add(std::string name, Factory factory);
+
+  // the renderer at `index`, constructed if needed, and marks it used. While
+  // its programs still compile (Renderer::ready()) the previous renderer is
+  // returned instead, unless `wait` asks for this one regardless.
+  Renderer &use(std::size_t index, double now, bool wait = false);
+  // nullptr if it isn't constructed
+  template <typename T> T *get_if(std::size_t index) const {
+    return dynamic_cast<T *>(m_slots[index].renderer.get());
+  }
+
+  // releases idle renderers and warms up the next one, once per frame after
+  // use(); `current` is never touched
+  void update(std::size_t current, double now);
+  void release_all();
+
+  void draw_dialog(double now);
+  Settings &settings() { return m_settings; }
+
+private:
+  struct Slot {
+    std::string name;
+    Factory factory;
+    std::shared_ptr<Renderer> renderer;
+    double last_used{0.0};
+    double construct_ms{0.0}; // of the last construction
+    bool warmed{false};       // constructed by warm up, not yet used
+  };
+
+  void construct(Slot &slot, double now);
+  std::size_t likely_next(std::size_t current) const;
+
+  std::vector<Slot> m_slots;
+  Settings m_settings;
+  std::size_t m_current{none};
+  std::size_t m_previous{none}; // the renderer used before m_current
+  double m_current_since{0.0};
+  bool m_warm_up_done{false};
+};
+
+} // namespace ren
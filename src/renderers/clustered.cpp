@@ -0,0 +1,146 @@
+#include "clustered.hpp"
+
+#include <algorithm>
+
+#include "../camera.hpp"
+#include "../gl_profiler.hpp"
+#include "../scene.hpp"
+#include "../zone_profiler.hpp"
+
+namespace ren {
+namespace {
+
+template <typename T>
+void stream(GLuint buffer, std::vector<T> const &data) {
+  glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+  // never empty, a texture buffer of size zero is incomplete on some drivers
+  glBufferData(GL_TEXTURE_BUFFER,
+               std::max<std::size_t>(data.size(), 1) * sizeof(T), nullptr,
+               GL_STREAM_DRAW);
+  if (!data.empty())
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, data.size() * sizeof(T), data.data());
+  GlProfiler::the().count_upload(data.size() * sizeof(T));
+}
+
+} // namespace
+
+ClusteredRenderer::ClusteredRenderer(std::filesystem::path root_dir,
+                                     std::shared_ptr<GeometryArena> arena)
+    : m_batcher(std::move(arena)) {
+  m_clustered_shader =
+      ren::Shader(root_dir / "shaders/lighting_clustered.vert",
+                  root_dir / "shaders/lighting_clustered.frag");
+  m_solid_shader = ren::Shader(root_dir / "shaders/solid_color.vert",
+                               root_dir / "shaders/solid_color.frag");
+
+  for (auto [tb, format] : {std::pair{&m_grid, GL_RG32UI},
+                            std::pair{&m_indices, GL_R32UI},
+                            std::pair{&m_lights, GL_RGBA32F}}) {
+    glGenBuffers(1, &tb->buffer);
+    glGenTextures(1, &tb->texture);
+    glBindBuffer(GL_TEXTURE_BUFFER, tb->buffer);
+    glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, tb->texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, tb->buffer);
+  }
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+ClusteredRenderer::~ClusteredRenderer() {
+  for (auto *tb : {&m_grid, &m_indices, &m_lights}) {
+    glDeleteTextures(1, &tb->texture);
+    glDeleteBuffers(1, &tb->buffer);
+  }
+}
+
+void ClusteredRenderer::upload() {
+  auto const &lights = m_light_set.lights();
+  m_light_data.clear();
+  for (auto const &light : lights) {
+    m_light_data.push_back(light.pos_radius);
+    m_light_data.push_back(glm::vec4(light.color, 0.f));
+  }
+  stream(m_grid.buffer, m_clusters.grid());
+  stream(m_indices.buffer, m_clusters.indices());
+  stream(m_lights.buffer, m_light_data);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredRenderer::render(const Scene &scene, Transformations const &trans,
+                               double ticks) {
+  REN_ZONE("ClusteredRenderer::render");
+  assert(trans.cam);
+
+  auto const view = trans.cam->view();
+  m_clusters.set_projection(trans.projection);
+  m_clusters.assign(m_light_set.gather(scene, ticks), view);
+
+  auto const light_pos = scene.lights().empty()
+                             ? glm::vec3(0.f)
+                             : scene.lights().front().translation();
+  m_frame.update({trans.projection, view, glm::vec4(trans.cam->pos(), 1.f),
+                  glm::vec4(light_pos, 1.f), glm::vec4(1.f)});
+  m_batcher.prepare(scene.objects());
+  m_culler.gather(scene.objects());
+  m_culler.cull(Frustum::from_matrix(trans.projection * view), m_visible);
+
+  auto const timer = GlProfiler::the().scope("lighting");
+  upload();
+  glViewport(0, 0, trans.screen_width, trans.screen_height);
+  glDisable(GL_STENCIL_TEST);
+  glDisable(GL_BLEND);
+  glDisable(GL_CULL_FACE);
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(GL_LESS);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  m_clustered_shader.use();
+  GLuint unit = 0;
+  for (auto [name, tb] : {std::pair{"cluster_grid", &m_grid},
+                          std::pair{"light_indices", &m_indices},
+                          std::pair{"light_data", &m_lights}}) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_BUFFER, tb->texture);
+    m_clustered_shader.set<GLuint>(name, unit++);
+  }
+  glActiveTexture(GL_TEXTURE0);
+  GlProfiler::the().count_state_change();
+  m_clustered_shader.set(
+      "clusters", glm::ivec3(LightClusters::tiles_x, LightClusters::tiles_y,
+                             LightClusters::slices));
+  m_clustered_shader.set(
+      "tile_size",
+      glm::vec2(static_cast<float>(trans.screen_width) / LightClusters::tiles_x,
+                static_cast<float>(trans.screen_height) /
+                    LightClusters::tiles_y));
+  m_clustered_shader.set(
+      "slicing",
+      glm::vec2(m_clusters.slice_scale(), m_clusters.slice_bias()));
+  m_clustered_shader.set("ambient", glm::vec3(m_ambient));
+  m_batcher.draw_objects(m_visible);
+
+  m_solid_shader.use();
+  m_solid_shader.set<glm::mat4>("projection", trans.projection);
+  m_solid_shader.set<glm::mat4>("view", view);
+  m_solid_shader.set<glm::vec3>("color", {1.f, 1.f, 1.f});
+  for (auto const &light : scene.lights()) {
+    m_solid_shader.set<glm::mat4>("model", light.model());
+    light.draw();
+  }
+}
+
+void ClusteredRenderer::draw_dialog() {
+  ImGui::Text("Clustered Forward");
+  m_light_set.draw_dialog();
+  ImGui::SliderFloat("Ambient", &m_ambient, 0.f, 1.f);
+  ImGui::Text("%dx%dx%d clusters, %zu with lights", LightClusters::tiles_x,
+              LightClusters::tiles_y, LightClusters::slices,
+              m_clusters.occupied());
+  ImGui::Text("%zu lights, %zu list entries, at most %u per cluster",
+              m_light_set.lights().size(), m_clusters.indices().size(),
+              m_clusters.max_count());
+  ImGui::Text("%zu of %zu objects in view", m_visible.size(),
+              m_culler.size());
+}
+} // namespace ren
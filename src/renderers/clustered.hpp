@@ -0,0 +1,65 @@
+#pragma once
+
+#include "../renderer.hpp"
+
+// clang-format off
+#include "glad/glad.h"
+#include <GLFW/glfw3.h>
+// clang-format on
+
+#include <vector>
+
+#include "../culling.hpp"
+#include "../instancing.hpp"
+#include "../light_clusters.hpp"
+#include "../point_lights.hpp"
+#include "../shader.hpp"
+#include "../uniform_buffer.hpp"
+
+namespace ren {
+
+// Forward shading of many point lights. The lights are assigned to clusters
+// of the view frustum on the CPU, the cluster grid, the light lists and the
+// lights themselves go to the GPU as buffer textures, and every fragment
+// only loops over the lights of its cluster.
+class ClusteredRenderer final : public Renderer {
+public:
+  ClusteredRenderer(std::filesystem::path root_dir,
+                    std::shared_ptr<GeometryArena> arena = nullptr);
+  ~ClusteredRenderer();
+  ClusteredRenderer(ClusteredRenderer const &) = delete;
+  ClusteredRenderer &operator=(ClusteredRenderer const &) = delete;
+
+  void render(const Scene &, Transformations const &, double ticks) override;
+  void draw_dialog() override;
+  bool ready() const override {
+    return m_clustered_shader.ready() && m_solid_shader.ready();
+  }
+
+private:
+  // a buffer and the texture reading it
+  struct TextureBuffer {
+    GLuint buffer{0};
+    GLuint texture{0};
+  };
+
+  void upload();
+
+  Shader m_clustered_shader;
+  Shader m_solid_shader;
+
+  FrameUniformBuffer m_frame;
+  InstanceBatcher m_batcher;
+  FrustumCuller m_culler;
+  std::vector<std::size_t> m_visible;
+
+  LightSet m_light_set;
+  LightClusters m_clusters;
+  std::vector<glm::vec4> m_light_data;
+  TextureBuffer m_grid;
+  TextureBuffer m_indices;
+  TextureBuffer m_lights;
+  float m_ambient{0.1f};
+};
+
+} // namespace ren
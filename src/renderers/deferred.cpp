@@ -0,0 +1,319 @@
+#include "deferred.hpp"
+
+#include <cmath>
+
+#include "../camera.hpp"
+#include "../gl_profiler.hpp"
+#include "../log.hpp"
+#include "../scene.hpp"
+#include "../util.hpp"
+#include "../zone_profiler.hpp"
+
+namespace ren {
+namespace {
+
+constexpr int volume_stacks = 8;
+constexpr int volume_slices = 12;
+
+GLuint make_target(GLenum internal_format, GLenum format, GLenum type,
+                   int width, int height) {
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format,
+               type, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  return texture;
+}
+
+bool framebuffer_complete(char const *name) {
+  auto const status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if (status == GL_FRAMEBUFFER_COMPLETE)
+    return true;
+  Log::the().add_log("DeferredRenderer: %s incomplete (0x%x)\n", name, status);
+  return false;
+}
+
+} // namespace
+
+DeferredRenderer::DeferredRenderer(std::filesystem::path root_dir,
+                                   std::shared_ptr<GeometryArena> arena)
+    : m_batcher(std::move(arena)) {
+  m_geometry_shader = ren::Shader(root_dir / "shaders/deferred_geometry.vert",
+                                  root_dir / "shaders/deferred_geometry.frag");
+  m_ambient_shader = ren::Shader(root_dir / "shaders/deferred_fullscreen.vert",
+                                 root_dir / "shaders/deferred_ambient.frag");
+  m_light_shader = ren::Shader(root_dir / "shaders/deferred_light.vert",
+                               root_dir / "shaders/deferred_light.frag");
+  m_solid_shader = ren::Shader(root_dir / "shaders/solid_color.vert",
+                               root_dir / "shaders/solid_color.frag");
+
+  create_volume();
+  // core profiles need a VAO bound even for attribute-less draws
+  glGenVertexArrays(1, &m_empty_vao);
+}
+
+DeferredRenderer::~DeferredRenderer() {
+  release_targets();
+  glDeleteVertexArrays(1, &m_volume_vao);
+  glDeleteVertexArrays(1, &m_empty_vao);
+  glDeleteBuffers(1, &m_volume_vbo);
+  glDeleteBuffers(1, &m_volume_ebo);
+  glDeleteBuffers(1, &m_light_buffer);
+}
+
+void DeferredRenderer::create_volume() {
+  // a uv sphere grown so its flat faces still enclose the unit sphere
+  auto const grow = 1.f / (std::cos(pi / volume_slices) *
+                           std::cos(pi / (2 * volume_stacks)));
+  std::vector<glm::vec3> vertices;
+  for (int i = 0; i <= volume_stacks; ++i) {
+    auto const phi = pi * i / volume_stacks;
+    for (int j = 0; j <= volume_slices; ++j) {
+      auto const theta = 2.f * pi * j / volume_slices;
+      vertices.push_back(grow * glm::vec3(std::sin(phi) * std::cos(theta),
+                                          std::cos(phi),
+                                          std::sin(phi) * std::sin(theta)));
+    }
+  }
+  // counter clockwise seen from outside
+  std::vector<GLuint> indices;
+  for (int i = 0; i < volume_stacks; ++i) {
+    for (int j = 0; j < volume_slices; ++j) {
+      auto const a = static_cast<GLuint>(i * (volume_slices + 1) + j);
+      auto const b = a + volume_slices + 1;
+      indices.insert(indices.end(), {a, a + 1, b, a + 1, b + 1, b});
+    }
+  }
+  m_volume_indices = static_cast<GLsizei>(indices.size());
+
+  glGenVertexArrays(1, &m_volume_vao);
+  glGenBuffers(1, &m_volume_vbo);
+  glGenBuffers(1, &m_volume_ebo);
+  glGenBuffers(1, &m_light_buffer);
+
+  glBindVertexArray(m_volume_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, m_volume_vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3),
+               vertices.data(), GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_volume_ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+               indices.data(), GL_STATIC_DRAW);
+
+  glBindBuffer(GL_ARRAY_BUFFER, m_light_buffer);
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(PointLight),
+                        reinterpret_cast<void *>(0));
+  glVertexAttribDivisor(3, 1);
+  glEnableVertexAttribArray(4);
+  glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(PointLight),
+                        reinterpret_cast<void *>(sizeof(glm::vec4)));
+  glVertexAttribDivisor(4, 1);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DeferredRenderer::release_targets() {
+  glDeleteFramebuffers(1, &m_gbuffer);
+  glDeleteFramebuffers(1, &m_accumulation);
+  glDeleteTextures(1, &m_albedo);
+  glDeleteTextures(1, &m_normal);
+  glDeleteTextures(1, &m_depth);
+  glDeleteTextures(1, &m_light_color);
+  glDeleteRenderbuffers(1, &m_light_depth);
+  m_gbuffer = m_accumulation = 0;
+  m_albedo = m_normal = m_depth = m_light_color = m_light_depth = 0;
+  m_width = m_height = 0;
+}
+
+void DeferredRenderer::resize(int width, int height) {
+  if (width == m_width && height == m_height)
+    return;
+  release_targets();
+  m_width = width;
+  m_height = height;
+
+  m_albedo = make_target(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+  m_normal = make_target(GL_RGBA16F, GL_RGBA, GL_FLOAT, width, height);
+  m_depth = make_target(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL,
+                        GL_UNSIGNED_INT_24_8, width, height);
+  glGenFramebuffers(1, &m_gbuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_gbuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         m_albedo, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                         m_normal, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                         GL_TEXTURE_2D, m_depth, 0);
+  GLenum const attachments[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, attachments);
+  framebuffer_complete("G-buffer");
+
+  m_light_color =
+      make_target(GL_RGBA16F, GL_RGBA, GL_FLOAT, width, height);
+  glGenRenderbuffers(1, &m_light_depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_light_depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glGenFramebuffers(1, &m_accumulation);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_accumulation);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         m_light_color, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                            GL_RENDERBUFFER, m_light_depth);
+  framebuffer_complete("light accumulation");
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  Log::the().add_log("DeferredRenderer: targets resized to %dx%d\n", width,
+                     height);
+}
+
+void DeferredRenderer::render(const Scene &scene, Transformations const &trans,
+                              double ticks) {
+  REN_ZONE("DeferredRenderer::render");
+  assert(trans.cam);
+
+  resize(trans.screen_width, trans.screen_height);
+  auto const view = trans.cam->view();
+  auto const view_proj = trans.projection * view;
+  auto const frustum = Frustum::from_matrix(view_proj);
+  auto const light_pos = scene.lights().empty()
+                             ? glm::vec3(0.f)
+                             : scene.lights().front().translation();
+  m_frame.update({trans.projection, view, glm::vec4(trans.cam->pos(), 1.f),
+                  glm::vec4(light_pos, 1.f), glm::vec4(1.f)});
+
+  m_batcher.prepare(scene.objects());
+  m_culler.gather(scene.objects());
+  m_culler.cull(frustum, m_visible);
+
+  // 1. every visible object once into the G-buffer
+  // ----------------------------------------------
+  {
+    auto const timer = GlProfiler::the().scope("gbuffer");
+    glBindFramebuffer(GL_FRAMEBUFFER, m_gbuffer);
+    GlProfiler::the().count_state_change();
+    glViewport(0, 0, m_width, m_height);
+    glDisable(GL_STENCIL_TEST);
+    glDisable(GL_BLEND);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+    m_geometry_shader.use();
+    m_batcher.draw_objects(m_visible);
+  }
+
+  // 2. ambient, then each light added over the pixels its volume covers
+  // -------------------------------------------------------------------
+  auto const timer = GlProfiler::the().scope("lighting");
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, m_gbuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_accumulation);
+  glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height,
+                    GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_accumulation);
+  GlProfiler::the().count_state_change();
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, m_albedo);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, m_normal);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, m_depth);
+  glActiveTexture(GL_TEXTURE0);
+
+  glDisable(GL_DEPTH_TEST);
+  glDepthMask(GL_FALSE);
+  m_ambient_shader.use();
+  m_ambient_shader.set<GLuint>("g_albedo", 0);
+  m_ambient_shader.set<GLuint>("g_depth", 2);
+  m_ambient_shader.set("ambient", glm::vec3(m_ambient));
+  glBindVertexArray(m_empty_vao);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  GlProfiler::the().count_draw();
+
+  m_lights.clear();
+  for (auto const &light : m_light_set.gather(scene, ticks)) {
+    auto const pos = glm::vec3(light.pos_radius);
+    auto const r = glm::vec3(light.pos_radius.w);
+    if (!frustum.outside(Aabb{pos - r, pos + r}))
+      m_lights.push_back(light);
+  }
+  if (!m_lights.empty()) {
+    glBindBuffer(GL_ARRAY_BUFFER, m_light_buffer);
+    glBufferData(GL_ARRAY_BUFFER, m_lights.size() * sizeof(PointLight),
+                 m_lights.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    GlProfiler::the().count_upload(m_lights.size() * sizeof(PointLight));
+
+    // the back faces of a volume pass where the surface is in front of them,
+    // which also holds with the camera inside it; clamping keeps volumes
+    // reaching past the far plane
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_GEQUAL);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT);
+    glEnable(GL_DEPTH_CLAMP);
+
+    m_light_shader.use();
+    m_light_shader.set<GLuint>("g_albedo", 0);
+    m_light_shader.set<GLuint>("g_normal", 1);
+    m_light_shader.set<GLuint>("g_depth", 2);
+    m_light_shader.set("inv_view_proj", glm::inverse(view_proj));
+    glBindVertexArray(m_volume_vao);
+    glDrawElementsInstanced(GL_TRIANGLES, m_volume_indices, GL_UNSIGNED_INT,
+                            nullptr, static_cast<GLsizei>(m_lights.size()));
+    GlProfiler::the().count_draw();
+
+    glDisable(GL_DEPTH_CLAMP);
+    glCullFace(GL_BACK);
+    glDisable(GL_CULL_FACE);
+    glDepthFunc(GL_LESS);
+    glDisable(GL_BLEND);
+  }
+  glBindVertexArray(0);
+  glEnable(GL_DEPTH_TEST);
+  glDepthMask(GL_TRUE);
+
+  m_solid_shader.use();
+  m_solid_shader.set<glm::mat4>("projection", trans.projection);
+  m_solid_shader.set<glm::mat4>("view", view);
+  m_solid_shader.set<glm::vec3>("color", {1.f, 1.f, 1.f});
+  for (auto const &light : scene.lights()) {
+    m_solid_shader.set<glm::mat4>("model", light.model());
+    light.draw();
+  }
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, m_accumulation);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height,
+                    GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  GlProfiler::the().count_state_change();
+}
+
+void DeferredRenderer::draw_dialog() {
+  ImGui::Text("Deferred");
+  m_light_set.draw_dialog();
+  ImGui::SliderFloat("Ambient", &m_ambient, 0.f, 1.f);
+  ImGui::Text("%zu of %zu lights in view", m_lights.size(),
+              m_light_set.lights().size());
+  ImGui::Text("%zu batches for %zu objects", m_batcher.batches().size(),
+              m_batcher.n_instances());
+  ImGui::Text("%zu of %zu objects in view", m_visible.size(),
+              m_culler.size());
+  ImGui::Text("G-buffer %dx%d, %.1f MiB", m_width, m_height,
+              m_width * m_height * (4 + 8 + 4) / (1024.f * 1024.f));
+}
+} // namespace ren
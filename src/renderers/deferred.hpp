@@ -0,0 +1,83 @@
+#pragma once
+
+#include "../renderer.hpp"
+
+// clang-format off
+#include "glad/glad.h"
+#include <GLFW/glfw3.h>
+// clang-format on
+
+#include <vector>
+
+#include "../culling.hpp"
+#include "../instancing.hpp"
+#include "../point_lights.hpp"
+#include "../shader.hpp"
+#include "../uniform_buffer.hpp"
+
+namespace ren {
+
+// Draws the scene once into a G-buffer (albedo and specular strength in
+// RGBA8, normal and shininess in RGBA16F, depth), then adds up every point
+// light by drawing its bounding sphere over the lit pixels. A light costs
+// the pixels it covers, independent of the number of objects. Only needs GL
+// 3.3 core.
+class DeferredRenderer final : public Renderer {
+public:
+  DeferredRenderer(std::filesystem::path root_dir,
+                   std::shared_ptr<GeometryArena> arena = nullptr);
+  ~DeferredRenderer();
+  DeferredRenderer(DeferredRenderer const &) = delete;
+  DeferredRenderer &operator=(DeferredRenderer const &) = delete;
+
+  void render(const Scene &, Transformations const &, double ticks) override;
+  void draw_dialog() override;
+  bool ready() const override {
+    return m_geometry_shader.ready() && m_ambient_shader.ready() &&
+           m_light_shader.ready() && m_solid_shader.ready();
+  }
+
+private:
+  void resize(int width, int height);
+  void release_targets();
+  void create_volume();
+
+  Shader m_geometry_shader;
+  Shader m_ambient_shader;
+  Shader m_light_shader;
+  Shader m_solid_shader;
+
+  FrameUniformBuffer m_frame;
+  InstanceBatcher m_batcher;
+  FrustumCuller m_culler;
+  std::vector<std::size_t> m_visible;
+
+  // G-buffer, its depth is a texture read by the lighting passes
+  GLuint m_gbuffer{0};
+  GLuint m_albedo{0};
+  GLuint m_normal{0};
+  GLuint m_depth{0};
+  // lights accumulate here, depth is a copy of the G-buffer's so the volumes
+  // are depth tested without reading and testing the same texture
+  GLuint m_accumulation{0};
+  GLuint m_light_color{0};
+  GLuint m_light_depth{0};
+  int m_width{0};
+  int m_height{0};
+
+  // low poly sphere, instanced once per light
+  GLuint m_volume_vao{0};
+  GLuint m_volume_vbo{0};
+  GLuint m_volume_ebo{0};
+  GLuint m_light_buffer{0};
+  GLsizei m_volume_indices{0};
+  GLuint m_empty_vao{0};
+
+  LightSet m_light_set;
+  // the lights in view, PointLight is the per light attributes of the volume
+  // draw at locations 3 and 4
+  std::vector<PointLight> m_lights;
+  float m_ambient{0.1f};
+};
+
+} // namespace ren
@@ -1,53 +1,50 @@
 #include "material.hpp"
 
 #include "../camera.hpp"
+#include "../gl_profiler.hpp"
 #include "../scene.hpp"
+#include "../zone_profiler.hpp"
 
 #include "glm/gtx/string_cast.hpp"
 
 namespace ren {
-MaterialRenderer::MaterialRenderer(std::filesystem::path root_dir) {
+MaterialRenderer::MaterialRenderer(std::filesystem::path root_dir,
+                                   std::shared_ptr<GeometryArena> arena)
+    : m_batcher(std::move(arena)) {
   m_material_shader = ren::Shader(root_dir / "shaders/material.vert",
                                   root_dir / "shaders/material.frag");
-  assert(m_material_shader.success());
   m_solid_shader = ren::Shader(root_dir / "shaders/solid_color.vert",
                                root_dir / "shaders/solid_color.frag");
-  assert(m_solid_shader.success());
 }
 
 void MaterialRenderer::render(const Scene &scene, Transformations const &trans,
                               double ticks) {
+  REN_ZONE("MaterialRenderer::render");
   assert(trans.cam);
 
   auto const &light = scene.lights()[0];
 
+  auto const timer = GlProfiler::the().scope("lighting");
   glViewport(0, 0, trans.screen_width, trans.screen_height);
   glEnable(GL_DEPTH_TEST);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  m_material_shader.use();
-  m_material_shader.set<glm::mat4>("projection", trans.projection);
-  m_material_shader.set<glm::mat4>("view", trans.cam->view());
-
-  auto const &l_mat = light.material();
-  assert(l_mat != nullptr);
-  m_material_shader.set<glm::vec3>("light.ambient", vec3(1.f));
-  m_material_shader.set<glm::vec3>("light.diffuse", vec3(1.f));
-  m_material_shader.set<glm::vec3>("light.specular", vec3(1.f));
-
-
-  m_material_shader.set<glm::vec3>("light.position", light.translation());
+  m_materials.begin_frame();
+  m_frame.update({trans.projection, trans.cam->view(),
+                  glm::vec4(trans.cam->pos(), 1.f),
+                  glm::vec4(light.translation(), 1.f), glm::vec4(1.f)});
 
-  for (auto const &obj : scene.objects()) {
-    auto const &mat = obj.material();
-    assert(mat != nullptr);
-    m_material_shader.set<glm::mat4>("model", obj.model());
-    m_material_shader.set<vec3>("material.ambient", vec3(0.5f, 0.5f, 0.31f));
-    m_material_shader.set<vec3>("material.diffuse", vec3(0.7f, 0.2f, 0.4f));
-    m_material_shader.set<vec3>("material.specular", vec3(0.5f, 0.5f, 0.5f));
-    m_material_shader.set<float>("material.shininess", 32.0f);
-    obj.draw();
-  }
+  // every object shares the same material values
+  m_material_shader.use();
+  m_materials.bind(uniform_binding::material,
+                   MaterialUniforms{glm::vec4(0.5f, 0.5f, 0.31f, 1.f),
+                                    glm::vec4(0.7f, 0.2f, 0.4f, 1.f),
+                                    glm::vec4(0.5f, 0.5f, 0.5f, 32.f)});
+  m_batcher.prepare(scene.objects());
+  m_culler.gather(scene.objects());
+  m_culler.cull(Frustum::from_matrix(trans.projection * trans.cam->view()),
+                m_visible);
+  m_batcher.draw_objects(m_visible);
 
   m_solid_shader.use();
   m_solid_shader.set<glm::mat4>("projection", trans.projection);
@@ -55,5 +52,14 @@ void MaterialRenderer::render(const Scene &scene, Transformations const &trans,
   m_solid_shader.set<glm::mat4>("model", light.model());
   m_solid_shader.set<glm::vec3>("color", {1.f, 1.f, 1.f});
   light.draw();
+  m_materials.end_frame();
+}
+
+void MaterialRenderer::draw_dialog() {
+  ImGui::Text("Material");
+  ImGui::Text("%zu batches for %zu objects", m_batcher.batches().size(),
+              m_batcher.n_instances());
+  ImGui::Text("%zu of %zu objects in view", m_visible.size(),
+              m_culler.size());
 }
 } // namespace ren
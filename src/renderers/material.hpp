@@ -7,20 +7,33 @@
 #include <GLFW/glfw3.h>
 // clang-format on
 
+#include "../culling.hpp"
+#include "../instancing.hpp"
 #include "../shader.hpp"
+#include "../uniform_buffer.hpp"
 
 namespace ren {
 
 class MaterialRenderer final : public Renderer {
 public:
-  MaterialRenderer(std::filesystem::path root_dir);
+  MaterialRenderer(std::filesystem::path root_dir,
+                   std::shared_ptr<GeometryArena> arena = nullptr);
   ~MaterialRenderer() = default;
   void render(const Scene &, Transformations const &, double ticks) override;
-  void draw_dialog() override {}
+  void draw_dialog() override;
+  bool ready() const override {
+    return m_material_shader.ready() && m_solid_shader.ready();
+  }
 
 private:
   Shader m_material_shader;
   Shader m_solid_shader;
+
+  FrameUniformBuffer m_frame;
+  UniformRing m_materials;
+  InstanceBatcher m_batcher;
+  FrustumCuller m_culler;
+  std::vector<std::size_t> m_visible;
 };
 
 } // namespace ren
\ No newline at end of file
@@ -2,13 +2,16 @@
 
 #include "../log.hpp"
 #include "../scene.hpp"
+#include "../trace.hpp"
 
 #include <iostream>
 
 #include "../util.hpp"
+#include "../zone_profiler.hpp"
 
 #include "../camera.hpp"
 #include "../color.hpp"
+#include "../gl_profiler.hpp"
 #include "../material.hpp"
 // #include "raytracing/sphere.hpp"
 
@@ -16,47 +19,32 @@
 #include "stb_image_write.h"
 
 namespace ren {
-// raytracing
-static bool hit_scene(ray const &r, Scene const *world, int depth,
-                      hit_record &rec) {
-
-  hit_record temp_rec;
-  float t_min = 0.001;
-  float t_max = infinity;
-  bool hit_anything = false;
-  auto closest_so_far = t_max;
-  for (auto const &object : world->objects()) {
-    if (!object.hit()) {
-      continue;
-    }
-    if (object.hit()(object, r, t_min, closest_so_far, temp_rec)) { // malo
-                                                                    // ruzno
-      hit_anything = true;
-      closest_so_far = temp_rec.t;
-      rec = temp_rec;
-    }
-  }
-  for (auto const &object : world->lights()) {
-    if (!object.hit()) {
-      continue;
-    }
-    if (object.hit()(object, r, t_min, closest_so_far, temp_rec)) { // malo
-                                                                    // ruzno
-      hit_anything = true;
-      closest_so_far = temp_rec.t;
-      rec = temp_rec;
-    }
-  }
-  return hit_anything;
+
+// rays are counted per thread and published once per image row, so the
+// counter is not contended from inside the kernels
+static std::atomic<std::uint64_t> total_rays{0};
+static thread_local std::uint64_t pending_rays = 0;
+
+static void publish_rays() {
+  total_rays.fetch_add(pending_rays, std::memory_order_relaxed);
+  pending_rays = 0;
 }
 
+// Neighbouring shading points are usually blocked by the same object, so
+// every render thread remembers the last occluder it found towards the light
+// and tests that object before walking the scene. Only the first light is
+// sampled. The index runs over objects() followed by lights(), -1 means
+// nothing cached.
+static thread_local int last_occluder = -1;
+
 static color ren_ray_color(ray const &r, Scene const *world, int depth) {
   hit_record rec;
 
   if (depth <= 0)
     return color(0, 0, 0);
 
-  if (!hit_scene(r, world, depth, rec)) {
+  ++pending_rays;
+  if (!hit_scene(r, world, rec)) {
     return color(0.2f, 0.2f, 0.2f);
   }
 
@@ -84,8 +72,24 @@ static color ren_ray_color(ray const &r, Scene const *world, int depth) {
 
   pdf = distance_squared / (light_cosine * light_area);
   scattered = ray(rec.p, to_light);
-  return emitted + albedo *
-                       rec.mat_ptr->scatter->scattering_pdf(r, rec, scattered) *
+  auto const scattering_pdf =
+      rec.mat_ptr->scatter->scattering_pdf(r, rec, scattered);
+
+  // An unblocked ray towards the light centre is guaranteed to end on the
+  // light, so its radiance is known without a closest-hit query.
+  auto const light_distance = std::sqrt(distance_squared);
+  auto const shadow_t_max = light_distance - light.scale().x - 0.001f;
+  if (shadow_t_max > 0.f)
+    ++pending_rays;
+  if (shadow_t_max > 0.f &&
+      !occluded(scattered, world, shadow_t_max, &last_occluder)) {
+    if (depth - 1 <= 0)
+      return emitted;
+    return emitted + albedo * scattering_pdf *
+                         light.material()->scatter->emitted() / pdf;
+  }
+
+  return emitted + albedo * scattering_pdf *
                        ren_ray_color(scattered, world, depth - 1) / pdf;
 }
 
@@ -103,6 +107,7 @@ void ren_task(RayTracingRenderer::ThreadTask task,
   Pixels *pixels = task.pixels;
 
   auto type = task.type;
+  REN_THREAD_NAME("ray tracing worker");
   do {
     if (type == RayTracingRenderer::ThreadTaskType::realtime) {
       ra.cam->update_rt_vectors();
@@ -114,6 +119,7 @@ void ren_task(RayTracingRenderer::ThreadTask task,
         continue;
       }
     }
+    REN_ZONE("ren_task tile");
     for (int j = ra.start; j <= ra.stop; ++j) {
       for (int i = 0; i < image_width; ++i) {
         if (type == RayTracingRenderer::ThreadTaskType::realtime) {
@@ -138,6 +144,7 @@ void ren_task(RayTracingRenderer::ThreadTask task,
         (*pixels).at(index++) = y;
         (*pixels).at(index++) = z;
       }
+      publish_rays();
     }
     index = starting_index;
     *task.thread_finished = true;
@@ -147,7 +154,6 @@ void ren_task(RayTracingRenderer::ThreadTask task,
 RayTracingRenderer::RayTracingRenderer(std::filesystem::path root_dir) {
   m_fstexture_shader = ren::Shader(root_dir / "shaders/fstexture.vert",
                                    root_dir / "shaders/fstexture.frag");
-  assert(m_fstexture_shader.success());
 
   glGenFramebuffers(1, &m_framebuffer);
   glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
@@ -193,6 +199,7 @@ RayTracingRenderer::RayTracingRenderer(std::filesystem::path root_dir) {
 
 void RayTracingRenderer::render(const Scene &scene,
                                 Transformations const &trans, double ticks) {
+  REN_ZONE("RayTracingRenderer::render");
 
   assert(trans.cam);
   a_camera = trans.cam;
@@ -218,6 +225,7 @@ void RayTracingRenderer::render(const Scene &scene,
 
   // realtime rendering
   if (m_has_render || m_render_realtime) {
+    auto const timer = GlProfiler::the().scope("fullscreen blit");
     // reset settings when switching from other renderers
     glDrawBuffer(GL_BACK);
     glDepthFunc(GL_LESS);
@@ -234,9 +242,15 @@ void RayTracingRenderer::render(const Scene &scene,
 
     glBindVertexArray(VAO);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    GlProfiler::the().count_state_change();
+    GlProfiler::the().count_draw();
   }
 }
 
+std::uint64_t RayTracingRenderer::rays_traced() {
+  return total_rays.load(std::memory_order_relaxed);
+}
+
 void RayTracingRenderer::setup_realtime() {
   if (m_realtime_setup)
     return;
@@ -6,6 +6,7 @@
 #include <atomic>
 #include <thread>
 #include <chrono>
+#include <cstdint>
 
 // clang-format off
 #include "glad/glad.h"
@@ -27,14 +28,20 @@ public:
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
+    glDeleteFramebuffers(1, &m_framebuffer);
     destroy_realtime();
   };
   void render(const Scene &, Transformations const &, double ticks) override;
   void draw_dialog() override;
+  bool ready() const override { return m_fstexture_shader.ready(); }
   void destroy() {
     destroy_realtime();
   }
   
+  // camera and shadow rays traced by all render threads since startup
+  static std::uint64_t rays_traced();
+  void set_realtime(bool enable) { m_render_realtime = enable; }
+
   auto elapsed() {
       return std::chrono::duration_cast<std::chrono::microseconds>(elapsed_time);
   }
@@ -112,7 +119,7 @@ private:
   void setup_realtime();
   void destroy_realtime();
   GLuint VBO, VAO, EBO;
-  GLuint m_framebuffer;
+  GLuint m_framebuffer{0};
   bool m_render_realtime{false};
   int m_realtime_samples_per_pixel = 5;
   int m_realtime_max_depth = 25;
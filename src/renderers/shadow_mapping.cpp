@@ -1,152 +1,330 @@
 #include "shadow_mapping.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 #include "../camera.hpp"
+#include "../gl_profiler.hpp"
+#include "../log.hpp"
 #include "../scene.hpp"
+#include "../zone_profiler.hpp"
 
 namespace ren {
-ShadowMappingRenderer::ShadowMappingRenderer(std::filesystem::path root_dir,
-                                             int const a_shadow_width,
-                                             int const a_shadow_height)
-    : shadow_width(a_shadow_width), shadow_height(a_shadow_height) {
+namespace {
+
+// view directions and up vectors of the cube faces, in the order and
+// orientation of GL_TEXTURE_CUBE_MAP_POSITIVE_X + face
+std::array<std::pair<glm::vec3, glm::vec3>, 6> const cube_faces{{
+    {glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, -1.f, 0.f)},
+    {glm::vec3(-1.f, 0.f, 0.f), glm::vec3(0.f, -1.f, 0.f)},
+    {glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.f, 0.f, 1.f)},
+    {glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, 0.f, -1.f)},
+    {glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f, -1.f, 0.f)},
+    {glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, -1.f, 0.f)},
+}};
+
+int floor_power_of_two(int x) {
+  int p = 1;
+  while (p * 2 <= x)
+    p *= 2;
+  return p;
+}
+
+} // namespace
+
+ShadowMappingRenderer::ShadowMappingRenderer(
+    std::filesystem::path root_dir, std::size_t shadow_budget_bytes,
+    std::shared_ptr<GeometryArena> arena)
+    : m_batcher(std::move(arena)), m_atlas(shadow_budget_bytes),
+      m_budget_mib(static_cast<int>(shadow_budget_bytes >> 20)) {
   m_solid_shader = ren::Shader(root_dir / "shaders/solid_color.vert",
                                root_dir / "shaders/solid_color.frag");
-  assert(m_solid_shader.success());
   m_depth_shader = ren::Shader(root_dir / "shaders/point_shadow_depth.vert",
-                               root_dir / "shaders/point_shadow_depth.frag",
-                               root_dir / "shaders/point_shadow_depth.geom");
-  assert(m_depth_shader.success());
+                               root_dir / "shaders/point_shadow_depth.frag");
   m_shadow_shader = ren::Shader(root_dir / "shaders/shadows.vert",
                                 root_dir / "shaders/shadows.frag");
-  assert(m_shadow_shader.success());
 
   glEnable(GL_DEPTH_TEST);
+  m_shadow_proj =
+      glm::perspective(glm::radians(90.0f), 1.f, near_plane, far_plane);
+}
+
+void ShadowMappingRenderer::place_lights(Scene const &scene,
+                                         Transformations const &trans) {
+  auto const n = std::min<std::size_t>(scene.lights().size(), max_lights);
+  for (auto i = n; i < m_lights.size(); ++i)
+    for (auto const &tile : m_lights[i].tiles)
+      m_atlas.release(tile);
+  m_lights.resize(n);
+
+  auto const frustum =
+      Frustum::from_matrix(trans.projection * trans.cam->view());
+  auto const cam_pos = trans.cam->pos();
+  bool repack = false;
+  for (std::size_t i = 0; i < n; ++i) {
+    auto const &object = scene.lights()[i];
+    auto &light = m_lights[i];
+    if (object.revision() != light.revision) {
+      light.revision = object.revision();
+      light.pos = object.translation();
+      for (int face = 0; face < 6; ++face) {
+        auto const &[dir, up] = cube_faces[face];
+        light.transforms[face] =
+            m_shadow_proj * glm::lookAt(light.pos, light.pos + dir, up);
+        light.frusta[face] = Frustum::from_matrix(light.transforms[face]);
+      }
+      light.dirty.fill(true);
+    }
+
+    // pixel diameter of the sphere the light casts shadows in
+    auto const range = glm::vec3(far_plane);
+    auto const d = glm::length(light.pos - cam_pos);
+    if (frustum.outside(Aabb{light.pos - range, light.pos + range}))
+      light.importance = 0.f;
+    else if (d <= far_plane)
+      light.importance = static_cast<float>(trans.screen_height);
+    else
+      light.importance = trans.screen_height * trans.projection[1][1] *
+                         far_plane /
+                         std::sqrt(d * d - far_plane * far_plane);
+
+    auto const wanted = floor_power_of_two(static_cast<int>(
+        std::clamp(light.importance, static_cast<float>(m_min_resolution),
+                   static_cast<float>(m_max_resolution))));
+    repack = repack || wanted != light.wanted;
+    light.wanted = wanted;
+  }
+  if (!repack)
+    return;
+
+  // most important first, each at the resolution it wants or the largest
+  // below that still fits
+  std::vector<std::size_t> order(n);
+  for (std::size_t i = 0; i < n; ++i)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) {
+    return m_lights[a].importance > m_lights[b].importance;
+  });
+  auto const previous = m_lights;
+  m_atlas.release_all();
+  for (auto const i : order) {
+    auto &light = m_lights[i];
+    auto resolution = light.wanted;
+    light.resolution = 0;
+    light.tiles = {};
+    for (; resolution >= ShadowAtlas::min_tile && light.resolution == 0;
+         resolution /= 2) {
+      int placed = 0;
+      for (; placed < 6; ++placed) {
+        auto const tile = m_atlas.allocate(resolution);
+        if (!tile)
+          break;
+        light.tiles[placed] = *tile;
+      }
+      if (placed == 6) {
+        light.resolution = resolution;
+        break;
+      }
+      for (int face = 0; face < placed; ++face)
+        m_atlas.release(light.tiles[face]);
+      light.tiles = {};
+    }
+    if (light.resolution == 0)
+      Log::the().add_log("ShadowMappingRenderer: no room for light %zu\n", i);
+
+    // a face keeps its map when it kept its tile
+    for (int face = 0; face < 6; ++face) {
+      auto const &was = previous[i].tiles[face];
+      auto const &is = light.tiles[face];
+      light.drawn[face] = previous[i].drawn[face] && was.x == is.x &&
+                          was.y == is.y && was.size == is.size &&
+                          is.size > 0;
+    }
+  }
+}
+
+void ShadowMappingRenderer::draw_face(ShadowLight const &light, int face) {
+  m_atlas.begin_tile(light.tiles[face]);
+  m_depth_shader.set("light_pos", light.pos);
+  m_depth_shader.set("shadow_matrix", light.transforms[face]);
+  m_culler.cull(light.frusta[face], m_visible);
+  m_batcher.draw_objects(m_visible);
+  m_caster_draws += m_visible.size();
+  ++m_faces_drawn;
+}
+
+void ShadowMappingRenderer::update_shadow_maps(Scene const &scene) {
+  REN_ZONE("update_shadow_maps");
+  auto const &objects = scene.objects();
 
-  glGenFramebuffers(1, &m_depth_map_FBO);
-  glGenTextures(1, &m_depth_cubemap);
-
-  glBindTexture(GL_TEXTURE_CUBE_MAP, m_depth_cubemap);
-  for (GLuint i = 0; i < 6; i++)
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT,
-                 shadow_width, shadow_height, 0, GL_DEPTH_COMPONENT, GL_FLOAT,
-                 NULL);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-  glBindFramebuffer(GL_FRAMEBUFFER, m_depth_map_FBO);
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depth_cubemap, 0);
-  glDrawBuffer(GL_NONE);
-  glReadBuffer(GL_NONE);
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  float const shadow_aspect =
-      static_cast<float>(shadow_width) / static_cast<float>(shadow_height);
-  m_shadow_proj = glm::perspective(glm::radians(90.0f), shadow_aspect,
-                                   near_plane, far_plane);
-  auto light_pos = glm::vec3(1.f);
-  m_shadow_transforms.push_back(
-      m_shadow_proj * glm::lookAt(light_pos,
-                                  light_pos + glm::vec3(1.0f, 0.0f, 0.0f),
-                                  glm::vec3(0.0f, -1.0f, 0.0f)));
-  m_shadow_transforms.push_back(
-      m_shadow_proj * glm::lookAt(light_pos,
-                                  light_pos + glm::vec3(-1.0f, 0.0f, 0.0f),
-                                  glm::vec3(0.0f, -1.0f, 0.0f)));
-  m_shadow_transforms.push_back(
-      m_shadow_proj * glm::lookAt(light_pos,
-                                  light_pos + glm::vec3(0.0f, 1.0f, 0.0f),
-                                  glm::vec3(0.0f, 0.0f, 1.0f)));
-  m_shadow_transforms.push_back(
-      m_shadow_proj * glm::lookAt(light_pos,
-                                  light_pos + glm::vec3(0.0f, -1.0f, 0.0f),
-                                  glm::vec3(0.0f, 0.0f, -1.0f)));
-  m_shadow_transforms.push_back(
-      m_shadow_proj * glm::lookAt(light_pos,
-                                  light_pos + glm::vec3(0.0f, 0.0f, 1.0f),
-                                  glm::vec3(0.0f, -1.0f, 0.0f)));
-  m_shadow_transforms.push_back(
-      m_shadow_proj * glm::lookAt(light_pos,
-                                  light_pos + glm::vec3(0.0f, 0.0f, -1.0f),
-                                  glm::vec3(0.0f, -1.0f, 0.0f)));
+  auto const caster_of = [](Object const &obj) {
+    return Caster{obj.mesh(), obj.revision(), obj.world_bounds()};
+  };
+
+  if (!m_cache_shadow_map || m_casters.size() != objects.size()) {
+    m_casters.clear();
+    for (auto const &obj : objects)
+      m_casters.push_back(caster_of(obj));
+    for (auto &light : m_lights)
+      light.dirty.fill(true);
+  } else {
+    // a moved caster invalidates the faces it was and is visible in
+    for (std::size_t i = 0; i < objects.size(); ++i) {
+      auto &caster = m_casters[i];
+      auto const &obj = objects[i];
+      if (caster.mesh == obj.mesh() && caster.revision == obj.revision())
+        continue;
+      auto const updated = caster_of(obj);
+      for (auto &light : m_lights)
+        for (int face = 0; face < 6; ++face)
+          light.dirty[face] = light.dirty[face] ||
+                              !light.frusta[face].outside(caster.bounds) ||
+                              !light.frusta[face].outside(updated.bounds);
+      caster = updated;
+    }
+  }
+
+  m_faces_drawn = 0;
+  m_caster_draws = 0;
+  auto const pending = [](ShadowLight const &light, int face) {
+    return light.resolution > 0 && (light.dirty[face] || !light.drawn[face]);
+  };
+  auto const budget =
+      m_faces_per_frame > 0 ? m_faces_per_frame : 6 * max_lights;
+
+  auto const timer = GlProfiler::the().scope("shadow atlas");
+  auto const n = m_lights.size();
+  bool bound = false;
+  // faces without a map first, then the stale ones round robin
+  for (int pass = 0; pass < 2; ++pass) {
+    for (std::size_t k = 0; k < n && m_faces_drawn < budget; ++k) {
+      auto const i = (m_next_light + k) % n;
+      auto &light = m_lights[i];
+      for (int face = 0; face < 6 && m_faces_drawn < budget; ++face) {
+        if (!pending(light, face) || (pass == 0 && light.drawn[face]))
+          continue;
+        if (!bound) {
+          m_depth_shader.use();
+          m_depth_shader.set("far_plane", far_plane);
+          bound = true;
+        }
+        draw_face(light, face);
+        light.dirty[face] = false;
+        light.drawn[face] = true;
+        if (pass == 1)
+          m_next_light = (i + 1) % n;
+      }
+    }
+  }
+  if (bound)
+    m_atlas.end_tiles();
+
+  m_faces_pending = 0;
+  for (auto const &light : m_lights)
+    for (int face = 0; face < 6; ++face)
+      m_faces_pending += pending(light, face);
 }
 
 void ShadowMappingRenderer::render(const Scene &scene,
                                    Transformations const &trans, double ticks) {
+  REN_ZONE("ShadowMappingRenderer::render");
 
   assert(trans.cam);
-  auto const &light = scene.lights().at(0);
-  auto const light_pos = light.translation();
-  m_shadow_transforms[0] =
-      (m_shadow_proj * glm::lookAt(light_pos,
-                                   light_pos + glm::vec3(1.0f, 0.0f, 0.0f),
-                                   glm::vec3(0.0f, -1.0f, 0.0f)));
-  m_shadow_transforms[1] =
-      (m_shadow_proj * glm::lookAt(light_pos,
-                                   light_pos + glm::vec3(-1.0f, 0.0f, 0.0f),
-                                   glm::vec3(0.0f, -1.0f, 0.0f)));
-  m_shadow_transforms[2] =
-      (m_shadow_proj * glm::lookAt(light_pos,
-                                   light_pos + glm::vec3(0.0f, 1.0f, 0.0f),
-                                   glm::vec3(0.0f, 0.0f, 1.0f)));
-  m_shadow_transforms[3] =
-      (m_shadow_proj * glm::lookAt(light_pos,
-                                   light_pos + glm::vec3(0.0f, -1.0f, 0.0f),
-                                   glm::vec3(0.0f, 0.0f, -1.0f)));
-  m_shadow_transforms[4] =
-      (m_shadow_proj * glm::lookAt(light_pos,
-                                   light_pos + glm::vec3(0.0f, 0.0f, 1.0f),
-                                   glm::vec3(0.0f, -1.0f, 0.0f)));
-  m_shadow_transforms[5] =
-      (m_shadow_proj * glm::lookAt(light_pos,
-                                   light_pos + glm::vec3(0.0f, 0.0f, -1.0f),
-                                   glm::vec3(0.0f, -1.0f, 0.0f)));
-
-  // 1. render scene to depth cubemap
-  // --------------------------------
-  glViewport(0, 0, shadow_width, shadow_height);
-  glBindFramebuffer(GL_FRAMEBUFFER, m_depth_map_FBO);
-  glClear(GL_DEPTH_BUFFER_BIT);
-  m_depth_shader.use();
-  for (unsigned int i = 0; i < 6; ++i)
-    m_depth_shader.set(("shadow_matrices[" + std::to_string(i) + "]").c_str(),
-                       m_shadow_transforms[i]);
-  m_depth_shader.set("far_plane", far_plane);
-  m_depth_shader.set("light_pos", light_pos);
-  m_depth_shader.use();
-  for (auto const &obj : scene.objects()) {
-    m_depth_shader.set("model", obj.model());
-    obj.draw();
-  }
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  auto const light_pos = scene.lights().at(0).translation();
+
+  // both passes draw from the same instance data and bounds
+  m_batcher.prepare(scene.objects());
+  m_culler.gather(scene.objects());
+
+  // 1. render the lights' cube faces into the atlas
+  // -----------------------------------------------
+  place_lights(scene, trans);
+  update_shadow_maps(scene);
 
   // 2. render scene as normal
   // -------------------------
+  auto const timer = GlProfiler::the().scope("lighting");
   glViewport(0, 0, trans.screen_width, trans.screen_height);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  m_frame.update({trans.projection, trans.cam->view(),
+                  glm::vec4(trans.cam->pos(), 1.f), glm::vec4(light_pos, 1.f),
+                  glm::vec4(1.f)});
+
   m_shadow_shader.use();
-  m_shadow_shader.set("projection", trans.projection);
-  m_shadow_shader.set("view", trans.cam->view());
-  // set lighting uniforms
-  m_shadow_shader.set("light.position", light_pos);
-  m_shadow_shader.set("view_pos", trans.cam->pos());
   m_shadow_shader.set("far_plane", far_plane);
-
   m_shadow_shader.set<GLuint>("depth_map", 0);
+  m_shadow_shader.set<int>("n_lights", static_cast<int>(m_lights.size()));
+  std::array<glm::vec3, max_lights> positions{};
+  std::array<glm::vec4, max_lights * 6> rects{};
+  for (std::size_t i = 0; i < m_lights.size(); ++i) {
+    auto const &light = m_lights[i];
+    positions[i] = light.pos;
+    // an empty rect until the face has a map, the light is unshadowed there
+    for (int face = 0; face < 6; ++face)
+      if (light.drawn[face])
+        rects[i * 6 + face] = m_atlas.rect(light.tiles[face]);
+  }
+  // both arrays in one call each
+  auto const n_lights = static_cast<GLsizei>(m_lights.size());
+  glUniform3fv(m_shadow_shader.location("light_pos"), n_lights,
+               glm::value_ptr(positions[0]));
+  glUniform4fv(m_shadow_shader.location("face_rect"), n_lights * 6,
+               glm::value_ptr(rects[0]));
   glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, m_depth_cubemap);
+  glBindTexture(GL_TEXTURE_2D, m_atlas.texture());
+  GlProfiler::the().count_state_change();
 
-  m_shadow_shader.use();
-  for (auto const &obj : scene.objects()) {
-    m_shadow_shader.set("model", obj.model());
-    obj.draw();
-  }
+  m_culler.cull(Frustum::from_matrix(trans.projection * trans.cam->view()),
+                m_visible);
+  m_visible_objects = m_visible.size();
+  m_batcher.draw_objects(m_visible);
 
   m_solid_shader.use();
   m_solid_shader.set<glm::mat4>("projection", trans.projection);
   m_solid_shader.set<glm::mat4>("view", trans.cam->view());
-  m_solid_shader.set<glm::mat4>("model", light.model());
   m_solid_shader.set<glm::vec3>("color", {1.f, 1.f, 1.f});
-  scene.lights().front().draw();
+  for (auto const &light : scene.lights()) {
+    m_solid_shader.set<glm::mat4>("model", light.model());
+    light.draw();
+  }
+}
+
+void ShadowMappingRenderer::draw_dialog() {
+  ImGui::Text("Simple Shadow Maps");
+  ImGui::Checkbox("Cache shadow map", &m_cache_shadow_map);
+  if (ImGui::SliderInt("Atlas budget (MiB)", &m_budget_mib, 1, 512)) {
+    m_atlas.set_budget(static_cast<std::size_t>(m_budget_mib) << 20);
+    for (auto &light : m_lights) {
+      light.wanted = 0;
+      light.resolution = 0;
+      light.tiles = {};
+      light.drawn = {};
+    }
+  }
+  ImGui::SliderInt("Faces per frame", &m_faces_per_frame, 0, 6 * max_lights);
+  ImGui::SliderInt("Min face size", &m_min_resolution, ShadowAtlas::min_tile,
+                   m_max_resolution);
+  ImGui::SliderInt("Max face size", &m_max_resolution, m_min_resolution,
+                   m_atlas.size() / 2);
+  ImGui::Text("atlas %dx%d, %zu MiB, %.0f%% used", m_atlas.size(),
+              m_atlas.size(), m_atlas.bytes() >> 20,
+              100.0 * m_atlas.texels_used() /
+                  (static_cast<double>(m_atlas.size()) * m_atlas.size()));
+  for (std::size_t i = 0; i < m_lights.size(); ++i)
+    ImGui::Text("light %zu: %d px faces, importance %.0f", i,
+                m_lights[i].resolution, m_lights[i].importance);
+  ImGui::Text("faces drawn %d, pending %d, caster draws %d", m_faces_drawn,
+              m_faces_pending, m_caster_draws);
+  ImGui::Text("%zu batches for %zu objects", m_batcher.batches().size(),
+              m_batcher.n_instances());
+  ImGui::Text("%zu of %zu objects in view", m_visible_objects,
+              m_culler.size());
+  if (auto const &arena = m_batcher.arena()) {
+    ImGui::Text("arena: %zu meshes, %zu vertices, %zu indices",
+                arena->n_meshes(), arena->vertices_used(),
+                arena->indices_used());
+    ImGui::Text("%zu GL draws%s", arena->n_gl_draws(),
+                arena->multi_draw_indirect() ? " (multi draw indirect)" : "");
+  }
 }
 } // namespace ren
@@ -1,7 +1,14 @@
 #pragma once
 
+#include "../bounds.hpp"
+#include "../culling.hpp"
+#include "../instancing.hpp"
 #include "../renderer.hpp"
+#include "../shadow_atlas.hpp"
+#include "../uniform_buffer.hpp"
 
+#include <array>
+#include <cstdint>
 #include <vector>
 
 // clang-format off
@@ -11,31 +18,81 @@
 
 namespace ren {
 
+// Point light shadows for up to max_lights lights, their cube faces are
+// tiles of one ShadowAtlas. A light's face resolution follows how large its
+// range appears on screen, halved until everything fits the atlas. Faces
+// are only redrawn when the light or a caster in them changed, and at most
+// faces_per_frame of them per frame, the rest wait their turn.
 class ShadowMappingRenderer final : public Renderer {
 public:
+  // must match shaders/shadows.frag
+  static constexpr int max_lights = 8;
+
   ShadowMappingRenderer(std::filesystem::path root_dir,
-                        int const a_shadow_width, int const a_shadow_height);
+                        std::size_t shadow_budget_bytes,
+                        std::shared_ptr<GeometryArena> arena = nullptr);
   ~ShadowMappingRenderer() = default;
   void render(const Scene &, Transformations const &, double ticks) override;
-  void draw_dialog() override { ImGui::Text("Simple Shadow Maps"); }
+  void draw_dialog() override;
+  bool ready() const override {
+    return m_solid_shader.ready() && m_depth_shader.ready() &&
+           m_shadow_shader.ready();
+  }
 
 private:
+  // a caster as it was when the shadow maps were last drawn
+  struct Caster {
+    Mesh const *mesh;
+    std::uint64_t revision;
+    Aabb bounds; // world space
+  };
+
+  struct ShadowLight {
+    glm::vec3 pos{0.f};
+    std::uint64_t revision{~std::uint64_t{0}};
+    float importance{0.f}; // projected size of its range in pixels
+    int wanted{0};         // resolution by importance
+    int resolution{0};     // per face, 0 when it has no tiles
+    std::array<ShadowAtlas::Tile, 6> tiles{};
+    std::array<glm::mat4, 6> transforms{};
+    std::array<Frustum, 6> frusta{};
+    std::array<bool, 6> dirty{};
+    std::array<bool, 6> drawn{}; // holds a depth map of the current tile
+  };
+
+  void place_lights(Scene const &scene, Transformations const &trans);
+  void update_shadow_maps(Scene const &scene);
+  void draw_face(ShadowLight const &light, int face);
+
   Shader m_solid_shader;
   Shader m_depth_shader;
   Shader m_shadow_shader;
 
-  GLuint m_depth_map_FBO;
-  GLuint m_depth_cubemap;
+  FrameUniformBuffer m_frame;
+  InstanceBatcher m_batcher;
+  FrustumCuller m_culler;
+  ShadowAtlas m_atlas;
 
   float near_plane = 1.0f;
   float far_plane = 25.0f;
 
-  int const shadow_width{};
-  int const shadow_height{};
-
   glm::mat4 m_shadow_proj;
 
-  std::vector<glm::mat4> m_shadow_transforms;
+  std::vector<ShadowLight> m_lights;
+  int m_budget_mib;
+  int m_min_resolution{128};
+  int m_max_resolution{1024};
+  int m_faces_per_frame{12};
+  std::size_t m_next_light{0}; // round robin start of the face updates
+
+  // the maps are only redrawn where a light or a caster changed
+  bool m_cache_shadow_map{true};
+  std::vector<Caster> m_casters;
+  std::vector<std::size_t> m_visible;
+  int m_faces_drawn{0};
+  int m_faces_pending{0};
+  int m_caster_draws{0};
+  std::size_t m_visible_objects{0};
 };
 
-} // namespace ren
\ No newline at end of file
+} // namespace ren
@@ -1,26 +1,80 @@
 #include "shadow_volume.hpp"
+
 #include <glm/gtx/quaternion.hpp>
 
+#include "../gl_profiler.hpp"
+#include "../zone_profiler.hpp"
+
 namespace ren {
+
+namespace {
+
+// same offset the geometry shader uses to keep the caps off the surface
+constexpr float volume_epsilon = 0.005f;
+
+// The volume is the caster's box swept away from the light. It is outside a
+// plane if every corner is and none of them moves towards the plane.
+bool volume_outside(Frustum const &frustum, Aabb const &caster,
+                    glm::vec3 const &light) {
+  auto const corners = caster.corners();
+  for (auto const &plane : frustum.planes) {
+    auto const n = glm::vec3(plane);
+    bool outside = true;
+    for (auto const &c : corners) {
+      if (glm::dot(n, c) + plane.w >= 0.f || glm::dot(n, c - light) > 0.f) {
+        outside = false;
+        break;
+      }
+    }
+    if (outside)
+      return true;
+  }
+  return false;
+}
+
+bool segment_hits_box(glm::vec3 const &from, glm::vec3 const &to,
+                      Aabb const &box) {
+  auto const d = to - from;
+  float t_min = 0.f, t_max = 1.f;
+  for (int i = 0; i < 3; ++i) {
+    if (std::abs(d[i]) < 1e-8f) {
+      if (from[i] < box.min[i] || from[i] > box.max[i])
+        return false;
+      continue;
+    }
+    auto t0 = (box.min[i] - from[i]) / d[i];
+    auto t1 = (box.max[i] - from[i]) / d[i];
+    if (t0 > t1)
+      std::swap(t0, t1);
+    t_min = std::max(t_min, t0);
+    t_max = std::min(t_max, t1);
+    if (t_min > t_max)
+      return false;
+  }
+  return true;
+}
+
+std::uint64_t volume_key(std::size_t light, std::size_t object) {
+  return static_cast<std::uint64_t>(light) << 32 | object;
+}
+
+} // namespace
 ShadowVolumeRenderer::ShadowVolumeRenderer(
     std::filesystem::path root_dir, Transformations const &transformations) {
   m_solid_shader = ren::Shader(root_dir / "shaders/solid_color.vert",
                                root_dir / "shaders/solid_color.frag");
-  assert(m_solid_shader.success());
   m_first_pass = ren::Shader(root_dir / "shaders/vs_first_pass.vert",
                              root_dir / "shaders/vs_first_pass.frag");
-  assert(m_first_pass.success());
   m_complete = ren::Shader(root_dir / "shaders/vs_complete.vert",
                            root_dir / "shaders/vs_complete.frag");
-  assert(m_complete.success());
   m_shadow_volume = ren::Shader(root_dir / "shaders/shadow_volume.vert",
                                 root_dir / "shaders/shadow_volume.frag",
                                 root_dir / "shaders/shadow_volume.geom");
-  assert(m_shadow_volume.success());
+  m_cached_volume = ren::Shader(root_dir / "shaders/shadow_volume_cached.vert",
+                                root_dir / "shaders/shadow_volume.frag");
 
   m_material = ren::Shader(root_dir / "shaders/material.vert",
                            root_dir / "shaders/material.frag");
-  assert(m_material.success());
 }
 void ShadowVolumeRenderer::render_into_depth(Scene const &scene,
                                              Transformations const &trans) {
@@ -32,15 +86,163 @@ void ShadowVolumeRenderer::render_into_depth(Scene const &scene,
 
   m_first_pass.set("projection", trans.projection);
   m_first_pass.set("view", trans.cam->view());
-  for (auto const &obj : scene.objects()) {
+  for (auto const i : m_visible) {
+    auto const &obj = scene.objects()[i];
     m_first_pass.set("model", obj.model());
     obj.draw();
   }
 
   glEnable(GL_STENCIL_TEST);
 }
+ShadowVolumeRenderer::MeshEdges const *
+ShadowVolumeRenderer::edges_for(Object const &obj) {
+  auto const &mesh = obj.shared_mesh();
+  if (mesh == nullptr || !mesh->has_adjacencies())
+    return nullptr;
+
+  auto &edges = m_edges[mesh.get()];
+  if (!edges.mesh.expired())
+    return &edges;
+  // released before this renderer saw it, the geometry shader extrudes it
+  if (!mesh->has_cpu_data()) {
+    m_edges.erase(mesh.get());
+    return nullptr;
+  }
+
+  auto const &verts = mesh->vertices();
+  auto const &indices = mesh->indices();
+  auto const n_tris = indices.size() / 6;
+  edges = MeshEdges{};
+  edges.mesh = mesh;
+  edges.n_triangles = n_tris;
+  edges.corners.resize(n_tris * 3);
+  for (auto *v : {&edges.face_x, &edges.face_y, &edges.face_z, &edges.face_d})
+    v->resize(n_tris);
+  for (auto *v : {&edges.adjacent_x, &edges.adjacent_y, &edges.adjacent_z,
+                  &edges.adjacent_d})
+    v->resize(n_tris * 3);
+
+  for (std::size_t t = 0; t < n_tris; ++t) {
+    auto const *tri = &indices[t * 6];
+    for (int k = 0; k < 3; ++k)
+      edges.corners[t * 3 + k] = verts[tri[k * 2]].pos;
+
+    auto const &p0 = edges.corners[t * 3];
+    auto const n =
+        glm::cross(edges.corners[t * 3 + 1] - p0, edges.corners[t * 3 + 2] - p0);
+    edges.face_x[t] = n.x;
+    edges.face_y[t] = n.y;
+    edges.face_z[t] = n.z;
+    edges.face_d[t] = -glm::dot(n, p0);
+
+    // the triangle across edge k is (start, adjacent, end)
+    for (int k = 0; k < 3; ++k) {
+      auto const &start = edges.corners[t * 3 + k];
+      auto const &end = edges.corners[t * 3 + (k + 1) % 3];
+      auto const &adjacent = verts[tri[k * 2 + 1]].pos;
+      auto const an = glm::cross(adjacent - start, end - start);
+      auto const h = t * 3 + k;
+      edges.adjacent_x[h] = an.x;
+      edges.adjacent_y[h] = an.y;
+      edges.adjacent_z[h] = an.z;
+      edges.adjacent_d[h] = -glm::dot(an, start);
+    }
+  }
+  return &edges;
+}
+
+void ShadowVolumeRenderer::update_volume(CachedVolume &volume,
+                                         Object const &light,
+                                         Object const &obj,
+                                         MeshEdges const &edges) {
+  volume.light_revision = light.revision();
+  volume.object_revision = obj.revision();
+  volume.mesh = obj.shared_mesh();
+
+  auto const &model = obj.model();
+  auto const l = glm::vec3(glm::inverse(model) *
+                           glm::vec4(light.translation(), 1.f));
+  auto const n_tris = edges.n_triangles;
+  auto const n_half_edges = n_tris * 3;
+
+  // plane tests over the flat arrays, branch free so they vectorize
+  m_facing.resize(n_tris);
+  for (std::size_t t = 0; t < n_tris; ++t)
+    m_facing[t] = edges.face_x[t] * l.x + edges.face_y[t] * l.y +
+                      edges.face_z[t] * l.z + edges.face_d[t] >
+                  0.f;
+  m_adjacent_facing.resize(n_half_edges);
+  for (std::size_t h = 0; h < n_half_edges; ++h)
+    m_adjacent_facing[h] = edges.adjacent_x[h] * l.x +
+                               edges.adjacent_y[h] * l.y +
+                               edges.adjacent_z[h] * l.z + edges.adjacent_d[h] >
+                           0.f;
+
+  auto const near = [&](glm::vec3 const &p) {
+    return glm::vec4(p + glm::normalize(p - l) * volume_epsilon, 1.f);
+  };
+  auto const far = [&](glm::vec3 const &p) {
+    return glm::vec4(glm::normalize(p - l), 0.f);
+  };
+
+  // side quads on the silhouette edges, wound like the geometry shader's
+  auto &out = m_volume_vertices;
+  out.clear();
+  for (std::size_t t = 0; t < n_tris; ++t) {
+    if (!m_facing[t])
+      continue;
+    for (std::size_t k = 0; k < 3; ++k) {
+      if (m_adjacent_facing[t * 3 + k])
+        continue;
+      auto const &start = edges.corners[t * 3 + k];
+      auto const &end = edges.corners[t * 3 + (k + 1) % 3];
+      out.insert(out.end(), {near(start), far(start), near(end), near(end),
+                             far(start), far(end)});
+    }
+  }
+  volume.n_side_vertices = static_cast<GLsizei>(out.size());
+
+  // front cap on the lit triangles, back cap at infinity
+  for (std::size_t t = 0; t < n_tris; ++t) {
+    if (!m_facing[t])
+      continue;
+    auto const *c = &edges.corners[t * 3];
+    out.insert(out.end(), {near(c[0]), near(c[1]), near(c[2]), far(c[0]),
+                           far(c[2]), far(c[1])});
+  }
+  volume.n_vertices = static_cast<GLsizei>(out.size());
+
+  if (volume.VAO == 0) {
+    glGenVertexArrays(1, &volume.VAO);
+    glGenBuffers(1, &volume.VBO);
+    glBindVertexArray(volume.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, volume.VBO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4),
+                          (void *)0);
+    glBindVertexArray(0);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, volume.VBO);
+  glBufferData(GL_ARRAY_BUFFER, out.size() * sizeof(glm::vec4), out.data(),
+               GL_DYNAMIC_DRAW);
+  GlProfiler::the().count_upload(out.size() * sizeof(glm::vec4));
+
+  // world space bounds of the caster for culling
+  volume.bounds = obj.world_bounds();
+}
+
+void ShadowVolumeRenderer::release_volumes() {
+  for (auto &[key, volume] : m_volumes) {
+    glDeleteVertexArrays(1, &volume.VAO);
+    glDeleteBuffers(1, &volume.VBO);
+  }
+  m_volumes.clear();
+  m_edges.clear();
+}
+
 void ShadowVolumeRenderer::render_shadow_volume_into_stencil(
     Scene const &scene, Transformations const &trans) {
+  REN_ZONE("render_shadow_volume_into_stencil");
 
   // Render shadow volume into stencil
 
@@ -52,17 +254,109 @@ void ShadowVolumeRenderer::render_shadow_volume_into_stencil(
   // to succeed always. Only the depth test matters.
   glStencilFunc(GL_ALWAYS, 0, 0xFF);
 
-  glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
-  glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+  m_stats = Stats{};
+  auto const &light = scene.lights().at(0);
+  auto const light_pos = light.translation();
+  auto const view = trans.cam->view();
+  auto const view_proj = trans.projection * view;
+  auto const frustum = Frustum::from_matrix(view_proj);
 
-  m_shadow_volume.use();
-  m_shadow_volume.set<vec3>("gLightPos", scene.lights().at(0).translation());
-  // Render the occluder
-  m_shadow_volume.set("projection", trans.projection);
-  m_shadow_volume.set("view", trans.cam->view());
-  for (auto const &obj : scene.objects()) {
-    m_shadow_volume.set("model", obj.model());
-    obj.draw();
+  // every point of the near plane is within this distance of the camera
+  auto const inv_view_proj = glm::inverse(view_proj);
+  auto const cam_pos = trans.cam->pos();
+  float near_radius = 0.f;
+  for (auto const &ndc : Aabb{vec3(-1.f), vec3(1.f, 1.f, -1.f)}.corners()) {
+    auto const p = inv_view_proj * glm::vec4(ndc, 1.f);
+    near_radius =
+        std::max(near_radius, glm::length(glm::vec3(p) / p.w - cam_pos));
+  }
+
+  std::vector<Object const *> uncached;
+  m_cached_volume.use();
+  m_cached_volume.set("projection", trans.projection);
+  m_cached_volume.set("view", view);
+  auto const &objects = scene.objects();
+  for (std::size_t i = 0; i < objects.size(); ++i) {
+    auto const &obj = objects[i];
+    auto const *edges = m_cache_volumes ? edges_for(obj) : nullptr;
+    if (edges == nullptr) {
+      uncached.push_back(&obj);
+      continue;
+    }
+
+    auto &volume = m_volumes[volume_key(0, i)];
+    if (volume.light_revision != light.revision() ||
+        volume.object_revision != obj.revision() ||
+        volume.mesh.lock() != obj.shared_mesh()) {
+      update_volume(volume, light, obj, *edges);
+      ++m_stats.rebuilt;
+    }
+    if (volume.n_vertices == 0)
+      continue;
+    if (volume_outside(frustum, volume.bounds, light_pos)) {
+      ++m_stats.culled;
+      continue;
+    }
+
+    // z-pass needs no caps but breaks when the camera sits in the volume,
+    // i.e. when the near plane may be in the caster's shadow
+    auto const margin = vec3(near_radius);
+    bool const z_pass = !segment_hits_box(
+        light_pos, cam_pos,
+        Aabb{volume.bounds.min - margin, volume.bounds.max + margin});
+    m_cached_volume.set("model", obj.model());
+    glBindVertexArray(volume.VAO);
+    GlProfiler::the().count_state_change();
+    GlProfiler::the().count_draw();
+    if (z_pass) {
+      glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_KEEP, GL_INCR_WRAP);
+      glStencilOpSeparate(GL_BACK, GL_KEEP, GL_KEEP, GL_DECR_WRAP);
+      glDrawArrays(GL_TRIANGLES, 0, volume.n_side_vertices);
+      ++m_stats.z_pass;
+    } else {
+      glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+      glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+      glDrawArrays(GL_TRIANGLES, 0, volume.n_vertices);
+      ++m_stats.z_fail;
+    }
+  }
+  glBindVertexArray(0);
+
+  // volumes of objects from the cache were removed from the scene
+  for (auto it = m_volumes.begin(); it != m_volumes.end();) {
+    if ((it->first & 0xFFFFFFFF) >= objects.size()) {
+      glDeleteVertexArrays(1, &it->second.VAO);
+      glDeleteBuffers(1, &it->second.VBO);
+      it = m_volumes.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  // edges of meshes freed with their last object
+  for (auto it = m_edges.begin(); it != m_edges.end();) {
+    if (it->second.mesh.expired())
+      it = m_edges.erase(it);
+    else
+      ++it;
+  }
+
+  // meshes without adjacency data on the CPU are extruded every frame by the
+  // geometry shader
+  if (!uncached.empty()) {
+    glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+    glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+
+    m_shadow_volume.use();
+    m_shadow_volume.set<vec3>("gLightPos", light_pos);
+    // Render the occluder
+    m_shadow_volume.set("projection", trans.projection);
+    m_shadow_volume.set("view", view);
+    for (auto const *obj : uncached) {
+      m_shadow_volume.set("model", obj->model());
+      obj->draw();
+      ++m_stats.geometry_shader;
+    }
   }
 
   glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -87,7 +381,8 @@ void ShadowVolumeRenderer::render_shadowed_scene(Scene const &scene,
 
   m_complete.set<glm::mat4>("projection", trans.projection);
   m_complete.set<glm::mat4>("view", trans.cam->view());
-  for (auto const &obj : scene.objects()) {
+  for (auto const i : m_visible) {
+    auto const &obj = scene.objects()[i];
     m_complete.set<glm::mat4>("model", obj.model());
     m_complete.set<vec3>("objectColor", vec3(0.4f));
     obj.draw();
@@ -106,7 +401,8 @@ void ShadowVolumeRenderer::render_ambient(Scene const &scene,
 
   m_complete.set<glm::mat4>("projection", trans.projection);
   m_complete.set<glm::mat4>("view", trans.cam->view());
-  for (auto const &obj : scene.objects()) {
+  for (auto const i : m_visible) {
+    auto const &obj = scene.objects()[i];
     m_complete.set<glm::mat4>("model", obj.model());
     m_complete.set<vec3>("objectColor", vec3(0.4f));
     obj.draw();
@@ -124,9 +420,10 @@ void ShadowVolumeRenderer::render_lights(Scene const &scene,
   light.draw();
 }
 
-ShadowVolumeRenderer::~ShadowVolumeRenderer() {}
+ShadowVolumeRenderer::~ShadowVolumeRenderer() { release_volumes(); }
 void ShadowVolumeRenderer::render(const Scene &scene,
                                   Transformations const &trans, double ticks) {
+  REN_ZONE("ShadowVolumeRenderer::render");
 
   auto &light = scene.lights().at(0);
   auto const view = trans.cam->view();
@@ -136,13 +433,27 @@ void ShadowVolumeRenderer::render(const Scene &scene,
 
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
   glClearStencil(0);
+
+  // the depth and lighting passes only draw what the camera sees, shadow
+  // volumes are culled on their own since casters out of view still cast
+  m_culler.gather(scene.objects());
+  m_culler.cull(Frustum::from_matrix(trans.projection * view), m_visible);
   glDisable(GL_STENCIL_TEST);
   glEnable(GL_DEPTH_TEST);
 
-  render_into_depth(scene, trans);
-  render_shadow_volume_into_stencil(scene, trans);
-  render_shadowed_scene(scene, trans);
-  render_ambient(scene, trans);
+  {
+    auto const timer = GlProfiler::the().scope("depth");
+    render_into_depth(scene, trans);
+  }
+  {
+    auto const timer = GlProfiler::the().scope("stencil volume");
+    render_shadow_volume_into_stencil(scene, trans);
+  }
+  {
+    auto const timer = GlProfiler::the().scope("lighting");
+    render_shadowed_scene(scene, trans);
+    render_ambient(scene, trans);
+  }
 
   glDisable(GL_BLEND);
 
@@ -152,6 +463,16 @@ void ShadowVolumeRenderer::render(const Scene &scene,
   glDisable(GL_STENCIL_TEST);
   render_lights(scene, trans);
 }
-void ShadowVolumeRenderer::draw_dialog() { ImGui::Text("Shadow Volume"); }
+void ShadowVolumeRenderer::draw_dialog() {
+  ImGui::Text("Shadow Volume");
+  if (ImGui::Checkbox("Cache shadow volumes", &m_cache_volumes) &&
+      !m_cache_volumes)
+    release_volumes();
+  ImGui::Text("rebuilt %d, culled %d, z-pass %d, z-fail %d, geometry shader %d",
+              m_stats.rebuilt, m_stats.culled, m_stats.z_pass, m_stats.z_fail,
+              m_stats.geometry_shader);
+  ImGui::Text("%zu of %zu objects in view", m_visible.size(),
+              m_culler.size());
+}
 
 } // namespace ren
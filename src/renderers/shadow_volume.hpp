@@ -1,5 +1,12 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "../bounds.hpp"
+#include "../culling.hpp"
 #include "../renderer.hpp"
 #include "../texture.hpp"
 
@@ -10,14 +17,67 @@ public:
   ~ShadowVolumeRenderer();
   void render(const Scene &, Transformations const &, double ticks) override;
   void draw_dialog() override;
+  bool ready() const override {
+    return m_solid_shader.ready() && m_first_pass.ready() &&
+           m_complete.ready() && m_shadow_volume.ready() &&
+           m_cached_volume.ready() && m_material.ready();
+  }
 
 private:
+  // Edge data of an adjacency mesh in structure of arrays form, object space.
+  // For every triangle its plane, for every half-edge the plane of the
+  // triangle across it.
+  struct MeshEdges {
+    // a new mesh at the address of a freed one is a miss
+    std::weak_ptr<Mesh> mesh;
+    std::size_t n_triangles{0};
+    std::vector<glm::vec3> corners; // 3 per triangle
+    std::vector<float> face_x, face_y, face_z, face_d;
+    std::vector<float> adjacent_x, adjacent_y, adjacent_z, adjacent_d;
+  };
+
+  // Extruded volume of one (light, object) pair. The buffer holds the side
+  // quads first, then both caps, so z-pass draws a prefix of it.
+  struct CachedVolume {
+    std::uint64_t light_revision{0};
+    std::uint64_t object_revision{0};
+    std::weak_ptr<Mesh> mesh;
+    GLuint VAO{0}, VBO{0};
+    GLsizei n_side_vertices{0};
+    GLsizei n_vertices{0};
+    Aabb bounds; // world space bounds of the caster
+  };
+
+  struct Stats {
+    int rebuilt{0};
+    int culled{0};
+    int z_pass{0};
+    int z_fail{0};
+    int geometry_shader{0};
+  };
+
   Shader m_shadow_volume;
+  Shader m_cached_volume;
   Shader m_complete;
   Shader m_solid_shader;
   Shader m_first_pass;
   Shader m_material;
 
+  bool m_cache_volumes{true};
+  std::unordered_map<Mesh const *, MeshEdges> m_edges;
+  std::unordered_map<std::uint64_t, CachedVolume> m_volumes;
+  std::vector<std::uint8_t> m_facing;
+  std::vector<std::uint8_t> m_adjacent_facing;
+  std::vector<glm::vec4> m_volume_vertices;
+  Stats m_stats;
+  FrustumCuller m_culler;
+  std::vector<std::size_t> m_visible; // objects in the camera frustum
+
+  MeshEdges const *edges_for(Object const &obj);
+  void update_volume(CachedVolume &volume, Object const &light,
+                     Object const &obj, MeshEdges const &edges);
+  void release_volumes();
+
   void render_into_depth(Scene const &scene, Transformations const &trans);
   void render_shadow_volume_into_stencil(Scene const &scene,
                                          Transformations const &trans);
@@ -25,4 +85,4 @@ private:
   void render_ambient(Scene const &scene, Transformations const &trans);
   void render_lights(Scene const &, Transformations const &);
 };
-} // namespace ren
\ No newline at end of file
+} // namespace ren
@@ -1,16 +1,60 @@
 #include "resource_manager.hpp"
 
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "zone_profiler.hpp"
+
 namespace ren {
 
 Image::Image(std::filesystem::path const &path) {
-  stbi_set_flip_vertically_on_load(true);
+  REN_ZONE("Image::Image");
+  // per thread, images are also decoded by the TextureLoader workers
+  stbi_set_flip_vertically_on_load_thread(true);
   m_data = stbi_load(path.c_str(), &m_width, &m_height, &m_n_channels, 0);
   assert(m_data);
 }
 
 Image::~Image() { stbi_image_free(m_data); }
 
+std::shared_ptr<Image>
+ResourceManager::load_image(std::filesystem::path const &path) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string, std::weak_ptr<Image>> images;
+
+  std::error_code error;
+  auto key = std::filesystem::weakly_canonical(path, error).string();
+  if (error)
+    key = path.string();
+
+  // decoded outside the lock, a racing load of the same path wastes one
+  // decode but both get the image that ends up cached
+  {
+    std::lock_guard lock(mutex);
+    if (auto image = images[key].lock())
+      return image;
+  }
+  auto image = std::make_shared<Image>(path);
+  std::lock_guard lock(mutex);
+  auto &cached = images[key];
+  if (auto existing = cached.lock())
+    return existing;
+  cached = image;
+
+  // drop the names of released images now and then
+  static std::size_t prune_at = 64;
+  if (images.size() >= prune_at) {
+    for (auto it = images.begin(); it != images.end();)
+      it = it->second.expired() ? images.erase(it) : std::next(it);
+    prune_at = std::max<std::size_t>(64, images.size() * 2);
+  }
+  return image;
+}
+
 } // namespace ren
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <filesystem>
+#include <memory>
 
 namespace ren {
 
@@ -8,6 +9,8 @@ class Image final {
 public:
   Image(std::filesystem::path const &path);
   ~Image();
+  Image(Image const &) = delete;
+  Image &operator=(Image const &) = delete;
 
   auto *data() { return m_data; }
   auto width() const { return m_width; }
@@ -22,8 +25,11 @@ private:
   unsigned char *m_data;
 };
 
+// Decoded images shared by path. An image stays cached while anyone holds
+// it, GL textures are cached by the TextureLoader. Thread safe.
 class ResourceManager final {
-  static auto load_image(std::filesystem::path const &path);
+public:
+  static std::shared_ptr<Image> load_image(std::filesystem::path const &path);
 };
 
 using rm = ResourceManager;
@@ -1,8 +1,115 @@
 #include "scene.hpp"
 #include "object.hpp"
+#include "parallel.hpp"
 #include "shader.hpp"
+#include "zone_profiler.hpp"
 
 namespace ren {
-void Scene::add_object(Object &&obj) { m_objects.push_back(std::move(obj)); }
-void Scene::add_light(Object &&obj) { m_lights.push_back(std::move(obj)); }
+
+Scene::Handle Scene::add(std::vector<Object> &objects,
+                         std::vector<std::uint32_t> &slots, Object &&obj,
+                         bool light) {
+  std::uint32_t slot;
+  if (!m_free_slots.empty()) {
+    slot = m_free_slots.back();
+    m_free_slots.pop_back();
+  } else {
+    slot = static_cast<std::uint32_t>(m_slots.size());
+    m_slots.push_back({0, 0, false, false});
+  }
+  auto &s = m_slots[slot];
+  s.index = static_cast<std::uint32_t>(objects.size());
+  s.light = light;
+  s.used = true;
+  objects.push_back(std::move(obj));
+  slots.push_back(slot);
+  return {slot, s.generation};
+}
+
+Scene::Handle Scene::add_object(Object &&obj) {
+  return add(m_objects, m_object_slots, std::move(obj), false);
+}
+
+Scene::Handle Scene::add_light(Object &&obj) {
+  return add(m_lights, m_light_slots, std::move(obj), true);
+}
+
+bool Scene::remove(Handle h) {
+  if (get(h) == nullptr)
+    return false;
+  auto &s = m_slots[h.slot];
+  auto &objects = s.light ? m_lights : m_objects;
+  auto &slots = s.light ? m_light_slots : m_object_slots;
+
+  auto const last = objects.size() - 1;
+  if (s.index != last) {
+    objects[s.index] = std::move(objects[last]);
+    slots[s.index] = slots[last];
+    m_slots[slots[s.index]].index = s.index;
+  }
+  objects.pop_back();
+  slots.pop_back();
+
+  s.used = false;
+  ++s.generation;
+  m_free_slots.push_back(h.slot);
+  return true;
+}
+
+Object *Scene::get(Handle h) {
+  return const_cast<Object *>(static_cast<Scene const *>(this)->get(h));
+}
+
+Object const *Scene::get(Handle h) const {
+  if (h.slot >= m_slots.size())
+    return nullptr;
+  auto const &s = m_slots[h.slot];
+  if (!s.used || s.generation != h.generation)
+    return nullptr;
+  return s.light ? &m_lights[s.index] : &m_objects[s.index];
+}
+
+std::size_t Scene::update_transforms() {
+  REN_ZONE("Scene::update_transforms");
+  std::size_t updated = 0;
+  for (auto &light : m_lights) {
+    if (light.transform_dirty()) {
+      light.update_model();
+      ++updated;
+    }
+  }
+
+  m_dirty.clear();
+  for (std::size_t i = 0; i < m_objects.size(); ++i)
+    if (m_objects[i].transform_dirty())
+      m_dirty.push_back(i);
+
+  // objects are independent, so large batches are split over threads
+  auto const update = [&](std::size_t begin, std::size_t end, unsigned) {
+    for (auto i = begin; i < end; ++i)
+      m_objects[m_dirty[i]].update_model();
+  };
+  if (m_dirty.size() < parallel_threshold)
+    update(0, m_dirty.size(), 0);
+  else
+    parallel_for(m_dirty.size(), update);
+  return updated + m_dirty.size();
+}
+
+std::size_t Scene::release_mesh_data() {
+  std::size_t freed = 0;
+  for (auto const *objects : {&m_objects, &m_lights}) {
+    for (auto const &obj : *objects) {
+      auto const &mesh = obj.shared_mesh();
+      // shared meshes are seen once with their data
+      if (mesh == nullptr || !mesh->has_cpu_data())
+        continue;
+      freed += mesh->vertices().capacity() * sizeof(Vertex) +
+               mesh->indices().capacity() * sizeof(GLuint);
+      mesh->release_cpu_data();
+    }
+  }
+  return freed;
+}
+
 } // namespace ren
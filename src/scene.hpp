@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <initializer_list>
 #include <string>
 #include <vector>
@@ -13,21 +14,67 @@ class Shader;
 
 class Scene {
 public:
+  // Refers to an object or light across additions and removals, which move
+  // objects around in their arrays. Once its object is removed the handle
+  // resolves to nullptr, even if the slot is reused.
+  struct Handle {
+    std::uint32_t slot{~0u};
+    std::uint32_t generation{0};
+
+    bool operator==(Handle const &o) const {
+      return slot == o.slot && generation == o.generation;
+    }
+    bool operator!=(Handle const &o) const { return !(*this == o); }
+  };
+
+  // dirty transforms above this many are recomputed on several threads
+  static constexpr std::size_t parallel_threshold = 4096;
+
   Scene() = default;
   // Scene(std::initializer_list<Object&&> l) : m_objects(std::move(l)) {}
-  void add_object(Object &&);
-  void add_light(Object &&);
+  Handle add_object(Object &&);
+  Handle add_light(Object &&);
+  // the last object takes the removed one's place
+  bool remove(Handle);
   // Scene(std::vector<Object> l) : m_objects(l) {}
 
+  Object *get(Handle);
+  Object const *get(Handle) const;
+
+  // index based access, the pointer is invalidated by add and remove
   auto *object_at(size_t index) { return &m_objects.at(index); }
   auto &objects() const { return m_objects; }
   auto &lights() const { return m_lights; }
   auto *light_at(size_t index) { return &m_lights.at(index); }
   auto size() const { return m_objects.size(); }
 
+  // runs update_model() on every object and light whose translation, scale
+  // or rotation changed, returns how many there were
+  std::size_t update_transforms();
+
+  // Mesh::release_cpu_data() on every mesh of the scene, returns the bytes
+  // freed. Opt-in, whatever still needs the CPU copies must take them first.
+  std::size_t release_mesh_data();
+
 private:
+  struct Slot {
+    std::uint32_t index; // into m_objects or m_lights
+    std::uint32_t generation;
+    bool light;
+    bool used;
+  };
+
+  Handle add(std::vector<Object> &objects, std::vector<std::uint32_t> &slots,
+             Object &&obj, bool light);
+
   std::vector<Object> m_objects;
   std::vector<Object> m_lights;
+  // slot of every object and light, parallel to the arrays
+  std::vector<std::uint32_t> m_object_slots;
+  std::vector<std::uint32_t> m_light_slots;
+  std::vector<Slot> m_slots;
+  std::vector<std::uint32_t> m_free_slots;
+  std::vector<std::size_t> m_dirty;
 };
 
 } // namespace ren
@@ -0,0 +1,398 @@
+#include "scene_file.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log.hpp"
+#include "material.hpp"
+#include "mesh_registry.hpp"
+#include "object.hpp"
+#include "scene.hpp"
+#include "zone_profiler.hpp"
+
+namespace ren::scene_file {
+
+static std::uint64_t align_up(std::uint64_t offset) {
+  return (offset + alignment - 1) & ~static_cast<std::uint64_t>(alignment - 1);
+}
+
+// FNV-1a, only used to bucket meshes before a full compare
+static std::uint64_t hash_bytes(void const *data, std::size_t size,
+                                std::uint64_t h = 14695981039346656037ull) {
+  auto const *bytes = static_cast<unsigned char const *>(data);
+  for (std::size_t i = 0; i < size; ++i) {
+    h ^= bytes[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+static bool same_mesh(Mesh const &a, Mesh const &b) {
+  return a.has_adjacencies() == b.has_adjacencies() &&
+         a.vertices().size() == b.vertices().size() &&
+         a.indices().size() == b.indices().size() &&
+         std::memcmp(a.vertices().data(), b.vertices().data(),
+                     a.vertices().size() * sizeof(Vertex)) == 0 &&
+         std::memcmp(a.indices().data(), b.indices().data(),
+                     a.indices().size() * sizeof(GLuint)) == 0;
+}
+
+static void copy3(float *dst, glm::vec3 const &v) {
+  dst[0] = v.x;
+  dst[1] = v.y;
+  dst[2] = v.z;
+}
+
+static glm::vec3 vec(float const *src) { return {src[0], src[1], src[2]}; }
+
+static MaterialRecord make_material_record(Material const &mat) {
+  MaterialRecord rec{};
+  rec.scatter_type = static_cast<std::uint32_t>(ScatterType::none);
+  copy3(rec.ambient, mat.ambient);
+  copy3(rec.diffuse, mat.diffuse);
+  copy3(rec.specular, mat.specular);
+  rec.shininess = mat.shininess;
+
+  if (!mat.scatter)
+    return rec;
+  rec.scatter_type = static_cast<std::uint32_t>(mat.scatter->type());
+  switch (mat.scatter->type()) {
+  case ScatterType::diffuse_light:
+    copy3(rec.albedo, static_cast<diffuse_light const &>(*mat.scatter).emit);
+    break;
+  case ScatterType::lambertian:
+    copy3(rec.albedo, static_cast<lambertian const &>(*mat.scatter).albedo);
+    break;
+  case ScatterType::metal: {
+    auto const &m = static_cast<metal const &>(*mat.scatter);
+    copy3(rec.albedo, m.albedo);
+    rec.parameter = m.fuzz;
+    break;
+  }
+  case ScatterType::dielectric:
+    rec.parameter = static_cast<dielectric const &>(*mat.scatter).ref_idx;
+    break;
+  case ScatterType::none:
+    break;
+  }
+  return rec;
+}
+
+static std::shared_ptr<Material> make_material(MaterialRecord const &rec) {
+  auto const albedo = vec(rec.albedo);
+  std::shared_ptr<Material> mat;
+  switch (static_cast<ScatterType>(rec.scatter_type)) {
+  case ScatterType::diffuse_light:
+    mat = Material::create_material_from_scatter<diffuse_light>(albedo);
+    break;
+  case ScatterType::lambertian:
+    mat = Material::create_material_from_scatter<lambertian>(albedo);
+    break;
+  case ScatterType::metal:
+    mat = Material::create_material_from_scatter<metal>(albedo, rec.parameter);
+    break;
+  case ScatterType::dielectric:
+    mat = Material::create_material_from_scatter<dielectric>(rec.parameter);
+    break;
+  default:
+    mat = std::make_shared<Material>();
+    break;
+  }
+  mat->ambient = vec(rec.ambient);
+  mat->diffuse = vec(rec.diffuse);
+  mat->specular = vec(rec.specular);
+  mat->shininess = rec.shininess;
+  return mat;
+}
+
+bool save(Scene const &scene, std::filesystem::path const &path) {
+  REN_ZONE("scene_file::save");
+  std::vector<ObjectRecord> objects;
+  std::vector<MaterialRecord> materials;
+  std::vector<Mesh const *> meshes;
+
+  std::unordered_map<Material const *, std::uint32_t> material_index;
+  std::unordered_multimap<std::uint64_t, std::uint32_t> mesh_buckets;
+
+  auto const add_mesh = [&](Mesh const *mesh) -> std::uint32_t {
+    if (mesh == nullptr)
+      return no_index;
+    if (!mesh->has_cpu_data()) {
+      Log::the().add_log("scene_file: skipping a mesh without CPU data\n");
+      return no_index;
+    }
+    auto h = hash_bytes(mesh->vertices().data(),
+                        mesh->vertices().size() * sizeof(Vertex));
+    h = hash_bytes(mesh->indices().data(),
+                   mesh->indices().size() * sizeof(GLuint), h);
+    auto [it, end] = mesh_buckets.equal_range(h);
+    for (; it != end; ++it) {
+      if (same_mesh(*meshes[it->second], *mesh))
+        return it->second;
+    }
+    auto const index = static_cast<std::uint32_t>(meshes.size());
+    meshes.push_back(mesh);
+    mesh_buckets.emplace(h, index);
+    return index;
+  };
+
+  auto const add_material = [&](Material const *mat) -> std::uint32_t {
+    if (mat == nullptr)
+      return no_index;
+    auto [it, inserted] = material_index.try_emplace(
+        mat, static_cast<std::uint32_t>(materials.size()));
+    if (inserted)
+      materials.push_back(make_material_record(*mat));
+    return it->second;
+  };
+
+  auto const add_object = [&](Object const &obj, std::uint32_t flags) {
+    ObjectRecord rec{};
+    copy3(rec.translation, obj.translation());
+    copy3(rec.scale, obj.scale());
+    copy3(rec.rotation_vector, obj.rotation_vector());
+    rec.rotation_scale = obj.rotation_scale();
+    rec.type = static_cast<std::uint32_t>(obj.type());
+    rec.mesh = add_mesh(obj.mesh());
+    rec.material = add_material(obj.material().get());
+    rec.flags = flags;
+    objects.push_back(rec);
+  };
+
+  for (auto const &obj : scene.objects())
+    add_object(obj, 0);
+  for (auto const &obj : scene.lights())
+    add_object(obj, object_is_light);
+
+  Header header{};
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.header_size = sizeof(Header);
+  header.n_objects = objects.size();
+  header.n_materials = materials.size();
+  header.n_meshes = meshes.size();
+  header.n_bvhs = 0;
+
+  std::uint64_t offset = align_up(sizeof(Header));
+  header.objects_offset = offset;
+  offset = align_up(offset + objects.size() * sizeof(ObjectRecord));
+  header.materials_offset = offset;
+  offset = align_up(offset + materials.size() * sizeof(MaterialRecord));
+  header.meshes_offset = offset;
+  offset = align_up(offset + meshes.size() * sizeof(MeshRecord));
+  header.bvhs_offset = offset;
+
+  std::vector<MeshRecord> mesh_records;
+  for (auto const *mesh : meshes) {
+    MeshRecord rec{};
+    rec.n_vertices = mesh->vertices().size();
+    rec.n_indices = mesh->indices().size();
+    rec.has_adjacencies = mesh->has_adjacencies();
+    rec.bvh = no_index;
+    rec.vertex_offset = offset;
+    offset = align_up(offset + rec.n_vertices * sizeof(Vertex));
+    rec.index_offset = offset;
+    offset = align_up(offset + rec.n_indices * sizeof(GLuint));
+    mesh_records.push_back(rec);
+  }
+  header.file_size = offset;
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    Log::the().add_log("scene_file: can't open %s for writing\n",
+                       path.c_str());
+    return false;
+  }
+
+  auto const write_at = [&out](std::uint64_t at, void const *data,
+                               std::size_t size) {
+    static char const zeros[alignment]{};
+    auto const pos = static_cast<std::uint64_t>(out.tellp());
+    out.write(zeros, at - pos);
+    out.write(static_cast<char const *>(data), size);
+  };
+
+  write_at(0, &header, sizeof(header));
+  write_at(header.objects_offset, objects.data(),
+           objects.size() * sizeof(ObjectRecord));
+  write_at(header.materials_offset, materials.data(),
+           materials.size() * sizeof(MaterialRecord));
+  write_at(header.meshes_offset, mesh_records.data(),
+           mesh_records.size() * sizeof(MeshRecord));
+  for (std::size_t i = 0; i < meshes.size(); ++i) {
+    write_at(mesh_records[i].vertex_offset, meshes[i]->vertices().data(),
+             mesh_records[i].n_vertices * sizeof(Vertex));
+    write_at(mesh_records[i].index_offset, meshes[i]->indices().data(),
+             mesh_records[i].n_indices * sizeof(GLuint));
+  }
+  write_at(header.file_size, nullptr, 0);
+
+  Log::the().add_log("scene_file: wrote %u objects, %u meshes to %s\n",
+                     header.n_objects, header.n_meshes, path.c_str());
+  return out.good();
+}
+
+std::optional<MappedScene> MappedScene::open(std::filesystem::path const &path) {
+  auto const fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    return std::nullopt;
+
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(Header)) {
+    close(fd);
+    return std::nullopt;
+  }
+
+  auto *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return std::nullopt;
+
+  MappedScene scene;
+  scene.m_data = static_cast<std::byte const *>(data);
+  scene.m_size = st.st_size;
+  scene.m_header = reinterpret_cast<Header const *>(scene.m_data);
+  if (!scene.validate())
+    return std::nullopt;
+
+  return scene;
+}
+
+MappedScene::MappedScene(MappedScene &&o) noexcept
+    : m_data(o.m_data), m_size(o.m_size), m_header(o.m_header) {
+  o.m_data = nullptr;
+  o.m_size = 0;
+  o.m_header = nullptr;
+}
+
+MappedScene &MappedScene::operator=(MappedScene &&o) noexcept {
+  if (this != &o) {
+    if (m_data)
+      munmap(const_cast<std::byte *>(m_data), m_size);
+    m_data = o.m_data;
+    m_size = o.m_size;
+    m_header = o.m_header;
+    o.m_data = nullptr;
+    o.m_size = 0;
+    o.m_header = nullptr;
+  }
+  return *this;
+}
+
+MappedScene::~MappedScene() {
+  if (m_data)
+    munmap(const_cast<std::byte *>(m_data), m_size);
+}
+
+// Bounds, alignment, indices and enums are checked, and every vertex index
+// of a mesh is scanned, the records themselves are used as they are stored.
+bool MappedScene::validate() const {
+  auto const &h = *m_header;
+  auto const in_bounds = [this](std::uint64_t offset, std::uint64_t count,
+                                std::uint64_t size) {
+    return offset % alignment == 0 && offset <= m_size &&
+           count <= (m_size - offset) / size;
+  };
+
+  if (std::memcmp(h.magic, magic, sizeof(magic)) != 0 || h.version != version ||
+      h.header_size != sizeof(Header) || h.file_size != m_size)
+    return false;
+  if (!in_bounds(h.objects_offset, h.n_objects, sizeof(ObjectRecord)) ||
+      !in_bounds(h.materials_offset, h.n_materials, sizeof(MaterialRecord)) ||
+      !in_bounds(h.meshes_offset, h.n_meshes, sizeof(MeshRecord)) ||
+      !in_bounds(h.bvhs_offset, h.n_bvhs, sizeof(BvhRecord)))
+    return false;
+
+  for (std::uint32_t i = 0; i < h.n_meshes; ++i) {
+    auto const &m = meshes()[i];
+    if (!in_bounds(m.vertex_offset, m.n_vertices, sizeof(Vertex)) ||
+        !in_bounds(m.index_offset, m.n_indices, sizeof(GLuint)) ||
+        (m.bvh != no_index && m.bvh >= h.n_bvhs))
+      return false;
+    // whole triangles and no index past the vertices, GL and the CPU shadow
+    // volumes would read out of bounds, the importer checks the same
+    if (m.n_indices % (m.has_adjacencies != 0 ? 6 : 3) != 0)
+      return false;
+    auto const *indices = this->indices(m);
+    if (std::any_of(indices, indices + m.n_indices,
+                    [&m](GLuint i) { return i >= m.n_vertices; }))
+      return false;
+  }
+  for (std::uint32_t i = 0; i < h.n_bvhs; ++i) {
+    auto const &b = bvhs()[i];
+    if (!in_bounds(b.node_offset, b.n_nodes, sizeof(BvhNode)) ||
+        !in_bounds(b.index_offset, b.n_indices, sizeof(GLuint)) ||
+        b.mesh >= h.n_meshes)
+      return false;
+  }
+  for (std::uint32_t i = 0; i < h.n_objects; ++i) {
+    auto const &o = objects()[i];
+    if ((o.mesh != no_index && o.mesh >= h.n_meshes) ||
+        (o.material != no_index && o.material >= h.n_materials) ||
+        o.type > static_cast<std::uint32_t>(Object::Type::custom))
+      return false;
+  }
+  return true;
+}
+
+bool load(std::filesystem::path const &path, Scene &scene) {
+  REN_ZONE("scene_file::load");
+  auto mapped = MappedScene::open(path);
+  if (!mapped) {
+    Log::the().add_log("scene_file: %s is not a valid scene file\n",
+                       path.c_str());
+    return false;
+  }
+
+  auto const &header = mapped->header();
+  std::vector<std::shared_ptr<Material>> materials(header.n_materials);
+  for (std::uint32_t i = 0; i < header.n_materials; ++i)
+    materials[i] = make_material(mapped->materials()[i]);
+
+  std::uint32_t skipped = 0;
+  for (std::uint32_t i = 0; i < header.n_objects; ++i) {
+    auto const &rec = mapped->objects()[i];
+    // e.g. saved from a mesh whose CPU data was released
+    if (rec.mesh == no_index) {
+      ++skipped;
+      continue;
+    }
+
+    auto const &mesh_rec = mapped->meshes()[rec.mesh];
+    auto obj = Object(MeshRegistry::the().get(
+        mapped->vertices(mesh_rec), mesh_rec.n_vertices,
+        mapped->indices(mesh_rec), mesh_rec.n_indices,
+        mesh_rec.has_adjacencies != 0));
+    obj.set_type(static_cast<Object::Type>(rec.type));
+    obj.set_translation(vec(rec.translation));
+    obj.set_scale(vec(rec.scale));
+    obj.set_rotation_vector(vec(rec.rotation_vector));
+    obj.set_rotation_scale(rec.rotation_scale);
+    obj.update_model();
+    if (rec.material != no_index)
+      obj.set_material(materials[rec.material]);
+    assign_hit_functions(obj);
+
+    if (rec.flags & object_is_light)
+      scene.add_light(std::move(obj));
+    else
+      scene.add_object(std::move(obj));
+  }
+
+  if (skipped != 0)
+    Log::the().add_log("scene_file: skipped %u objects without a mesh\n",
+                       skipped);
+  Log::the().add_log("scene_file: loaded %u objects from %s\n",
+                     header.n_objects - skipped, path.c_str());
+  return true;
+}
+
+} // namespace ren::scene_file
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+#include "mesh.hpp"
+
+namespace ren {
+
+class Scene;
+
+// Versioned binary scene format. Every section is a flat array of fixed size
+// records at a 16 byte aligned offset, so a mapped file is used in place and
+// the optional BVH nodes can be traversed without being copied. Loading still
+// copies the vertex and index blobs: MeshRegistry compares them and each Mesh
+// keeps its own CPU copy.
+namespace scene_file {
+
+constexpr char magic[8] = {'Z', 'R', 'S', 'C', 'E', 'N', 'E', '\0'};
+constexpr std::uint32_t version = 1;
+constexpr std::size_t alignment = 16;
+
+struct Header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t header_size;
+  std::uint64_t file_size;
+
+  std::uint32_t n_objects;
+  std::uint32_t n_materials;
+  std::uint32_t n_meshes;
+  std::uint32_t n_bvhs;
+
+  std::uint64_t objects_offset;
+  std::uint64_t materials_offset;
+  std::uint64_t meshes_offset;
+  std::uint64_t bvhs_offset;
+};
+
+enum ObjectFlags : std::uint32_t {
+  object_is_light = 1u << 0,
+};
+
+constexpr std::uint32_t no_index = 0xFFFFFFFF;
+
+struct ObjectRecord {
+  float translation[3];
+  float scale[3];
+  float rotation_vector[3];
+  float rotation_scale;
+  std::uint32_t type;     // Object::Type
+  std::uint32_t mesh;     // index into the mesh table or no_index
+  std::uint32_t material; // index into the material table or no_index
+  std::uint32_t flags;    // ObjectFlags
+};
+
+struct MaterialRecord {
+  std::uint32_t scatter_type; // ScatterType
+  float albedo[3];            // albedo or emitted color
+  float parameter;            // metal fuzz or dielectric refraction index
+  float ambient[3];
+  float diffuse[3];
+  float specular[3];
+  float shininess;
+  std::uint32_t pad;
+};
+
+struct MeshRecord {
+  std::uint64_t vertex_offset; // Vertex[n_vertices]
+  std::uint64_t index_offset;  // GLuint[n_indices]
+  std::uint32_t n_vertices;
+  std::uint32_t n_indices;
+  std::uint32_t has_adjacencies;
+  std::uint32_t bvh; // index into the bvh table or no_index
+};
+
+// Flattened BVH in depth first order. Inner nodes store the index of their
+// second child in `first` (the first child follows directly), leaves store
+// the first triangle and a non zero count.
+struct BvhNode {
+  float min[3];
+  std::uint32_t first;
+  float max[3];
+  std::uint32_t count;
+};
+
+struct BvhRecord {
+  std::uint64_t node_offset; // BvhNode[n_nodes]
+  std::uint64_t index_offset; // triangle indices referenced by the leaves
+  std::uint32_t n_nodes;
+  std::uint32_t n_indices;
+  std::uint32_t mesh;
+  std::uint32_t pad;
+};
+
+static_assert(sizeof(Header) == 72);
+static_assert(sizeof(ObjectRecord) == 56);
+static_assert(sizeof(MaterialRecord) == 64);
+static_assert(sizeof(MeshRecord) == 32);
+static_assert(sizeof(BvhNode) == 32);
+static_assert(sizeof(BvhRecord) == 32);
+static_assert(sizeof(Vertex) == 32);
+
+// Read only mapping of a scene file. The record accessors point into the
+// mapping and stay valid for the lifetime of the MappedScene.
+class MappedScene {
+public:
+  static std::optional<MappedScene> open(std::filesystem::path const &path);
+
+  MappedScene(MappedScene &&o) noexcept;
+  MappedScene &operator=(MappedScene &&o) noexcept;
+  MappedScene(MappedScene const &) = delete;
+  MappedScene &operator=(MappedScene const &) = delete;
+  ~MappedScene();
+
+  auto const &header() const { return *m_header; }
+  auto const *objects() const { return at<ObjectRecord>(m_header->objects_offset); }
+  auto const *materials() const { return at<MaterialRecord>(m_header->materials_offset); }
+  auto const *meshes() const { return at<MeshRecord>(m_header->meshes_offset); }
+  auto const *bvhs() const { return at<BvhRecord>(m_header->bvhs_offset); }
+
+  auto const *vertices(MeshRecord const &m) const { return at<Vertex>(m.vertex_offset); }
+  auto const *indices(MeshRecord const &m) const { return at<GLuint>(m.index_offset); }
+  auto const *nodes(BvhRecord const &b) const { return at<BvhNode>(b.node_offset); }
+
+private:
+  MappedScene() = default;
+  bool validate() const;
+  template <typename T> T const *at(std::uint64_t offset) const {
+    return reinterpret_cast<T const *>(m_data + offset);
+  }
+
+  std::byte const *m_data{nullptr};
+  std::size_t m_size{0};
+  Header const *m_header{nullptr};
+};
+
+// Writes the scene; meshes with identical contents are stored once.
+bool save(Scene const &scene, std::filesystem::path const &path);
+// Maps the file and appends its objects and lights to the scene, objects
+// without a mesh are skipped.
+bool load(std::filesystem::path const &path, Scene &scene);
+
+} // namespace scene_file
+} // namespace ren
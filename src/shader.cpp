@@ -1,10 +1,115 @@
 #include "shader.hpp"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <sstream>
 
+#include "embedded_shaders.hpp"
+#include "log.hpp"
+#include "uniform_buffer.hpp"
+
 namespace ren {
 
+namespace {
+
+// set by Shader::init_cache, an empty directory disables the cache
+struct ProgramCache {
+  std::filesystem::path directory;
+  std::string driver; // vendor, renderer and version
+  bool parallel_compile{false};
+};
+ProgramCache program_cache;
+
+constexpr std::uint32_t cache_magic = 0x50524e52; // "RNRP"
+
+std::uint64_t fnv1a(std::string_view data, std::uint64_t hash) {
+  for (auto const c : data) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+std::string gl_string(GLenum name) {
+  auto const *s = reinterpret_cast<char const *>(glGetString(name));
+  return s != nullptr ? s : "";
+}
+
+// the embedded source of the file if there is one, otherwise its content
+std::string read_source(std::filesystem::path const &path) {
+  if (auto const embedded = embedded_shader(path.filename().string()))
+    return std::string(*embedded);
+  std::ifstream file(path, std::ios::binary);
+  assert(file.is_open());
+  std::ostringstream content;
+  content << file.rdbuf();
+  return content.str();
+}
+
+GLuint compile(GLenum type, std::string const &source) {
+  auto const shader = glCreateShader(type);
+  auto const *code = source.c_str();
+  glShaderSource(shader, 1, &code, nullptr);
+  glCompileShader(shader);
+  return shader;
+}
+
+std::filesystem::path cache_file(std::string const &key) {
+  return program_cache.directory / (key + ".bin");
+}
+
+bool load_binary(GLuint program, std::string const &key) {
+  std::ifstream in(cache_file(key), std::ios::binary);
+  if (!in)
+    return false;
+  std::uint32_t header[3]{}; // magic, format, size
+  if (!in.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+      header[0] != cache_magic)
+    return false;
+  std::vector<char> binary(header[2]);
+  if (!in.read(binary.data(), binary.size()))
+    return false;
+  glProgramBinary(program, header[1], binary.data(),
+                  static_cast<GLsizei>(binary.size()));
+  GLint linked = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  return linked == GL_TRUE;
+}
+
+void store_binary(GLuint program, std::string const &key) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+  // written aside and renamed, a concurrent run never reads half a file
+  std::error_code error;
+  std::filesystem::create_directories(program_cache.directory, error);
+  auto const path = cache_file(key);
+  auto temporary = path;
+  temporary += ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::binary);
+    std::uint32_t const header[3] = {cache_magic, format,
+                                     static_cast<std::uint32_t>(length)};
+    out.write(reinterpret_cast<char const *>(header), sizeof(header));
+    out.write(binary.data(), binary.size());
+    if (!out)
+      return;
+  }
+  std::filesystem::rename(temporary, path, error);
+  if (error)
+    Log::the().add_log("Shader: cannot write %s\n", path.c_str());
+}
+
+} // namespace
+
 auto check_compile(GLuint shader, Shader::Type type, std::string_view name)
     -> bool {
   GLint success;
@@ -28,102 +133,168 @@ auto check_compile(GLuint shader, Shader::Type type, std::string_view name)
   return success;
 };
 
+void Shader::init_cache(std::filesystem::path const &directory) {
+  program_cache.parallel_compile = GLAD_GL_KHR_parallel_shader_compile ||
+                                   GLAD_GL_ARB_parallel_shader_compile;
+  // as many compiler threads as the driver likes
+  if (GLAD_GL_KHR_parallel_shader_compile)
+    glMaxShaderCompilerThreadsKHR(0xffffffff);
+  else if (GLAD_GL_ARB_parallel_shader_compile)
+    glMaxShaderCompilerThreadsARB(0xffffffff);
+
+  GLint n_formats = 0;
+  if (GLAD_GL_ARB_get_program_binary)
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats);
+  if (n_formats == 0) {
+    Log::the().add_log("Shader: no program binary formats, not caching\n");
+    program_cache.directory.clear();
+    return;
+  }
+  program_cache.directory = directory;
+  program_cache.driver = gl_string(GL_VENDOR) + '\n' +
+                         gl_string(GL_RENDERER) + '\n' +
+                         gl_string(GL_VERSION);
+  Log::the().add_log("Shader: program cache in %s%s\n", directory.c_str(),
+                     program_cache.parallel_compile ? ", parallel compile"
+                                                    : "");
+}
+
+std::filesystem::path Shader::default_cache_directory() {
+  if (auto const *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+    return std::filesystem::path(xdg) / "ren/shaders";
+  if (auto const *home = std::getenv("HOME"); home && *home)
+    return std::filesystem::path(home) / ".cache/ren/shaders";
+  return {};
+}
+
 Shader::Shader(std::filesystem::path const &vertex_path,
                std::filesystem::path const &fragment_path,
                std::filesystem::path const &geometry_path) {
-  std::ifstream vertex_file(vertex_path, std::ios::ate);
-  std::ifstream fragment_file(fragment_path, std::ios::ate);
-  std::ifstream geometry_file;
-
-  assert(vertex_file.is_open() && fragment_file.is_open());
-  if (!geometry_path.empty()) {
-    geometry_file.open(geometry_path, std::ios::ate);
-    assert(geometry_file.is_open());
+  auto const v_string = read_source(vertex_path);
+  auto const f_string = read_source(fragment_path);
+  auto const g_string =
+      geometry_path.empty() ? std::string() : read_source(geometry_path);
+  m_name = vertex_path.filename().string() + ", " +
+           fragment_path.filename().string();
+  m_pending = true;
+
+  ID = glCreateProgram();
+  if (!program_cache.directory.empty()) {
+    auto hash = fnv1a(program_cache.driver, 0xcbf29ce484222325ull);
+    for (auto const *source : {&v_string, &f_string, &g_string})
+      hash = fnv1a(*source, fnv1a(std::string_view("\0", 1), hash));
+    char key[17];
+    std::snprintf(key, sizeof(key), "%016llx",
+                  static_cast<unsigned long long>(hash));
+    m_cache_key = key;
+    if (load_binary(ID, m_cache_key)) {
+      m_from_cache = true;
+      return;
+    }
+    // a stale or foreign binary leaves the program unusable
+    glDeleteProgram(ID);
+    ID = glCreateProgram();
+    glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
   }
 
-  size_t v_size = static_cast<size_t>(vertex_file.tellg());
-  size_t f_size = static_cast<size_t>(fragment_file.tellg());
-  vertex_file.seekg(0);
-  fragment_file.seekg(0);
+  // nothing here waits for the compiler, see finish_link()
+  m_stages[VERTEX] = compile(GL_VERTEX_SHADER, v_string);
+  m_stages[FRAGMENT] = compile(GL_FRAGMENT_SHADER, f_string);
+  if (!geometry_path.empty())
+    m_stages[GEOMETRY] = compile(GL_GEOMETRY_SHADER, g_string);
+  for (auto const stage : m_stages)
+    if (stage != 0)
+      glAttachShader(ID, stage);
+  glLinkProgram(ID);
+}
 
-  size_t g_size{};
-  if (!geometry_path.empty()) {
-    g_size = static_cast<size_t>(geometry_file.tellg());
-    geometry_file.seekg(0);
-  }
+bool Shader::ready() const {
+  if (!m_pending || m_from_cache || !program_cache.parallel_compile)
+    return true;
+  GLint done = GL_FALSE;
+  glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+  return done == GL_TRUE;
+}
 
-  std::vector<char> v_code_buffer(v_size);
-  vertex_file.read(v_code_buffer.data(), v_size);
-  std::string v_string(v_code_buffer.cbegin(), v_code_buffer.cend());
-  vertex_file.close();
-
-  std::vector<char> f_code_buffer(f_size);
-  fragment_file.read(f_code_buffer.data(), f_size);
-  std::string f_string(f_code_buffer.cbegin(), f_code_buffer.cend());
-  fragment_file.close();
-
-  std::string g_string;
-  if (!geometry_path.empty()) {
-    std::vector<char> g_code_buffer(g_size);
-    geometry_file.read(g_code_buffer.data(), g_size);
-    g_string = std::string(g_code_buffer.cbegin(), g_code_buffer.cend());
-    geometry_file.close();
-  }
-  GLuint vertex, fragment, geometry;
-
-  char const *v_code = v_string.c_str();
-  vertex = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertex, 1, &v_code, nullptr);
-  glCompileShader(vertex);
-
-  char const *f_code = f_string.c_str();
-  fragment = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragment, 1, &f_code, nullptr);
-  glCompileShader(fragment);
-
-  char const *g_code;
-  if (!geometry_path.empty()) {
-    g_code = g_string.c_str();
-    geometry = glCreateShader(GL_GEOMETRY_SHADER);
-    glShaderSource(geometry, 1, &g_code, nullptr);
-    glCompileShader(geometry);
+void Shader::finish_link() {
+  m_pending = false;
+  if (m_from_cache) {
+    cache_uniforms();
+    m_success = true;
+    return;
   }
 
-  if (!check_compile(vertex, Shader::Type::VERTEX, vertex_path.string())) {
-    m_success = false;
-    return;
+  // a failed link is explained by the stage that didn't compile
+  auto linked = check_compile(ID, Type::PROGRAM, m_name);
+  for (auto const type : {VERTEX, FRAGMENT, GEOMETRY}) {
+    auto const stage = m_stages[type];
+    if (stage == 0)
+      continue;
+    if (!linked)
+      check_compile(stage, type, m_name);
+    glDetachShader(ID, stage);
+    glDeleteShader(stage);
   }
-  if (!check_compile(fragment, Shader::Type::FRAGMENT,
-                     fragment_path.string())) {
+  m_stages = {};
+  if (!linked) {
     m_success = false;
     return;
   }
 
-  if (!geometry_path.empty()) {
-    if (!check_compile(geometry, Shader::Type::GEOMETRY,
-                       geometry_path.string())) {
-      m_success = false;
-      return;
-    }
-  }
+  cache_uniforms();
+  if (!m_cache_key.empty())
+    store_binary(ID, m_cache_key);
+  m_success = true;
+}
 
-  ID = glCreateProgram();
-  glAttachShader(ID, vertex);
-  glAttachShader(ID, fragment);
-  if (!geometry_path.empty())
-    glAttachShader(ID, geometry);
-  glLinkProgram(ID);
+void Shader::release() {
+  for (auto const stage : m_stages)
+    if (stage != 0)
+      glDeleteShader(stage);
+  m_stages = {};
+  if (ID != 0)
+    glDeleteProgram(ID);
+  ID = 0;
+  m_pending = false;
+}
 
-  glDeleteShader(vertex);
-  glDeleteShader(fragment);
-  if (!geometry_path.empty())
-    glDeleteShader(geometry);
+void Shader::cache_uniforms() {
+  GLint n_uniforms = 0, max_length = 0;
+  glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &n_uniforms);
+  glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
 
-  if (!check_compile(ID, Shader::Type::PROGRAM, vertex_path.string())) {
-    m_success = false;
-    return;
+  std::vector<GLchar> name(std::max(max_length, 1));
+  for (GLint i = 0; i < n_uniforms; ++i) {
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(ID, i, name.size(), nullptr, &size, &type, name.data());
+    auto const location = glGetUniformLocation(ID, name.data());
+    if (location == -1)
+      continue; // member of a uniform block
+
+    // arrays are reported as "name[0]", make every element and the bare
+    // name available
+    std::string base = name.data();
+    auto const bracket = base.find('[');
+    if (bracket == std::string::npos) {
+      m_locations.emplace(base, location);
+      continue;
+    }
+    base.resize(bracket);
+    m_locations.emplace(base, location);
+    for (GLint e = 0; e < size; ++e) {
+      auto const element = base + "[" + std::to_string(e) + "]";
+      m_locations.emplace(element, glGetUniformLocation(ID, element.c_str()));
+    }
   }
 
-  m_success = true;
+  // uniform blocks get fixed binding points, see uniform_buffer.hpp
+  for (auto const &[block, binding] :
+       {std::pair{"Frame", uniform_binding::frame},
+        std::pair{"Material", uniform_binding::material}}) {
+    auto const index = glGetUniformBlockIndex(ID, block);
+    if (index != GL_INVALID_INDEX)
+      glUniformBlockBinding(ID, index, binding);
+  }
 }
 } // namespace ren
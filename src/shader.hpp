@@ -7,43 +7,97 @@
 
 #include <array>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <cassert>
 #include <filesystem>
 #include <iostream>
 
+#include "gl_profiler.hpp"
 #include "material.hpp"
 
 namespace ren {
 
+// A linked GLSL program. Constructing one only starts compiling and linking,
+// the result is checked the first time the program is used, so the programs
+// of a renderer compile together, on the driver's threads with
+// KHR_parallel_shader_compile. ready() polls for that without blocking.
+// With init_cache() linked programs are stored as program binaries keyed by
+// their sources and the driver, and later runs load them instead of
+// compiling. Sources embedded at build time (see embedded_shaders.hpp) are
+// taken over the files.
 class Shader final {
 public:
-  GLuint ID;
+  GLuint ID{0};
 
   enum Type { VERTEX, FRAGMENT, GEOMETRY, PROGRAM };
 
+  // enables parallel compilation and the program binary cache in
+  // `directory`, needs a current context; without it every program is
+  // compiled
+  static void init_cache(std::filesystem::path const &directory);
+  // $XDG_CACHE_HOME/ren/shaders or ~/.cache/ren/shaders
+  static std::filesystem::path default_cache_directory();
+
   Shader() = default;
   Shader(std::filesystem::path const &vertex_path,
          std::filesystem::path const &fragment_path,
          std::filesystem::path const &geometry_path = {});
+  Shader(Shader const &) = delete;
+  Shader &operator=(Shader const &) = delete;
   Shader &operator=(Shader &&other) {
+    if (this == &other)
+      return *this;
+    release();
     ID = other.ID;
     m_success = other.m_success;
+    m_locations = std::move(other.m_locations);
+    m_pending = other.m_pending;
+    m_from_cache = other.m_from_cache;
+    m_stages = other.m_stages;
+    m_name = std::move(other.m_name);
+    m_cache_key = std::move(other.m_cache_key);
+    other.ID = 0;
+    other.m_pending = false;
+    other.m_stages = {};
     return *this;
   }
-  ~Shader() = default;
+  // the owning renderer is destroyed when it is released, see
+  // renderer_pool.hpp
+  ~Shader() { release(); }
 
-  void use() { glUseProgram(ID); }
-  bool success() { return m_success; }
+  void use() {
+    resolve();
+    assert(m_success);
+    glUseProgram(ID);
+    GlProfiler::the().count_state_change();
+  }
+  // waits for the link to finish
+  bool success() {
+    resolve();
+    return m_success;
+  }
+  // the driver is done compiling and linking, never waits
+  bool ready() const;
+
+  // resolved once after linking, -1 for names that aren't active uniforms
+  GLint location(GLchar const *name) {
+    resolve();
+    auto const it = m_locations.find(name);
+    return it == m_locations.end() ? -1 : it->second;
+  }
 
   template <typename T> void set(GLchar const *name, T const &value) {
-    auto const location = glGetUniformLocation(ID, name);
+    auto const location = this->location(name);
     if (location == -1) {
       std::cout << "Shader (set): " << name << " -1" << std::endl;
     }
     assert(location != -1);
+    set(location, value);
+  }
 
+  template <typename T> void set(GLint location, T const &value) {
     // TODO: clean up
     if constexpr (std::is_same<T, bool>::value) { // bool
       glUniform1i(location, static_cast<int>(value));
@@ -57,6 +111,8 @@ public:
       glUniform2f(location, value.x, value.y);
     } else if constexpr (std::is_same<T, glm::vec3>::value) { // vec3
       glUniform3f(location, value.x, value.y, value.z);
+    } else if constexpr (std::is_same<T, glm::ivec3>::value) { // ivec3
+      glUniform3i(location, value.x, value.y, value.z);
     } else if constexpr (std::is_same<T, glm::vec4>::value) { // vec4
       glUniform4f(location, value.x, value.y, value.z, value.w);
     } else if constexpr (std::is_same<T, glm::mat2>::value) { // mat2
@@ -73,6 +129,23 @@ public:
   }
 
 private:
+  // checks the link and caches the uniforms, once
+  void resolve() {
+    if (m_pending)
+      finish_link();
+  }
+  void finish_link();
+  void cache_uniforms();
+  void release();
+
   bool m_success{false};
+  std::unordered_map<std::string, GLint> m_locations;
+
+  bool m_pending{false};
+  bool m_from_cache{false};
+  // kept until the link is checked to report compile errors, 0 if unused
+  std::array<GLuint, 3> m_stages{};
+  std::string m_name;      // for errors
+  std::string m_cache_key; // empty when not cached
 };
 } // namespace ren
@@ -0,0 +1,158 @@
+#include "shadow_atlas.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "gl_profiler.hpp"
+#include "log.hpp"
+
+namespace ren {
+
+ShadowAtlas::ShadowAtlas(std::size_t budget_bytes) {
+  glGenFramebuffers(1, &m_framebuffer);
+  set_budget(budget_bytes);
+}
+
+ShadowAtlas::~ShadowAtlas() {
+  glDeleteTextures(1, &m_texture);
+  glDeleteFramebuffers(1, &m_framebuffer);
+}
+
+void ShadowAtlas::set_budget(std::size_t budget_bytes) {
+  // the largest power of two square fitting the budget
+  int size = min_tile;
+  while (static_cast<std::size_t>(size) * 2 * size * 2 * bytes_per_texel <=
+         budget_bytes)
+    size *= 2;
+  GLint max_size = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+  while (size > min_tile && size > max_size)
+    size /= 2;
+
+  if (size != m_size) {
+    m_size = size;
+    glDeleteTextures(1, &m_texture);
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, m_size, m_size, 0,
+                 GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+                           m_texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      Log::the().add_log("ShadowAtlas: framebuffer incomplete\n");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    Log::the().add_log("ShadowAtlas: %dx%d, %zu MiB\n", m_size, m_size,
+                       bytes() >> 20);
+  }
+
+  int levels = 1;
+  while ((m_size >> (levels - 1)) > min_tile)
+    ++levels;
+  m_free.assign(levels, {});
+  release_all();
+}
+
+int ShadowAtlas::level_of(int size) const {
+  int level = 0;
+  while (level + 1 < static_cast<int>(m_free.size()) &&
+         (m_size >> (level + 1)) >= size)
+    ++level;
+  return level;
+}
+
+std::optional<ShadowAtlas::Tile> ShadowAtlas::allocate(int size) {
+  auto const level = level_of(std::max(size, min_tile));
+  // the smallest free tile at least as large, split down to the level
+  auto from = level;
+  while (from >= 0 && m_free[from].empty())
+    --from;
+  if (from < 0)
+    return std::nullopt;
+
+  for (; from < level; ++from) {
+    auto const origin = m_free[from].back();
+    m_free[from].pop_back();
+    auto const half = m_size >> (from + 1);
+    for (auto const offset : {glm::ivec2(half, half), glm::ivec2(0, half),
+                              glm::ivec2(half, 0), glm::ivec2(0, 0)})
+      m_free[from + 1].push_back(
+          glm::ivec2(origin.x + offset.x, origin.y + offset.y));
+  }
+  auto const origin = m_free[level].back();
+  m_free[level].pop_back();
+  auto const tile_size = m_size >> level;
+  m_texels_used += static_cast<std::size_t>(tile_size) * tile_size;
+  return Tile{origin.x, origin.y, tile_size};
+}
+
+void ShadowAtlas::release(Tile const &tile) {
+  if (tile.size == 0)
+    return;
+  m_texels_used -= static_cast<std::size_t>(tile.size) * tile.size;
+
+  auto level = level_of(tile.size);
+  auto origin = glm::ivec2(tile.x, tile.y);
+  // merge with the three siblings while they are free too
+  while (level > 0) {
+    auto const size = m_size >> level;
+    auto const parent =
+        glm::ivec2(origin.x & ~(2 * size - 1), origin.y & ~(2 * size - 1));
+    auto &free = m_free[level];
+    int siblings = 0;
+    for (auto const &f : free)
+      siblings += f.x >= parent.x && f.x < parent.x + 2 * size &&
+                  f.y >= parent.y && f.y < parent.y + 2 * size;
+    if (siblings < 3)
+      break;
+    free.erase(std::remove_if(free.begin(), free.end(),
+                              [&](glm::ivec2 const &f) {
+                                return f.x >= parent.x &&
+                                       f.x < parent.x + 2 * size &&
+                                       f.y >= parent.y &&
+                                       f.y < parent.y + 2 * size;
+                              }),
+               free.end());
+    origin = parent;
+    --level;
+  }
+  m_free[level].push_back(origin);
+}
+
+void ShadowAtlas::release_all() {
+  for (auto &free : m_free)
+    free.clear();
+  m_free[0].push_back(glm::ivec2(0, 0));
+  m_texels_used = 0;
+}
+
+void ShadowAtlas::begin_tile(Tile const &tile) const {
+  assert(tile.size > 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+  glViewport(tile.x, tile.y, tile.size, tile.size);
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(tile.x, tile.y, tile.size, tile.size);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  GlProfiler::the().count_state_change();
+}
+
+void ShadowAtlas::end_tiles() const {
+  glDisable(GL_SCISSOR_TEST);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  GlProfiler::the().count_state_change();
+}
+
+glm::vec4 ShadowAtlas::rect(Tile const &tile) const {
+  auto const s = static_cast<float>(m_size);
+  return glm::vec4(tile.x / s, tile.y / s, tile.size / s, tile.size / s);
+}
+
+} // namespace ren
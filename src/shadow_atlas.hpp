@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+namespace ren {
+
+// One depth texture holding the shadow maps of several lights. The square
+// texture is as large as the memory budget allows and hands out square
+// power of two tiles, split from and merged back into their parents like a
+// quadtree.
+class ShadowAtlas final {
+public:
+  struct Tile {
+    int x{0};
+    int y{0};
+    int size{0}; // 0 is no tile
+  };
+
+  static constexpr int min_tile = 64;
+  static constexpr std::size_t bytes_per_texel = 4; // DEPTH_COMPONENT32F
+
+  explicit ShadowAtlas(std::size_t budget_bytes);
+  ~ShadowAtlas();
+  ShadowAtlas(ShadowAtlas const &) = delete;
+  ShadowAtlas &operator=(ShadowAtlas const &) = delete;
+
+  // reallocates the texture, every tile is released
+  void set_budget(std::size_t budget_bytes);
+
+  // `size` is rounded up to a power of two of at least min_tile
+  std::optional<Tile> allocate(int size);
+  void release(Tile const &tile);
+  void release_all();
+
+  // binds the atlas framebuffer, restricted to `tile`, and clears the tile
+  void begin_tile(Tile const &tile) const;
+  void end_tiles() const;
+
+  // xy the origin and zw the size of `tile` in texture coordinates
+  glm::vec4 rect(Tile const &tile) const;
+
+  GLuint texture() const { return m_texture; }
+  int size() const { return m_size; }
+  std::size_t bytes() const {
+    return static_cast<std::size_t>(m_size) * m_size * bytes_per_texel;
+  }
+  std::size_t texels_used() const { return m_texels_used; }
+
+private:
+  int level_of(int size) const;
+
+  GLuint m_texture{0};
+  GLuint m_framebuffer{0};
+  int m_size{0};
+  // per level the origins of the free tiles, level 0 is the whole atlas
+  std::vector<std::vector<glm::ivec2>> m_free;
+  std::size_t m_texels_used{0};
+};
+
+} // namespace ren
@@ -6,6 +6,7 @@
 #include <utility>
 #include <vector>
 
+#include "gl_profiler.hpp"
 #include "gl_util.hpp"
 #include "resource_manager.hpp"
 
@@ -27,6 +28,8 @@ struct Texture {
 
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, img.width(), img.heigth(), 0,
                  GL_RGBA, GL_UNSIGNED_BYTE, img.data());
+    GlProfiler::the().count_upload(static_cast<std::size_t>(img.width()) *
+                                   img.heigth() * 4);
     glGenerateMipmap(GL_TEXTURE_2D);
 
     height = img.heigth();
@@ -45,6 +48,7 @@ struct Texture {
 
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, a_width, a_heigth, 0, GL_RGB,
                  GL_UNSIGNED_BYTE, data.data());
+    GlProfiler::the().count_upload(data.size());
     // glGenerateMipmap(GL_TEXTURE_2D);
 
     height = a_heigth;
@@ -56,6 +60,7 @@ struct Texture {
     assert(m_is_valid);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, a_width, a_heigth, 0, GL_RGB,
                  GL_UNSIGNED_BYTE, data.data());
+    GlProfiler::the().count_upload(data.size());
   }
   ~Texture() {
     if (m_is_valid) {
@@ -63,8 +68,10 @@ struct Texture {
     }
   }
   void bind() const {
-    if (m_is_valid)
-      glBindTexture(GL_TEXTURE_2D, id);
+    if (!m_is_valid)
+      return;
+    glBindTexture(GL_TEXTURE_2D, id);
+    GlProfiler::the().count_state_change();
   }
   void bind(GLuint target) const {
     if (!m_is_valid)
@@ -72,40 +79,8 @@ struct Texture {
 
     glActiveTexture(target);
     glBindTexture(GL_TEXTURE_2D, id);
+    GlProfiler::the().count_state_change();
   }
 };
 
-class TextureManager {
-public:
-  TextureManager() = default;
-  ~TextureManager() = default;
-
-  std::size_t create_texture_from_image(Image &img) {
-    m_textures.emplace_back(img);
-    return m_textures.size() - 1;
-  }
-
-  std::size_t create_empty_texture() {
-    m_textures.emplace_back();
-    return m_textures.size() - 1;
-  }
-
-  auto &texture(std::size_t id) const { return m_textures.at(id); }
-  auto name(std::size_t id) const { return m_textures.at(id).id; }
-
-  void bind(std::size_t id) const {
-    m_textures[id].bind();
-    check_gl_error("bind");
-  }
-
-  void bind(std::size_t index, GLenum target) const {
-    glActiveTexture(target);
-    m_textures[index].bind();
-    check_gl_error("bind");
-  }
-
-private:
-  std::vector<Texture> m_textures;
-};
-
 } // namespace ren
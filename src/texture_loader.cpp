@@ -0,0 +1,475 @@
+#include "texture_loader.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "stb_image.h"
+
+#include "gl_profiler.hpp"
+#include "imgui.h"
+#include "log.hpp"
+#include "parallel.hpp"
+#include "zone_profiler.hpp"
+
+namespace ren {
+
+namespace {
+
+// 2x2 box filter, odd sizes repeat their last row or column
+void downsample(std::uint8_t const *src, int width, int height,
+                std::uint8_t *dst) {
+  auto const w = std::max(1, width / 2);
+  auto const h = std::max(1, height / 2);
+  for (int y = 0; y < h; ++y) {
+    auto const y0 = std::min(2 * y, height - 1);
+    auto const y1 = std::min(2 * y + 1, height - 1);
+    for (int x = 0; x < w; ++x) {
+      auto const x0 = std::min(2 * x, width - 1);
+      auto const x1 = std::min(2 * x + 1, width - 1);
+      for (int c = 0; c < 4; ++c) {
+        auto const sum = src[(y0 * width + x0) * 4 + c] +
+                         src[(y0 * width + x1) * 4 + c] +
+                         src[(y1 * width + x0) * 4 + c] +
+                         src[(y1 * width + x1) * 4 + c];
+        dst[(y * w + x) * 4 + c] = static_cast<std::uint8_t>((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+std::uint64_t fnv1a(void const *data, std::size_t size, std::uint64_t hash) {
+  auto const *bytes = static_cast<std::uint8_t const *>(data);
+  for (std::size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+} // namespace
+
+TextureLoader::TextureLoader(std::filesystem::path const &placeholder,
+                             std::size_t upload_budget, unsigned n_workers)
+    : m_upload_budget(upload_budget) {
+  m_placeholder_image.path = placeholder;
+  decode(m_placeholder_image);
+  assert(m_placeholder_image.error == nullptr);
+  m_placeholder_2d = create_placeholder(GL_TEXTURE_2D);
+  m_placeholder_cube = create_placeholder(GL_TEXTURE_CUBE_MAP);
+  m_placeholder_image.pixels = {};
+
+  glGenBuffers(staging_buffers, m_staging.data());
+  for (auto const buffer : m_staging) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, m_upload_budget, nullptr,
+                 GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  // decoding is mostly waiting on memory and the disk, a few threads do
+  if (n_workers == 0)
+    n_workers = std::min(4u, default_thread_count());
+  for (unsigned i = 0; i < n_workers; ++i)
+    m_workers.emplace_back([this]() { work(); });
+}
+
+TextureLoader::~TextureLoader() {
+  {
+    std::lock_guard lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (auto &worker : m_workers)
+    worker.join();
+
+  for (auto &fence : m_fences)
+    if (fence != nullptr)
+      glDeleteSync(fence);
+  glDeleteBuffers(staging_buffers, m_staging.data());
+  for (auto const &entry : m_entries)
+    if (entry->texture != 0)
+      glDeleteTextures(1, &entry->texture);
+  glDeleteTextures(1, &m_placeholder_2d);
+  glDeleteTextures(1, &m_placeholder_cube);
+}
+
+TextureLoader::Handle TextureLoader::load(std::filesystem::path const &path) {
+  return add(GL_TEXTURE_2D, {path});
+}
+
+TextureLoader::Handle TextureLoader::load_cubemap(
+    std::array<std::filesystem::path, 6> const &faces) {
+  return add(GL_TEXTURE_CUBE_MAP, {faces.begin(), faces.end()});
+}
+
+TextureLoader::Handle
+TextureLoader::add(GLenum target, std::vector<std::filesystem::path> paths) {
+  auto key = std::to_string(target);
+  for (auto const &path : paths)
+    key += '\n' + path.string();
+  auto const [it, inserted] = m_by_path.emplace(key, m_entries.size());
+  if (!inserted)
+    return it->second;
+
+  auto entry = std::make_unique<Entry>();
+  entry->target = target;
+  entry->faces.resize(paths.size());
+  for (std::size_t i = 0; i < paths.size(); ++i)
+    entry->faces[i].path = std::move(paths[i]);
+  entry->last_used = m_frame;
+  m_entries.push_back(std::move(entry));
+  request(it->second);
+  return it->second;
+}
+
+// queues the faces for decoding, for a new or an evicted entry
+void TextureLoader::request(Handle handle) {
+  auto &entry = *m_entries[handle];
+  entry.state = State::decoding;
+  entry.faces_decoded = 0;
+  entry.face = 0;
+  entry.level = 0;
+  entry.row = 0;
+  {
+    std::lock_guard lock(m_mutex);
+    for (auto &face : entry.faces) {
+      face.levels.clear();
+      face.error = nullptr;
+      m_jobs.push_back({handle, &face});
+    }
+  }
+  m_wake.notify_all();
+  ++m_loading;
+}
+
+void TextureLoader::decode(Face &face) {
+  REN_ZONE("decode texture");
+  // same orientation as Image
+  stbi_set_flip_vertically_on_load_thread(true);
+  int width = 0, height = 0, n_channels = 0;
+  auto *const data =
+      stbi_load(face.path.c_str(), &width, &height, &n_channels, 4);
+  if (data == nullptr) {
+    face.error = stbi_failure_reason();
+    return;
+  }
+
+  // the whole chain is 4/3 of the base level
+  std::size_t size = 0;
+  for (int w = width, h = height;; w = std::max(1, w / 2),
+           h = std::max(1, h / 2)) {
+    face.levels.push_back({w, h, size});
+    size += static_cast<std::size_t>(w) * h * 4;
+    if (w == 1 && h == 1)
+      break;
+  }
+  face.pixels.resize(size);
+  std::memcpy(face.pixels.data(), data,
+              static_cast<std::size_t>(width) * height * 4);
+  stbi_image_free(data);
+  for (std::size_t i = 1; i < face.levels.size(); ++i) {
+    auto const &src = face.levels[i - 1];
+    downsample(face.pixels.data() + src.offset, src.width, src.height,
+               face.pixels.data() + face.levels[i].offset);
+  }
+
+  int const size_key[] = {width, height};
+  face.hash = fnv1a(size_key, sizeof(size_key), 0xcbf29ce484222325ull);
+  face.hash = fnv1a(face.pixels.data(),
+                    static_cast<std::size_t>(width) * height * 4, face.hash);
+}
+
+void TextureLoader::work() {
+  REN_THREAD_NAME("texture loader");
+  while (true) {
+    Job job;
+    {
+      std::unique_lock lock(m_mutex);
+      m_wake.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+      if (m_stop)
+        return;
+      job = m_jobs.front();
+      m_jobs.pop_front();
+    }
+    decode(*job.face);
+    std::lock_guard lock(m_mutex);
+    m_done.push_back(job);
+  }
+}
+
+void TextureLoader::update() {
+  REN_ZONE("texture loader");
+  collect();
+  if (!m_uploads.empty())
+    stream();
+  if (m_gpu_bytes > m_budget)
+    evict();
+  ++m_frame;
+}
+
+// moves entries whose faces are all decoded into the upload queue
+void TextureLoader::collect() {
+  std::vector<Job> done;
+  {
+    std::lock_guard lock(m_mutex);
+    done.swap(m_done);
+  }
+  for (auto const &job : done) {
+    auto &entry = *m_entries[job.handle];
+    m_cpu_bytes += job.face->pixels.size();
+    if (++entry.faces_decoded < entry.faces.size())
+      continue;
+
+    auto const &first = entry.faces.front();
+    auto const failed = std::find_if(
+        entry.faces.begin(), entry.faces.end(), [&first](Face const &face) {
+          return face.error != nullptr ||
+                 face.levels[0].width != first.levels[0].width ||
+                 face.levels[0].height != first.levels[0].height;
+        });
+    if (failed != entry.faces.end()) {
+      Log::the().add_log("TextureLoader: cannot use %s: %s\n",
+                         failed->path.c_str(),
+                         failed->error != nullptr ? failed->error
+                                                 : "faces differ in size");
+      entry.state = State::failed;
+      for (auto &face : entry.faces)
+        free_pixels(face);
+      --m_loading;
+      continue;
+    }
+
+    // the same pixels under another name share that texture
+    entry.hash = 0xcbf29ce484222325ull;
+    for (auto const &face : entry.faces)
+      entry.hash = fnv1a(&face.hash, sizeof(face.hash), entry.hash);
+    entry.hash = fnv1a(&entry.target, sizeof(entry.target), entry.hash);
+    auto const [it, inserted] = m_by_content.emplace(entry.hash, job.handle);
+    if (!inserted && it->second != job.handle) {
+      entry.alias = it->second;
+      entry.state = State::aliased;
+      for (auto &face : entry.faces)
+        free_pixels(face);
+      --m_loading;
+      ++m_duplicates;
+      continue;
+    }
+    allocate(entry);
+    entry.state = State::uploading;
+    m_uploads.push_back(job.handle);
+  }
+}
+
+// creates every level of the texture, the pixels follow through stream()
+void TextureLoader::allocate(Entry &entry) {
+  glGenTextures(1, &entry.texture);
+  glBindTexture(entry.target, entry.texture);
+  auto const &levels = entry.faces.front().levels;
+  entry.gpu_bytes = 0;
+  for (auto const &face : entry.faces)
+    entry.gpu_bytes += face.pixels.size();
+  m_gpu_bytes += entry.gpu_bytes;
+  for (std::size_t f = 0; f < entry.faces.size(); ++f) {
+    auto const target = entry.target == GL_TEXTURE_CUBE_MAP
+                            ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + GLenum(f)
+                            : entry.target;
+    for (std::size_t l = 0; l < levels.size(); ++l)
+      glTexImage2D(target, static_cast<GLint>(l), GL_RGBA8, levels[l].width,
+                   levels[l].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  }
+  auto const wrap =
+      entry.target == GL_TEXTURE_CUBE_MAP ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+  glTexParameteri(entry.target, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(entry.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(entry.target, GL_TEXTURE_WRAP_S, wrap);
+  glTexParameteri(entry.target, GL_TEXTURE_WRAP_T, wrap);
+  glTexParameteri(entry.target, GL_TEXTURE_WRAP_R, wrap);
+  glTexParameteri(entry.target, GL_TEXTURE_MAX_LEVEL,
+                  static_cast<GLint>(levels.size() - 1));
+  glBindTexture(entry.target, 0);
+}
+
+// copies rows of the queued textures into the next staging buffer until it
+// is full, then hands them to GL. Never waits for the GPU: a staging buffer
+// still being read means no upload this frame.
+void TextureLoader::stream() {
+  auto const index = m_staging_index;
+  auto &fence = m_fences[index];
+  if (fence != nullptr) {
+    if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+      ++m_stalled_frames;
+      return;
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+  m_staging_index = (m_staging_index + 1) % staging_buffers;
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_staging[index]);
+  auto *const staging = static_cast<std::uint8_t *>(glMapBufferRange(
+      GL_PIXEL_UNPACK_BUFFER, 0, m_upload_budget,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+          GL_MAP_UNSYNCHRONIZED_BIT));
+  if (staging == nullptr) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return;
+  }
+
+  m_chunks.clear();
+  std::size_t used = 0;
+  while (!m_uploads.empty()) {
+    auto &entry = *m_entries[m_uploads.front()];
+    auto const &face = entry.faces[entry.face];
+    auto const &level = face.levels[entry.level];
+    auto const row_size = static_cast<std::size_t>(level.width) * 4;
+    auto const rows = std::min<std::size_t>(level.height - entry.row,
+                                            (m_upload_budget - used) /
+                                                row_size);
+    if (rows == 0)
+      break; // full, budgets below one row never finish a texture
+    auto const target = entry.target == GL_TEXTURE_CUBE_MAP
+                            ? GL_TEXTURE_CUBE_MAP_POSITIVE_X +
+                                  GLenum(entry.face)
+                            : entry.target;
+    std::memcpy(staging + used,
+                face.pixels.data() + level.offset + entry.row * row_size,
+                rows * row_size);
+    m_chunks.push_back({target, entry.texture, level,
+                        static_cast<int>(entry.level), entry.row,
+                        static_cast<int>(rows), used});
+    used += rows * row_size;
+
+    // advance to the next rows, level, face or texture
+    entry.row += static_cast<int>(rows);
+    if (entry.row < level.height)
+      continue;
+    entry.row = 0;
+    if (++entry.level < face.levels.size())
+      continue;
+    entry.level = 0;
+    free_pixels(entry.faces[entry.face]);
+    if (++entry.face < entry.faces.size())
+      continue;
+    entry.state = State::ready;
+    --m_loading;
+    m_uploads.pop_front();
+  }
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+  for (auto const &chunk : m_chunks) {
+    glBindTexture(chunk.target == GL_TEXTURE_2D ? GL_TEXTURE_2D
+                                                : GL_TEXTURE_CUBE_MAP,
+                  chunk.texture);
+    glTexSubImage2D(chunk.target, chunk.level_index, 0, chunk.row,
+                    chunk.level.width, chunk.rows, GL_RGBA, GL_UNSIGNED_BYTE,
+                    reinterpret_cast<void const *>(chunk.offset));
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  GlProfiler::the().count_upload(used);
+  m_uploaded_bytes += used;
+}
+
+// deletes the least recently bound textures until the budget is met,
+// textures bound in this frame are kept even if that means staying over
+void TextureLoader::evict() {
+  std::vector<Handle> candidates;
+  for (Handle h = 0; h < m_entries.size(); ++h) {
+    auto const &entry = *m_entries[h];
+    if (entry.state == State::ready && entry.last_used < m_frame)
+      candidates.push_back(h);
+  }
+  std::sort(candidates.begin(), candidates.end(), [this](Handle a, Handle b) {
+    return m_entries[a]->last_used < m_entries[b]->last_used;
+  });
+  for (auto const h : candidates) {
+    if (m_gpu_bytes <= m_budget)
+      break;
+    auto &entry = *m_entries[h];
+    glDeleteTextures(1, &entry.texture);
+    entry.texture = 0;
+    entry.state = State::evicted;
+    m_gpu_bytes -= entry.gpu_bytes;
+    ++m_evictions;
+  }
+}
+
+void TextureLoader::free_pixels(Face &face) {
+  m_cpu_bytes -= face.pixels.size();
+  face.pixels = {};
+}
+
+GLuint TextureLoader::create_placeholder(GLenum target) {
+  auto const &image = m_placeholder_image;
+  GLuint texture = 0;
+  glGenTextures(1, &texture);
+  glBindTexture(target, texture);
+  auto const n_faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+  for (int f = 0; f < n_faces; ++f) {
+    auto const face_target = target == GL_TEXTURE_CUBE_MAP
+                                 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + f
+                                 : target;
+    for (std::size_t l = 0; l < image.levels.size(); ++l) {
+      auto const &level = image.levels[l];
+      glTexImage2D(face_target, static_cast<GLint>(l), GL_RGBA8, level.width,
+                   level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                   image.pixels.data() + level.offset);
+    }
+  }
+  GlProfiler::the().count_upload(image.pixels.size() * n_faces);
+  glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(target, GL_TEXTURE_MAX_LEVEL,
+                  static_cast<GLint>(image.levels.size() - 1));
+  glBindTexture(target, 0);
+  return texture;
+}
+
+bool TextureLoader::ready(Handle handle) const {
+  auto const *entry = m_entries[handle].get();
+  if (entry->state == State::aliased)
+    entry = m_entries[entry->alias].get();
+  return entry->state == State::ready;
+}
+
+GLuint TextureLoader::texture(Handle handle) {
+  if (m_entries[handle]->state == State::aliased)
+    handle = m_entries[handle]->alias;
+  auto &entry = *m_entries[handle];
+  entry.last_used = m_frame;
+  if (entry.state == State::ready)
+    return entry.texture;
+  if (entry.state == State::evicted)
+    request(handle);
+  return entry.target == GL_TEXTURE_CUBE_MAP ? m_placeholder_cube
+                                             : m_placeholder_2d;
+}
+
+void TextureLoader::bind(Handle handle, GLenum unit) {
+  glActiveTexture(unit);
+  glBindTexture(target(handle), texture(handle));
+  GlProfiler::the().count_state_change();
+}
+
+void TextureLoader::draw_dialog() {
+  if (!ImGui::CollapsingHeader("Textures"))
+    return;
+  ImGui::Text("%zu textures, %zu loading, %zu duplicates", m_entries.size(),
+              m_loading, m_duplicates);
+  auto budget_mib = static_cast<int>(m_budget >> 20);
+  if (ImGui::SliderInt("Budget (MiB)", &budget_mib, 16, 4096))
+    m_budget = static_cast<std::size_t>(budget_mib) << 20;
+  ImGui::Text("in GL %.1f MiB, decoded %.1f MiB, %zu evictions",
+              m_gpu_bytes / double(1 << 20), m_cpu_bytes / double(1 << 20),
+              m_evictions);
+  ImGui::Text("uploaded %.1f MiB, %.1f MiB per frame",
+              m_uploaded_bytes / double(1 << 20),
+              m_upload_budget / double(1 << 20));
+  ImGui::Text("frames waiting on staging: %d", m_stalled_frames);
+}
+
+} // namespace ren
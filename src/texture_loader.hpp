@@ -0,0 +1,170 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "glad/glad.h"
+
+namespace ren {
+
+// Loads textures without blocking the main thread. Images are decoded and
+// their mip chains built on a pool of worker threads, then update() streams
+// the levels into GL through a ring of pixel unpack buffers, at most
+// upload_budget bytes per frame. Until a texture is complete texture()
+// returns the placeholder, decoded up front from the image the loader was
+// constructed with. A texture that fails to decode keeps the placeholder.
+//
+// The loader is also the texture cache. Loading the same paths again
+// returns the same handle, and images whose pixels hash the same share one
+// GL texture. When the textures in GL exceed the budget, the least recently
+// bound are deleted, down to those bound in the current frame. Their
+// handles stay valid and load again the next time they are bound.
+// Everything but the workers runs on the main thread.
+class TextureLoader final {
+public:
+  using Handle = std::size_t;
+  static constexpr Handle none = ~Handle{0};
+
+  explicit TextureLoader(std::filesystem::path const &placeholder,
+                         std::size_t upload_budget = 4u << 20,
+                         unsigned n_workers = 0);
+  ~TextureLoader();
+  TextureLoader(TextureLoader const &) = delete;
+  TextureLoader &operator=(TextureLoader const &) = delete;
+
+  // a mipmapped GL_TEXTURE_2D
+  Handle load(std::filesystem::path const &path);
+  // a mipmapped GL_TEXTURE_CUBE_MAP, faces in +x, -x, +y, -y, +z, -z order,
+  // decoded in parallel
+  Handle load_cubemap(std::array<std::filesystem::path, 6> const &faces);
+
+  // takes the decoded images, uploads the next part and evicts, once per
+  // frame
+  void update();
+
+  bool ready(Handle handle) const;
+  // the texture, or the placeholder of the same target while it loads,
+  // marks it used in this frame and reloads it if it was evicted
+  GLuint texture(Handle handle);
+  GLenum target(Handle handle) const { return m_entries[handle]->target; }
+  void bind(Handle handle, GLenum unit);
+
+  // bytes of GL textures, not counting the placeholders
+  void set_budget(std::size_t bytes) { m_budget = bytes; }
+  std::size_t resident_bytes() const { return m_gpu_bytes; }
+
+  void draw_dialog();
+
+private:
+  static constexpr std::size_t staging_buffers = 3;
+
+  struct Level {
+    int width;
+    int height;
+    std::size_t offset; // into Face::pixels
+  };
+
+  // one image, written by a worker until it is handed back
+  struct Face {
+    std::filesystem::path path;
+    std::vector<Level> levels;
+    std::vector<std::uint8_t> pixels; // RGBA8, all levels
+    char const *error{nullptr};       // stb's reason, a string literal
+    std::uint64_t hash{0};            // of the pixels and size
+  };
+
+  // an aliased entry uses the texture of `alias`, which has the same pixels
+  enum class State { decoding, uploading, ready, evicted, aliased, failed };
+
+  struct Entry {
+    GLenum target;
+    State state{State::decoding};
+    GLuint texture{0};
+    // never resized, the workers hold pointers. The paths are kept for
+    // reloading, the pixels only until they are uploaded.
+    std::vector<Face> faces;
+    std::size_t faces_decoded{0};
+    std::uint64_t hash{0};
+    Handle alias{none};
+    std::size_t gpu_bytes{0};
+    std::uint64_t last_used{0}; // frame
+
+    // upload position
+    std::size_t face{0};
+    std::size_t level{0};
+    int row{0};
+  };
+
+  struct Job {
+    Handle handle;
+    Face *face;
+  };
+
+  // a part of a level in the current staging buffer
+  struct Chunk {
+    GLenum target;
+    GLuint texture;
+    Level level;
+    int level_index;
+    int row;
+    int rows;
+    std::size_t offset; // into the staging buffer
+  };
+
+  static void decode(Face &face);
+  Handle add(GLenum target, std::vector<std::filesystem::path> paths);
+  void request(Handle handle);
+  void work();
+  void collect();
+  void allocate(Entry &entry);
+  void stream();
+  void evict();
+  void free_pixels(Face &face);
+  GLuint create_placeholder(GLenum target);
+
+  std::vector<std::unique_ptr<Entry>> m_entries;
+  std::deque<Handle> m_uploads; // decoded, in upload order
+  // target and paths, and pixel hash of the texture that holds them
+  std::unordered_map<std::string, Handle> m_by_path;
+  std::unordered_map<std::uint64_t, Handle> m_by_content;
+
+  std::size_t m_budget{512u << 20};
+  std::size_t m_gpu_bytes{0};
+  std::size_t m_cpu_bytes{0}; // decoded and waiting for upload
+  std::uint64_t m_frame{1};
+
+  Face m_placeholder_image;
+  GLuint m_placeholder_2d{0};
+  GLuint m_placeholder_cube{0};
+
+  std::size_t m_upload_budget;
+  std::array<GLuint, staging_buffers> m_staging{};
+  std::array<GLsync, staging_buffers> m_fences{};
+  std::size_t m_staging_index{0};
+  std::vector<Chunk> m_chunks;
+
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::deque<Job> m_jobs;
+  std::vector<Job> m_done;
+  bool m_stop{false};
+  std::vector<std::thread> m_workers;
+
+  std::size_t m_loading{0};
+  std::size_t m_evictions{0};
+  std::size_t m_duplicates{0};
+  std::uint64_t m_uploaded_bytes{0};
+  int m_stalled_frames{0}; // the staging buffer was still in use
+};
+
+} // namespace ren
@@ -0,0 +1,79 @@
+#include "trace.hpp"
+
+#include "scene.hpp"
+
+namespace ren {
+
+bool hit_scene(ray const &r, Scene const *world, hit_record &rec) {
+  hit_record temp_rec;
+  float t_min = 0.001;
+  float t_max = infinity;
+  bool hit_anything = false;
+  auto closest_so_far = t_max;
+  for (auto const &object : world->objects()) {
+    if (!object.hit()) {
+      continue;
+    }
+    if (object.hit()(object, r, t_min, closest_so_far, temp_rec)) { // malo
+                                                                    // ruzno
+      hit_anything = true;
+      closest_so_far = temp_rec.t;
+      rec = temp_rec;
+    }
+  }
+  for (auto const &object : world->lights()) {
+    if (!object.hit()) {
+      continue;
+    }
+    if (object.hit()(object, r, t_min, closest_so_far, temp_rec)) { // malo
+                                                                    // ruzno
+      hit_anything = true;
+      closest_so_far = temp_rec.t;
+      rec = temp_rec;
+    }
+  }
+  return hit_anything;
+}
+
+bool occluded(ray const &r, Scene const *world, float t_max,
+              int *last_occluder) {
+  float const t_min = 0.001;
+  auto const blocks = [&](Object const &object) {
+    if (object.occlusion()) {
+      return object.occlusion()(object, r, t_min, t_max);
+    }
+    hit_record temp_rec;
+    return object.hit() && object.hit()(object, r, t_min, t_max, temp_rec);
+  };
+
+  auto const &objects = world->objects();
+  auto const &lights = world->lights();
+  auto const n_objects = static_cast<int>(objects.size());
+  auto const n_total = n_objects + static_cast<int>(lights.size());
+  auto const object_at = [&](int index) -> Object const & {
+    return index < n_objects ? objects[index] : lights[index - n_objects];
+  };
+
+  int cached = -1;
+  if (last_occluder && *last_occluder >= 0 && *last_occluder < n_total) {
+    cached = *last_occluder;
+    if (blocks(object_at(cached))) {
+      return true;
+    }
+  }
+
+  for (int i = 0; i < n_total; ++i) {
+    if (i == cached) {
+      continue;
+    }
+    if (blocks(object_at(i))) {
+      if (last_occluder) {
+        *last_occluder = i;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace ren
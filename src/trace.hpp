@@ -0,0 +1,23 @@
+#pragma once
+
+#include "hittable.hpp"
+#include "ray.hpp"
+
+namespace ren {
+
+class Scene;
+
+// Scene queries of the ray tracer, kept apart from the renderer so they can be
+// measured without a GL context.
+
+// closest hit over objects() and lights()
+bool hit_scene(ray const &r, Scene const *world, hit_record &rec);
+
+// any-hit query for shadow rays: returns on the first intersection found and
+// never fills a hit_record, so no material shared_ptr is copied.
+// `last_occluder` indexes objects() followed by lights(), it is tested first
+// and updated on a hit, -1 means nothing cached.
+bool occluded(ray const &r, Scene const *world, float t_max,
+              int *last_occluder = nullptr);
+
+} // namespace ren
@@ -0,0 +1,105 @@
+#include "uniform_buffer.hpp"
+
+#include <cstring>
+
+#include "gl_profiler.hpp"
+#include "log.hpp"
+
+namespace ren {
+
+FrameUniformBuffer::FrameUniformBuffer() {
+  glGenBuffers(1, &m_buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr,
+               GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+FrameUniformBuffer::~FrameUniformBuffer() { glDeleteBuffers(1, &m_buffer); }
+
+void FrameUniformBuffer::update(FrameUniforms const &frame) {
+  glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+  GlProfiler::the().count_upload(sizeof(FrameUniforms));
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, uniform_binding::frame, m_buffer);
+}
+
+UniformRing::UniformRing(std::size_t region_size) {
+  GLint alignment = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  if (alignment > 0)
+    m_alignment = static_cast<std::size_t>(alignment);
+  m_region_size = (region_size + m_alignment - 1) / m_alignment * m_alignment;
+  auto const size = m_region_size * frames_in_flight;
+
+  glGenBuffers(1, &m_buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+  if (GLAD_GL_ARB_buffer_storage) {
+    GLbitfield const flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags);
+    m_mapped = static_cast<std::byte *>(
+        glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+  }
+  if (m_mapped == nullptr)
+    glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_STREAM_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformRing::~UniformRing() {
+  for (auto &fence : m_fences)
+    if (fence != nullptr)
+      glDeleteSync(fence);
+  if (m_mapped != nullptr) {
+    glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+  glDeleteBuffers(1, &m_buffer);
+}
+
+void UniformRing::wait(std::size_t region) {
+  auto &fence = m_fences[region];
+  if (fence == nullptr)
+    return;
+  while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) ==
+         GL_TIMEOUT_EXPIRED) {
+  }
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+
+void UniformRing::begin_frame() {
+  m_region = (m_region + 1) % frames_in_flight;
+  m_cursor = 0;
+  wait(m_region);
+}
+
+void UniformRing::end_frame() {
+  m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLintptr UniformRing::push(void const *data, std::size_t size) {
+  if (m_cursor + size > m_region_size) {
+    // more draws than fit into a region, start over once the GPU caught up
+    Log::the().add_log("UniformRing: region of %zu bytes is full\n",
+                       m_region_size);
+    m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    wait(m_region);
+    m_cursor = 0;
+  }
+
+  auto const offset = m_region * m_region_size + m_cursor;
+  if (m_mapped != nullptr) {
+    std::memcpy(m_mapped + offset, data, size);
+  } else {
+    glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+  }
+  GlProfiler::the().count_upload(size);
+  m_cursor += (size + m_alignment - 1) / m_alignment * m_alignment;
+  return static_cast<GLintptr>(offset);
+}
+
+} // namespace ren
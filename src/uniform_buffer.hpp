@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+namespace ren {
+
+// Binding points of the uniform blocks, Shader assigns them at link time to
+// every program declaring a block of that name.
+namespace uniform_binding {
+constexpr GLuint frame = 0;
+constexpr GLuint material = 1;
+} // namespace uniform_binding
+
+// std140 layout of `uniform Frame`, set once per frame.
+struct FrameUniforms {
+  glm::mat4 projection;
+  glm::mat4 view;
+  glm::vec4 view_pos;
+  glm::vec4 light_pos;
+  glm::vec4 light_color;
+};
+
+// std140 layout of `uniform Material`, one per draw. Transforms are per
+// instance attributes, see InstanceData.
+struct MaterialUniforms {
+  glm::vec4 ambient;
+  glm::vec4 diffuse;
+  glm::vec4 specular; // w is the shininess
+};
+
+static_assert(sizeof(FrameUniforms) == 176);
+static_assert(sizeof(MaterialUniforms) == 48);
+
+class FrameUniformBuffer final {
+public:
+  FrameUniformBuffer();
+  ~FrameUniformBuffer();
+  FrameUniformBuffer(FrameUniformBuffer const &) = delete;
+  FrameUniformBuffer &operator=(FrameUniformBuffer const &) = delete;
+
+  // uploads and binds the block to uniform_binding::frame
+  void update(FrameUniforms const &frame);
+
+private:
+  GLuint m_buffer{0};
+};
+
+// Streams small per draw blocks through one buffer. The buffer is split into
+// a region per frame in flight, a fence guards each region against being
+// overwritten while the GPU still reads it. With ARB_buffer_storage the
+// buffer stays persistently mapped, otherwise every push is a
+// glBufferSubData into the current region.
+class UniformRing final {
+public:
+  explicit UniformRing(std::size_t region_size = 1 << 20);
+  ~UniformRing();
+  UniformRing(UniformRing const &) = delete;
+  UniformRing &operator=(UniformRing const &) = delete;
+
+  void begin_frame();
+  void end_frame();
+
+  // copies `data` into the ring and binds it to `binding`
+  template <typename T> void bind(GLuint binding, T const &data) {
+    auto const offset = push(&data, sizeof(T));
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, m_buffer, offset, sizeof(T));
+  }
+
+  bool persistent() const { return m_mapped != nullptr; }
+
+private:
+  static constexpr std::size_t frames_in_flight = 3;
+
+  GLintptr push(void const *data, std::size_t size);
+  void wait(std::size_t region);
+
+  GLuint m_buffer{0};
+  std::byte *m_mapped{nullptr};
+  std::size_t m_region_size;
+  std::size_t m_alignment{256};
+  std::size_t m_region{0};
+  std::size_t m_cursor{0};
+  std::array<GLsync, frames_in_flight> m_fences{};
+};
+
+} // namespace ren
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <atomic>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <limits>
 #include <memory>
@@ -11,10 +13,36 @@ float const pi = 3.1415926535897932385;
 
 inline float degrees_to_radians(float degrees) { return degrees * pi / 180.0; }
 
+namespace detail {
+inline std::atomic<std::uint32_t> random_seed{std::mt19937::default_seed};
+inline std::atomic<std::uint32_t> random_epoch{0};
+inline std::atomic<std::uint32_t> random_streams{0};
+} // namespace detail
+
+// Restarts every thread's generator. Stream n, handed out in the order threads
+// draw their first number after the reseed, starts from seed + n * golden, so
+// a single threaded run is fully repeatable.
+inline void seed_random(std::uint32_t seed) {
+  detail::random_seed = seed;
+  detail::random_streams = 0;
+  ++detail::random_epoch;
+}
+
+inline std::mt19937 &random_generator() {
+  thread_local std::mt19937 generator;
+  thread_local std::uint32_t epoch = ~0u;
+  auto const current = detail::random_epoch.load(std::memory_order_relaxed);
+  if (epoch != current) {
+    epoch = current;
+    auto const stream = detail::random_streams.fetch_add(1);
+    generator.seed(detail::random_seed.load() + stream * 0x9E3779B9u);
+  }
+  return generator;
+}
+
 inline float random_float() {
-  static std::uniform_real_distribution<float> distribution(0.0, 1.0);
-  static std::mt19937 generator;
-  return distribution(generator);
+  thread_local std::uniform_real_distribution<float> distribution(0.0, 1.0);
+  return distribution(random_generator());
 }
 inline float random_float(float min, float max) {
   return min + (max - min) * random_float();
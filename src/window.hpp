@@ -19,13 +19,15 @@ namespace ren {
 class Window final {
 public:
   Window(std::string name, int width, int height, bool debug = false) {
-    (void)debug; // currently unused
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    // debug contexts report more through KHR_debug, see GlProfiler
+    if (debug)
+      glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
 
     m_window = glfwCreateWindow(width, height, name.c_str(), nullptr, nullptr);
     if (!m_window) {
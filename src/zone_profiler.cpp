@@ -0,0 +1,198 @@
+#include "zone_profiler.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <fstream>
+
+#include "imgui.h"
+#include "log.hpp"
+
+namespace ren {
+
+namespace {
+
+// gives its ring back when the thread exits, the events stay for export
+struct ThreadSlot {
+  std::atomic<bool> *in_use{nullptr};
+  ~ThreadSlot() {
+    if (in_use != nullptr)
+      in_use->store(false, std::memory_order_release);
+  }
+};
+
+void write_json_string(std::ostream &out, std::string_view s) {
+  out << '"';
+  for (auto const c : s) {
+    if (c == '"' || c == '\\')
+      out << '\\';
+    out << c;
+  }
+  out << '"';
+}
+
+} // namespace
+
+ZoneProfiler &ZoneProfiler::the() {
+  static ZoneProfiler profiler;
+  return profiler;
+}
+
+ZoneProfiler::ThreadZones &ZoneProfiler::thread_zones() {
+  thread_local ThreadSlot slot;
+  thread_local ThreadZones *zones = nullptr;
+  if (zones != nullptr)
+    return *zones;
+
+  std::lock_guard<std::mutex> const lock(m_mutex);
+  // rings of finished threads are reused, e.g. by the next batch of ray
+  // tracing workers, so the number of rings stays bounded
+  for (auto &t : m_threads) {
+    bool expected = false;
+    if (t->in_use.compare_exchange_strong(expected, true)) {
+      zones = t.get();
+      break;
+    }
+  }
+  if (zones == nullptr) {
+    m_threads.push_back(std::make_unique<ThreadZones>());
+    zones = m_threads.back().get();
+    zones->id = static_cast<std::uint32_t>(m_threads.size());
+    zones->name = "thread " + std::to_string(zones->id);
+    zones->in_use = true;
+  }
+  slot.in_use = &zones->in_use;
+  return *zones;
+}
+
+void ZoneProfiler::record(char const *name, std::uint64_t start,
+                          std::uint64_t end) {
+  auto &zones = thread_zones();
+  auto const head = zones.head.load(std::memory_order_relaxed);
+  auto &e = zones.events[head % ring_size];
+  e.name.store(name, std::memory_order_relaxed);
+  e.start.store(start, std::memory_order_relaxed);
+  e.end.store(end, std::memory_order_relaxed);
+  zones.head.store(head + 1, std::memory_order_release);
+}
+
+void ZoneProfiler::set_thread_name(std::string name) {
+  auto &zones = thread_zones();
+  std::lock_guard<std::mutex> const lock(m_mutex);
+  zones.name = std::move(name);
+}
+
+void ZoneProfiler::add_frame_time(double ms) {
+  m_frames[m_n_frames % frame_window] = static_cast<float>(ms);
+  ++m_n_frames;
+}
+
+double ZoneProfiler::frame_percentile(double p) const {
+  auto const n = std::min(m_n_frames, frame_window);
+  if (n == 0)
+    return 0.0;
+  std::vector<float> sorted(m_frames.begin(), m_frames.begin() + n);
+  auto const k = std::min(n - 1, static_cast<std::size_t>(p * n));
+  std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+  return sorted[k];
+}
+
+bool ZoneProfiler::write_trace(std::filesystem::path const &path) {
+  struct Zone {
+    char const *name;
+    std::uint64_t start;
+    std::uint64_t end;
+  };
+
+  std::ofstream out(path);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  bool first_event = true;
+  auto const separator = [&]() -> char const * {
+    auto const s = first_event ? "" : ",\n";
+    first_event = false;
+    return s;
+  };
+
+  std::lock_guard<std::mutex> const lock(m_mutex);
+  std::uint64_t epoch = ~std::uint64_t{0};
+  std::vector<std::vector<Zone>> per_thread(m_threads.size());
+  for (std::size_t t = 0; t < m_threads.size(); ++t) {
+    auto const &zones = *m_threads[t];
+    auto const head = zones.head.load(std::memory_order_acquire);
+    auto const first = head > ring_size ? head - ring_size : 0;
+    for (auto i = first; i < head; ++i) {
+      auto const &e = zones.events[i % ring_size];
+      per_thread[t].push_back({e.name.load(std::memory_order_relaxed),
+                               e.start.load(std::memory_order_relaxed),
+                               e.end.load(std::memory_order_relaxed)});
+    }
+    // the owner kept writing, drop what it may have overwritten meanwhile
+    auto const now_head = zones.head.load(std::memory_order_acquire);
+    auto const overwritten =
+        now_head >= ring_size ? now_head - ring_size + 1 : 0;
+    auto const drop = std::min<std::size_t>(
+        per_thread[t].size(), overwritten > first ? overwritten - first : 0);
+    per_thread[t].erase(per_thread[t].begin(), per_thread[t].begin() + drop);
+    for (auto const &z : per_thread[t])
+      epoch = std::min(epoch, z.start);
+  }
+
+  for (std::size_t t = 0; t < m_threads.size(); ++t) {
+    auto const tid = m_threads[t]->id;
+    out << separator()
+        << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+        << tid << ", \"args\": {\"name\": ";
+    write_json_string(out, m_threads[t]->name);
+    out << "}}";
+    for (auto const &z : per_thread[t]) {
+      out << separator() << "{\"name\": ";
+      write_json_string(out, z.name);
+      out << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+          << ", \"ts\": " << (z.start - epoch) / 1000.0
+          << ", \"dur\": " << (z.end - z.start) / 1000.0 << "}";
+    }
+  }
+  out << "\n]}\n";
+  Log::the().add_log("ZoneProfiler: wrote %s\n", path.c_str());
+  return out.good();
+}
+
+void ZoneProfiler::draw_dialog() {
+  if (!ImGui::CollapsingHeader("Frame profiler"))
+    return;
+
+  auto const n = std::min(m_n_frames, frame_window);
+  ImGui::Text("p50 %.2f ms, p95 %.2f ms, p99 %.2f ms (%zu frames)",
+              frame_percentile(0.5), frame_percentile(0.95),
+              frame_percentile(0.99), n);
+
+  if (n != 0) {
+    // oldest to newest
+    std::array<float, frame_window> ordered{};
+    for (std::size_t i = 0; i < n; ++i)
+      ordered[i] = m_frames[(m_n_frames - n + i) % frame_window];
+    ImGui::PlotLines("frame ms", ordered.data(), n, 0, nullptr, 0.f,
+                     FLT_MAX, ImVec2(0, 60));
+
+    constexpr int n_bins = 32;
+    auto const [lo, hi] = std::minmax_element(ordered.begin(),
+                                              ordered.begin() + n);
+    std::array<float, n_bins> bins{};
+    auto const width = std::max(*hi - *lo, 1e-3f) / n_bins;
+    for (std::size_t i = 0; i < n; ++i)
+      bins[std::min(n_bins - 1, static_cast<int>((ordered[i] - *lo) / width))] +=
+          1.f;
+    auto const label = std::to_string(*lo) + " .. " + std::to_string(*hi) +
+                       " ms";
+    ImGui::PlotHistogram("histogram", bins.data(), n_bins, 0, label.c_str(),
+                         0.f, FLT_MAX, ImVec2(0, 60));
+  }
+
+#ifdef REN_PROFILE
+  if (ImGui::Button("Capture trace"))
+    write_trace("./trace.json");
+#else
+  ImGui::TextUnformatted("zones compiled out, build with -Dprofile=true");
+#endif
+}
+
+} // namespace ren
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ren {
+
+// CPU side counterpart of GlProfiler. Zones are recorded into a ring buffer
+// per thread without locking and exported as Chrome trace JSON, which
+// chrome://tracing and Perfetto open. Frame times feed a rolling window for
+// percentiles. Only REN_ZONE depends on REN_PROFILE (meson -Dprofile=true,
+// off by default), without it zones cost nothing.
+class ZoneProfiler {
+public:
+  // events kept per thread, older ones are overwritten
+  static constexpr std::size_t ring_size = 1 << 14;
+  static constexpr std::size_t frame_window = 512;
+
+  static ZoneProfiler &the();
+
+  static std::uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // `name` must outlive the profiler, string literals in practice
+  void record(char const *name, std::uint64_t start, std::uint64_t end);
+  void set_thread_name(std::string name);
+
+  void add_frame_time(double ms);
+  // p in [0, 1] over the frame window, 0 without frames
+  double frame_percentile(double p) const;
+
+  bool write_trace(std::filesystem::path const &path);
+  void draw_dialog();
+
+private:
+  struct Event {
+    std::atomic<char const *> name{nullptr};
+    std::atomic<std::uint64_t> start{0};
+    std::atomic<std::uint64_t> end{0};
+  };
+
+  // written by its thread only, read by write_trace()
+  struct ThreadZones {
+    std::uint32_t id{0};
+    std::string name;
+    std::atomic<bool> in_use{false};
+    std::atomic<std::uint64_t> head{0};
+    std::array<Event, ring_size> events;
+  };
+
+  ZoneProfiler() = default;
+  ThreadZones &thread_zones();
+
+  std::mutex m_mutex; // guards m_threads and the thread names
+  std::vector<std::unique_ptr<ThreadZones>> m_threads;
+
+  std::array<float, frame_window> m_frames{};
+  std::size_t m_n_frames{0};
+};
+
+class ZoneScope {
+public:
+  explicit ZoneScope(char const *name)
+      : m_name(name), m_start(ZoneProfiler::now_ns()) {}
+  ~ZoneScope() {
+    ZoneProfiler::the().record(m_name, m_start, ZoneProfiler::now_ns());
+  }
+  ZoneScope(ZoneScope const &) = delete;
+  ZoneScope &operator=(ZoneScope const &) = delete;
+
+private:
+  char const *m_name;
+  std::uint64_t m_start;
+};
+
+} // namespace ren
+
+#define REN_ZONE_CONCAT_(a, b) a##b
+#define REN_ZONE_CONCAT(a, b) REN_ZONE_CONCAT_(a, b)
+
+#ifdef REN_PROFILE
+#define REN_ZONE(name)                                                         \
+  ::ren::ZoneScope REN_ZONE_CONCAT(ren_zone_, __LINE__) { name }
+#define REN_THREAD_NAME(name) ::ren::ZoneProfiler::the().set_thread_name(name)
+#else
+#define REN_ZONE(name) static_cast<void>(0)
+#define REN_THREAD_NAME(name) static_cast<void>(0)
+#endif
@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+# Writes a C++ source defining ren::embedded_shader() for the given GLSL
+# files, see src/embedded_shaders.hpp.
+#
+#   embed_shaders.py OUTPUT SHADER...
+
+import os
+import sys
+
+DELIMITER = 'ren_glsl'
+
+
+def main():
+    output, shaders = sys.argv[1], sys.argv[2:]
+    entries = []
+    for path in sorted(shaders, key=os.path.basename):
+        with open(path, encoding='utf-8') as f:
+            source = f.read()
+        if ')' + DELIMITER + '"' in source:
+            sys.exit(f'{path}: contains the raw string delimiter')
+        entries.append((os.path.basename(path), source))
+
+    with open(output, 'w', encoding='utf-8') as out:
+        out.write('// generated by tools/embed_shaders.py, do not edit\n\n')
+        out.write('#include "embedded_shaders.hpp"\n\n')
+        out.write('#include <algorithm>\n#include <iterator>\n\n')
+        out.write('namespace ren {\nnamespace {\n\n')
+        out.write('struct Entry {\n  std::string_view name;\n'
+                  '  std::string_view source;\n};\n\n')
+        out.write('// sorted by name\nconstexpr Entry entries[] = {\n')
+        for name, source in entries:
+            out.write(f'    {{"{name}",\n'
+                      f'     R"{DELIMITER}({source}){DELIMITER}"}},\n')
+        out.write('};\n\n} // namespace\n\n')
+        out.write('std::optional<std::string_view> '
+                  'embedded_shader(std::string_view name) {\n'
+                  '  auto const it = std::lower_bound(\n'
+                  '      std::begin(entries), std::end(entries), name,\n'
+                  '      [](Entry const &e, std::string_view n) '
+                  '{ return e.name < n; });\n'
+                  '  if (it == std::end(entries) || it->name != name)\n'
+                  '    return std::nullopt;\n'
+                  '  return it->source;\n}\n\n'
+                  '} // namespace ren\n')
+
+
+if __name__ == '__main__':
+    main()